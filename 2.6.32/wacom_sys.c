@@ -11,6 +11,10 @@
 #include "wacom_wac.h"
 #include "wacom.h"
 
+static unsigned int urbs = 4;
+module_param(urbs, uint, 0444);
+MODULE_PARM_DESC(urbs, " interrupt URBs kept in flight per interface (1-16, default 4)");
+
 /* defines to get HID report descriptor */
 #define HID_DEVICET_HID		(USB_TYPE_CLASS | 0x01)
 #define HID_DEVICET_REPORT	(USB_TYPE_CLASS | 0x02)
@@ -105,36 +109,155 @@ static void wacom_sys_irq(struct urb *urb)
 		dev_dbg(dev, "%s - urb shutting down with status: %d\n",
 			__func__, urb->status);
 		return;
+	case -EOVERFLOW:
+		wacom->urbs_overrun++;
+		goto exit;
 	default:
 		dev_dbg(dev, "%s - nonzero urb status received: %d\n",
 			__func__, urb->status);
+		wacom->urbs_dropped++;
 		goto exit;
 	}
 
+	/*
+	 * URBs queued on one endpoint complete in submission order, so
+	 * decoding straight from each one's buffer keeps reports in order.
+	 */
+	wacom->wacom_wac.data = urb->transfer_buffer;
 	wacom_wac_irq(&wacom->wacom_wac, urb->actual_length);
 
  exit:
 	usb_mark_last_busy(wacom->usbdev);
+	usb_anchor_urb(urb, &wacom->anchor);
 	retval = usb_submit_urb(urb, GFP_ATOMIC);
-	if (retval)
+	if (retval) {
+		usb_unanchor_urb(urb);
+		wacom->urbs_dropped++;
 		dev_err(dev, "%s - usb_submit_urb failed with result %d\n",
 			__func__, retval);
+	}
+}
+
+static int wacom_submit_urbs(struct wacom *wacom, gfp_t mem_flags)
+{
+	int i, error;
+
+	for (i = 0; i < wacom->num_urbs; i++) {
+		wacom->urbs[i]->dev = wacom->usbdev;
+		usb_anchor_urb(wacom->urbs[i], &wacom->anchor);
+		error = usb_submit_urb(wacom->urbs[i], mem_flags);
+		if (error) {
+			usb_unanchor_urb(wacom->urbs[i]);
+			usb_kill_anchored_urbs(&wacom->anchor);
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+static void wacom_free_urbs(struct wacom *wacom)
+{
+	int i;
+
+	for (i = 0; i < wacom->num_urbs; i++) {
+		struct urb *urb = wacom->urbs[i];
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
+		usb_buffer_free(wacom->usbdev, WACOM_PKGLEN_MAX,
+				urb->transfer_buffer, urb->transfer_dma);
+#else
+		usb_free_coherent(wacom->usbdev, WACOM_PKGLEN_MAX,
+				  urb->transfer_buffer, urb->transfer_dma);
+#endif
+		usb_free_urb(urb);
+	}
+	wacom->num_urbs = 0;
+}
+
+static int wacom_alloc_urbs(struct wacom *wacom,
+			    struct usb_endpoint_descriptor *endpoint)
+{
+	struct usb_device *dev = wacom->usbdev;
+	struct wacom_features *features = &wacom->wacom_wac.features;
+	unsigned int count = clamp_t(unsigned int, urbs, 1, WACOM_URBS_MAX);
+
+	init_usb_anchor(&wacom->anchor);
+
+	while (wacom->num_urbs < count) {
+		struct urb *urb;
+		dma_addr_t dma;
+		void *buf;
+
+		urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!urb)
+			goto fail;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
+		buf = usb_buffer_alloc(dev, WACOM_PKGLEN_MAX, GFP_KERNEL, &dma);
+#else
+		buf = usb_alloc_coherent(dev, WACOM_PKGLEN_MAX, GFP_KERNEL, &dma);
+#endif
+		if (!buf) {
+			usb_free_urb(urb);
+			goto fail;
+		}
+
+		usb_fill_int_urb(urb, dev,
+				 usb_rcvintpipe(dev, endpoint->bEndpointAddress),
+				 buf, features->pktlen,
+				 wacom_sys_irq, wacom, endpoint->bInterval);
+		urb->transfer_dma = dma;
+		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+		wacom->urbs[wacom->num_urbs++] = urb;
+	}
+
+	wacom->wacom_wac.data = wacom->urbs[0]->transfer_buffer;
+	return 0;
+
+ fail:
+	wacom_free_urbs(wacom);
+	return -ENOMEM;
 }
 
+#define DEVICE_URB_ATTR(name, fmt)					\
+static ssize_t wacom_##name##_show(struct device *dev,			\
+	struct device_attribute *attr, char *buf)			\
+{									\
+	struct wacom *wacom = dev_get_drvdata(dev);			\
+	return snprintf(buf, PAGE_SIZE, fmt "\n", wacom->name);		\
+}									\
+static DEVICE_ATTR(name, S_IRUSR, wacom_##name##_show, NULL)
+
+DEVICE_URB_ATTR(num_urbs, "%u");
+DEVICE_URB_ATTR(urbs_dropped, "%lu");
+DEVICE_URB_ATTR(urbs_overrun, "%lu");
+
+static struct attribute *urb_attrs[] = {
+	&dev_attr_num_urbs.attr,
+	&dev_attr_urbs_dropped.attr,
+	&dev_attr_urbs_overrun.attr,
+	NULL
+};
+
+static struct attribute_group urb_attr_group = {
+	.attrs = urb_attrs,
+};
+
+
 static int wacom_open(struct input_dev *dev)
 {
 	struct wacom *wacom = input_get_drvdata(dev);
 
 	mutex_lock(&wacom->lock);
 
-	wacom->irq->dev = wacom->usbdev;
-
 	if (usb_autopm_get_interface(wacom->intf) < 0) {
 		mutex_unlock(&wacom->lock);
 		return -EIO;
 	}
 
-	if (usb_submit_urb(wacom->irq, GFP_KERNEL)) {
+	if (wacom_submit_urbs(wacom, GFP_KERNEL)) {
 		usb_autopm_put_interface(wacom->intf);
 		mutex_unlock(&wacom->lock);
 		return -EIO;
@@ -152,7 +275,7 @@ static void wacom_close(struct input_dev *dev)
 	struct wacom *wacom = input_get_drvdata(dev);
 
 	mutex_lock(&wacom->lock);
-	usb_kill_urb(wacom->irq);
+	usb_kill_anchored_urbs(&wacom->anchor);
 	wacom->open = false;
 	wacom->intf->needs_remote_wakeup = 0;
 	mutex_unlock(&wacom->lock);
@@ -943,24 +1066,6 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 		goto fail1;
 	}
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
-	wacom_wac->data = usb_buffer_alloc(dev, WACOM_PKGLEN_MAX,
-					   GFP_KERNEL, &wacom->data_dma);
-#else
-	wacom_wac->data = usb_alloc_coherent(dev, WACOM_PKGLEN_MAX,
-					     GFP_KERNEL, &wacom->data_dma);
-#endif
-	if (!wacom_wac->data) {
-		error = -ENOMEM;
-		goto fail1;
-	}
-
-	wacom->irq = usb_alloc_urb(0, GFP_KERNEL);
-	if (!wacom->irq) {
-		error = -ENOMEM;
-		goto fail2;
-	}
-
 	wacom->usbdev = dev;
 	wacom->intf = intf;
 	mutex_init(&wacom->lock);
@@ -974,7 +1079,7 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 	/* Retrieve the physical and logical size for OEM devices */
 	error = wacom_retrieve_hid_descriptor(intf, features);
 	if (error)
-		goto fail2;
+		goto fail1;
 
 	wacom_setup_device_quirks(wacom);
 
@@ -990,7 +1095,7 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 		other_dev = dev;
 	error = wacom_add_shared_data(wacom_wac, other_dev);
 	if (error)
-		goto fail3;
+		goto fail1;
 
 	input_dev->name = wacom_wac->name;
 	input_dev->dev.parent = &intf->dev;
@@ -1001,20 +1106,24 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 
 	wacom_setup_input_capabilities(input_dev, wacom_wac);
 
-	usb_fill_int_urb(wacom->irq, dev,
-			 usb_rcvintpipe(dev, endpoint->bEndpointAddress),
-			 wacom_wac->data, features->pktlen,
-			 wacom_sys_irq, wacom, endpoint->bInterval);
-	wacom->irq->transfer_dma = wacom->data_dma;
-	wacom->irq->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+	error = wacom_alloc_urbs(wacom, endpoint);
+	if (error)
+		goto fail4;
+
+	/* the sysfs attributes below find wacom through it */
+	usb_set_intfdata(intf, wacom);
 
 	error = wacom_initialize_leds(wacom);
 	if (error)
-		goto fail4;
+		goto fail5;
+
+	error = wacom_devm_sysfs_create_group(wacom, &urb_attr_group);
+	if (error)
+		goto fail5;
 
 	error = input_register_device(input_dev);
 	if (error)
-		goto fail4;
+		goto fail5;
 
 	if (wacom_wac->features.touch_max && wacom_wac->shared) {
 		if (wacom_wac->features.device_type == BTN_TOOL_DOUBLETAP ||
@@ -1027,16 +1136,11 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 	/* Note that if query fails it is not a hard failure */
 	wacom_query_tablet_data(intf, features);
 
-	usb_set_intfdata(intf, wacom);
 	return 0;
 
+ fail5:	usb_set_intfdata(intf, NULL);
+	wacom_free_urbs(wacom);
  fail4:	wacom_remove_shared_data(wacom_wac);
- fail3:	usb_free_urb(wacom->irq);
-#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
- fail2:	usb_buffer_free(dev, WACOM_PKGLEN_MAX, wacom_wac->data, wacom->data_dma);
-#else
- fail2: usb_free_coherent(dev, WACOM_PKGLEN_MAX, wacom_wac->data, wacom->data_dma);
-#endif
  fail1:	input_free_device(input_dev);
 	return error;
 }
@@ -1047,16 +1151,9 @@ static void wacom_disconnect(struct usb_interface *intf)
 
 	usb_set_intfdata(intf, NULL);
 
-	usb_kill_urb(wacom->irq);
+	usb_kill_anchored_urbs(&wacom->anchor);
 	input_unregister_device(wacom->wacom_wac.input);
-	usb_free_urb(wacom->irq);
-#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
-	usb_buffer_free(interface_to_usbdev(intf), WACOM_PKGLEN_MAX,
-			wacom->wacom_wac.data, wacom->data_dma);
-#else
-	usb_free_coherent(interface_to_usbdev(intf), WACOM_PKGLEN_MAX,
-			wacom->wacom_wac.data, wacom->data_dma);
-#endif
+	wacom_free_urbs(wacom);
 	wacom_remove_shared_data(&wacom->wacom_wac);
 }
 
@@ -1065,7 +1162,7 @@ static int wacom_suspend(struct usb_interface *intf, pm_message_t message)
 	struct wacom *wacom = usb_get_intfdata(intf);
 
 	mutex_lock(&wacom->lock);
-	usb_kill_urb(wacom->irq);
+	usb_kill_anchored_urbs(&wacom->anchor);
 	mutex_unlock(&wacom->lock);
 
 	return 0;
@@ -1084,7 +1181,7 @@ static int wacom_resume(struct usb_interface *intf)
 	wacom_led_control(wacom);
 
 	if (wacom->open)
-		rv = usb_submit_urb(wacom->irq, GFP_NOIO);
+		rv = wacom_submit_urbs(wacom, GFP_NOIO);
 	else
 		rv = 0;
 	mutex_unlock(&wacom->lock);
@@ -141,11 +141,17 @@ struct wacom_remote {
 	} remotes[WACOM_MAX_REMOTES];
 };
 
+/* interrupt URBs kept in flight, see the "urbs" module parameter */
+#define WACOM_URBS_MAX		16
+
 struct wacom {
-	dma_addr_t data_dma;
 	struct usb_device *usbdev;
 	struct usb_interface *intf;
-	struct urb *irq;
+	struct urb *urbs[WACOM_URBS_MAX];
+	unsigned int num_urbs;
+	struct usb_anchor anchor;
+	unsigned long urbs_dropped;
+	unsigned long urbs_overrun;
 	struct wacom_wac wacom_wac;
 	struct mutex lock;
 	struct work_struct wireless_work;
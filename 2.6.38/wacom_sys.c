@@ -64,6 +64,10 @@ struct hid_descriptor {
 #define WAC_CMD_UNPAIR_ALL	0xFF
 #define WAC_REMOTE_SERIAL_MAX_STRLEN	9
 
+static unsigned int urbs = 4;
+module_param(urbs, uint, 0444);
+MODULE_PARM_DESC(urbs, " interrupt URBs kept in flight per interface (1-16, default 4)");
+
 #define DEV_ATTR_RW_PERM (S_IRUGO | S_IWUSR | S_IWGRP)
 #define DEV_ATTR_WO_PERM (S_IWUSR | S_IWGRP)
 #define DEV_ATTR_RO_PERM (S_IRUSR | S_IRGRP)
@@ -128,22 +132,133 @@ static void wacom_sys_irq(struct urb *urb)
 		dev_dbg(dev, "%s - urb shutting down with status: %d\n",
 			__func__, urb->status);
 		return;
+	case -EOVERFLOW:
+		wacom->urbs_overrun++;
+		goto exit;
 	default:
 		dev_dbg(dev, "%s - nonzero urb status received: %d\n",
 			__func__, urb->status);
+		wacom->urbs_dropped++;
 		goto exit;
 	}
 
+	/*
+	 * URBs queued on one endpoint complete in submission order, so
+	 * decoding straight from each one's buffer keeps reports in order.
+	 */
+	wacom->wacom_wac.data = urb->transfer_buffer;
 	wacom_wac_irq(&wacom->wacom_wac, urb->actual_length);
 
  exit:
 	usb_mark_last_busy(wacom->usbdev);
+	usb_anchor_urb(urb, &wacom->anchor);
 	retval = usb_submit_urb(urb, GFP_ATOMIC);
-	if (retval)
+	if (retval) {
+		usb_unanchor_urb(urb);
+		wacom->urbs_dropped++;
 		dev_err(dev, "%s - usb_submit_urb failed with result %d\n",
 			__func__, retval);
+	}
+}
+
+static int wacom_submit_urbs(struct wacom *wacom, gfp_t mem_flags)
+{
+	int i, error;
+
+	for (i = 0; i < wacom->num_urbs; i++) {
+		usb_anchor_urb(wacom->urbs[i], &wacom->anchor);
+		error = usb_submit_urb(wacom->urbs[i], mem_flags);
+		if (error) {
+			usb_unanchor_urb(wacom->urbs[i]);
+			usb_kill_anchored_urbs(&wacom->anchor);
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+static void wacom_free_urbs(struct wacom *wacom)
+{
+	int i;
+
+	for (i = 0; i < wacom->num_urbs; i++) {
+		struct urb *urb = wacom->urbs[i];
+
+		usb_free_coherent(wacom->usbdev, WACOM_PKGLEN_MAX,
+				  urb->transfer_buffer, urb->transfer_dma);
+		usb_free_urb(urb);
+	}
+	wacom->num_urbs = 0;
+}
+
+static int wacom_alloc_urbs(struct wacom *wacom,
+			    struct usb_endpoint_descriptor *endpoint)
+{
+	struct usb_device *dev = wacom->usbdev;
+	struct wacom_features *features = &wacom->wacom_wac.features;
+	unsigned int count = clamp_t(unsigned int, urbs, 1, WACOM_URBS_MAX);
+
+	init_usb_anchor(&wacom->anchor);
+
+	while (wacom->num_urbs < count) {
+		struct urb *urb;
+		dma_addr_t dma;
+		void *buf;
+
+		urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!urb)
+			goto fail;
+
+		buf = usb_alloc_coherent(dev, WACOM_PKGLEN_MAX, GFP_KERNEL, &dma);
+		if (!buf) {
+			usb_free_urb(urb);
+			goto fail;
+		}
+
+		usb_fill_int_urb(urb, dev,
+				 usb_rcvintpipe(dev, endpoint->bEndpointAddress),
+				 buf, features->pktlen,
+				 wacom_sys_irq, wacom, endpoint->bInterval);
+		urb->transfer_dma = dma;
+		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+		wacom->urbs[wacom->num_urbs++] = urb;
+	}
+
+	wacom->wacom_wac.data = wacom->urbs[0]->transfer_buffer;
+	return 0;
+
+ fail:
+	wacom_free_urbs(wacom);
+	return -ENOMEM;
 }
 
+#define DEVICE_URB_ATTR(name, fmt)					\
+static ssize_t wacom_##name##_show(struct device *dev,			\
+	struct device_attribute *attr, char *buf)			\
+{									\
+	struct wacom *wacom = dev_get_drvdata(dev);			\
+	return snprintf(buf, PAGE_SIZE, fmt "\n", wacom->name);		\
+}									\
+static DEVICE_ATTR(name, DEV_ATTR_RO_PERM, wacom_##name##_show, NULL)
+
+DEVICE_URB_ATTR(num_urbs, "%u");
+DEVICE_URB_ATTR(urbs_dropped, "%lu");
+DEVICE_URB_ATTR(urbs_overrun, "%lu");
+
+static struct attribute *urb_attrs[] = {
+	&dev_attr_num_urbs.attr,
+	&dev_attr_urbs_dropped.attr,
+	&dev_attr_urbs_overrun.attr,
+	NULL
+};
+
+static struct attribute_group urb_attr_group = {
+	.attrs = urb_attrs,
+};
+
+
 static int wacom_open(struct input_dev *dev)
 {
 	struct wacom *wacom = input_get_drvdata(dev);
@@ -154,7 +269,7 @@ static int wacom_open(struct input_dev *dev)
 
 	mutex_lock(&wacom->lock);
 
-	if (usb_submit_urb(wacom->irq, GFP_KERNEL)) {
+	if (wacom_submit_urbs(wacom, GFP_KERNEL)) {
 		retval = -EIO;
 		goto out;
 	}
@@ -176,7 +291,7 @@ static void wacom_close(struct input_dev *dev)
 	autopm_error = usb_autopm_get_interface(wacom->intf);
 
 	mutex_lock(&wacom->lock);
-	usb_kill_urb(wacom->irq);
+	usb_kill_anchored_urbs(&wacom->anchor);
 	wacom->open = false;
 	wacom->intf->needs_remote_wakeup = 0;
 	mutex_unlock(&wacom->lock);
@@ -1957,19 +2072,6 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 		goto fail1;
 	}
 
-	wacom_wac->data = usb_alloc_coherent(dev, WACOM_PKGLEN_MAX,
-					     GFP_KERNEL, &wacom->data_dma);
-	if (!wacom_wac->data) {
-		error = -ENOMEM;
-		goto fail1;
-	}
-
-	wacom->irq = usb_alloc_urb(0, GFP_KERNEL);
-	if (!wacom->irq) {
-		error = -ENOMEM;
-		goto fail2;
-	}
-
 	wacom->usbdev = dev;
 	wacom->intf = intf;
 	mutex_init(&wacom->lock);
@@ -2010,17 +2112,14 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 	if (error)
 		goto fail3;
 
-	usb_fill_int_urb(wacom->irq, dev,
-			 usb_rcvintpipe(dev, endpoint->bEndpointAddress),
-			 wacom_wac->data, features->pktlen,
-			 wacom_sys_irq, wacom, endpoint->bInterval);
-	wacom->irq->transfer_dma = wacom->data_dma;
-	wacom->irq->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+	error = wacom_alloc_urbs(wacom, endpoint);
+	if (error)
+		goto fail4;
 
 	if (!(features->quirks & WACOM_QUIRK_NO_INPUT)) {
 		error = wacom_register_input(wacom);
 		if (error)
-			goto fail4;
+			goto fail5;
 	}
 
 	/* Note that if query fails it is not a hard failure */
@@ -2028,21 +2127,25 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 
 	usb_set_intfdata(intf, wacom);
 
+	error = wacom_devm_sysfs_create_group(wacom, &urb_attr_group);
+	if (error)
+		goto fail5;
+
 	if (features->quirks & WACOM_QUIRK_MONITOR) {
-		if (usb_submit_urb(wacom->irq, GFP_KERNEL)) {
+		if (wacom_submit_urbs(wacom, GFP_KERNEL)) {
 			error = -EIO;
-			goto fail4;
+			goto fail5;
 		}
 	}
 
 	error = wacom_initialize_leds(wacom);
 	if (error)
-		goto fail4;
+		goto fail6;
 
 	if (wacom->wacom_wac.features.type == REMOTE) {
 		error = wacom_initialize_remotes(wacom);
 		if (error)
-			goto fail4;
+			goto fail6;
 	}
 
 	if (wacom_wac->features.touch_max && wacom_wac->shared) {
@@ -2054,10 +2157,10 @@ static int wacom_probe(struct usb_interface *intf, const struct usb_device_id *i
 
 	return 0;
 
+ fail6:	usb_kill_anchored_urbs(&wacom->anchor);
+ fail5:	wacom_free_urbs(wacom);
  fail4:	wacom_remove_shared_data(wacom_wac);
- fail3:	usb_free_urb(wacom->irq);
-	wacom_destroy_battery(wacom);
- fail2:	usb_free_coherent(dev, WACOM_PKGLEN_MAX, wacom_wac->data, wacom->data_dma);
+ fail3:	wacom_destroy_battery(wacom);
  fail1:
 	return error;
 }
@@ -2068,16 +2171,14 @@ static void wacom_disconnect(struct usb_interface *intf)
 
 	usb_set_intfdata(intf, NULL);
 
-	usb_kill_urb(wacom->irq);
+	usb_kill_anchored_urbs(&wacom->anchor);
 	cancel_work_sync(&wacom->wireless_work);
 	cancel_work_sync(&wacom->battery_work);
 	cancel_work_sync(&wacom->remote_work);
 	wacom_remotes_destroy(wacom);
 	wacom_unregister_inputs(wacom);
 	wacom_destroy_battery(wacom);
-	usb_free_urb(wacom->irq);
-	usb_free_coherent(interface_to_usbdev(intf), WACOM_PKGLEN_MAX,
-			wacom->wacom_wac.data, wacom->data_dma);
+	wacom_free_urbs(wacom);
 	wacom_remove_shared_data(&wacom->wacom_wac);
 	kfree(wacom->wacom_wac.slots);
 }
@@ -2087,7 +2188,7 @@ static int wacom_suspend(struct usb_interface *intf, pm_message_t message)
 	struct wacom *wacom = usb_get_intfdata(intf);
 
 	mutex_lock(&wacom->lock);
-	usb_kill_urb(wacom->irq);
+	usb_kill_anchored_urbs(&wacom->anchor);
 	mutex_unlock(&wacom->lock);
 
 	return 0;
@@ -2106,7 +2207,7 @@ static int wacom_resume(struct usb_interface *intf)
 	wacom_led_control(wacom);
 
 	if ((wacom->open || (features->quirks & WACOM_QUIRK_MONITOR)) &&
-	    usb_submit_urb(wacom->irq, GFP_NOIO) < 0)
+	    wacom_submit_urbs(wacom, GFP_NOIO) < 0)
 		rv = -EIO;
 
 	mutex_unlock(&wacom->lock);
@@ -88,6 +88,10 @@ struct w8001 {
 	struct completion cmd_done;
 	int id;
 	int idx;
+	unsigned int expected;	/* length of the packet being assembled */
+	bool lost;		/* bytes were dropped since the last packet */
+	unsigned long resyncs;
+	unsigned long dropped;
 	unsigned char response_type;
 	unsigned char response[W8001_MAX_LENGTH];
 	unsigned char data[W8001_MAX_LENGTH];
@@ -278,79 +282,91 @@ static void report_single_touch(struct w8001 *w8001, struct w8001_coord *coord)
 	w8001->type = coord->tsw ? BTN_TOOL_FINGER : KEY_RESERVED;
 }
 
-static irqreturn_t w8001_interrupt(struct serio *serio,
-				   unsigned char data, unsigned int flags)
+/*
+ * Only the first byte of a packet has W8001_LEAD_BYTE set, and it tells
+ * what kind of packet follows. Returns the packet length, or 0 when the
+ * packet cannot be handled (touch data before the touch query).
+ */
+static unsigned int w8001_packet_length(struct w8001 *w8001, unsigned char lead)
 {
-	struct w8001 *w8001 = serio_get_drvdata(serio);
-	struct w8001_coord coord;
-	unsigned char tmp;
+	if ((lead & W8001_TOUCH_MASK) == W8001_TOUCH_BYTE)
+		return w8001->pktlen;
 
-	w8001->data[w8001->idx] = data;
-	switch (w8001->idx++) {
-	case 0:
-		if ((data & W8001_LEAD_MASK) != W8001_LEAD_BYTE) {
-			pr_debug("w8001: unsynchronized data: 0x%02x\n", data);
-			w8001->idx = 0;
-		}
-		break;
+	if ((lead & W8001_TAB_MASK) == W8001_TAB_BYTE)
+		return W8001_PKTLEN_TPCCTL;
 
-	case W8001_PKTLEN_TOUCH93 - 1:
-	case W8001_PKTLEN_TOUCH9A - 1:
-		tmp = w8001->data[0] & W8001_TOUCH_BYTE;
-		if (tmp != W8001_TOUCH_BYTE)
-			break;
+	return W8001_PKTLEN_TPCPEN;
+}
 
-		if (w8001->pktlen == w8001->idx) {
-			w8001->idx = 0;
-			if (w8001->type != BTN_TOOL_PEN &&
-			    w8001->type != BTN_TOOL_RUBBER) {
-				parse_single_touch(w8001->data, &coord);
-				report_single_touch(w8001, &coord);
-			}
+static void w8001_dispatch(struct w8001 *w8001)
+{
+	struct w8001_coord coord;
+	unsigned char lead = w8001->data[0];
+
+	/* touch data */
+	if ((lead & W8001_TOUCH_MASK) == W8001_TOUCH_BYTE) {
+		if (!w8001->touch_dev)
+			return;
+
+		if (w8001->pktlen == W8001_PKTLEN_TOUCH2FG) {
+			parse_multi_touch(w8001);
+		} else if (w8001->type != BTN_TOOL_PEN &&
+			   w8001->type != BTN_TOOL_RUBBER) {
+			parse_single_touch(w8001->data, &coord);
+			report_single_touch(w8001, &coord);
 		}
-		break;
-
-	/* Pen coordinates packet */
-	case W8001_PKTLEN_TPCPEN - 1:
-		tmp = w8001->data[0] & W8001_TAB_MASK;
-		if (unlikely(tmp == W8001_TAB_BYTE))
-			break;
+		return;
+	}
 
-		tmp = w8001->data[0] & W8001_TOUCH_BYTE;
-		if (tmp == W8001_TOUCH_BYTE)
-			break;
+	/* control packet */
+	if ((lead & W8001_TAB_MASK) == W8001_TAB_BYTE) {
+		memcpy(w8001->response, w8001->data, W8001_MAX_LENGTH);
+		w8001->response_type = W8001_QUERY_PACKET;
+		complete(&w8001->cmd_done);
+		return;
+	}
 
-		w8001->idx = 0;
+	/* Pen coordinates packet */
+	if (w8001->pen_dev) {
 		parse_pen_data(w8001->data, &coord);
 		report_pen_events(w8001, &coord);
-		break;
+	}
+}
 
-	/* control packet */
-	case W8001_PKTLEN_TPCCTL - 1:
-		tmp = w8001->data[0] & W8001_TOUCH_MASK;
-		if (tmp == W8001_TOUCH_BYTE)
-			break;
+static irqreturn_t w8001_interrupt(struct serio *serio,
+				   unsigned char data, unsigned int flags)
+{
+	struct w8001 *w8001 = serio_get_drvdata(serio);
 
+	/*
+	 * A lead byte always starts a new packet. If it arrives in the
+	 * middle of one, the line lost bytes: drop the partial packet and
+	 * carry on from here rather than waiting for the next lead byte.
+	 */
+	if ((data & W8001_LEAD_MASK) == W8001_LEAD_BYTE) {
+		if (w8001->idx || w8001->lost) {
+			pr_debug("w8001: resynchronized after %d bytes\n",
+				 w8001->idx);
+			w8001->dropped += w8001->idx;
+			w8001->resyncs++;
+			w8001->lost = false;
+		}
 		w8001->idx = 0;
-		memcpy(w8001->response, w8001->data, W8001_MAX_LENGTH);
-		w8001->response_type = W8001_QUERY_PACKET;
-		complete(&w8001->cmd_done);
-		break;
+		w8001->expected = w8001_packet_length(w8001, data);
+	}
 
-	/* 2 finger touch packet */
-	case W8001_PKTLEN_TOUCH2FG - 1:
-		w8001->idx = 0;
-		parse_multi_touch(w8001);
-		break;
+	if (!w8001->expected) {
+		pr_debug("w8001: unsynchronized data: 0x%02x\n", data);
+		w8001->dropped++;
+		w8001->lost = true;
+		return IRQ_HANDLED;
+	}
 
-	default:
-		/*
-		 * ThinkPad X60 Tablet PC (pen only device) sometimes
-		 * sends invalid data packets that are larger than
-		 * W8001_PKTLEN_TPCPEN. Let's start over again.
-		 */
-		if (!w8001->touch_dev && w8001->idx > W8001_PKTLEN_TPCPEN - 1)
-			w8001->idx = 0;
+	w8001->data[w8001->idx++] = data;
+	if (w8001->idx == w8001->expected) {
+		w8001->idx = 0;
+		w8001->expected = 0;
+		w8001_dispatch(w8001);
 	}
 
 	return IRQ_HANDLED;
@@ -549,6 +565,31 @@ static int w8001_setup_touch(struct w8001 *w8001, char *basename,
 	return 0;
 }
 
+#define W8001_STAT_ATTR(name)						\
+static ssize_t w8001_##name##_show(struct device *dev,			\
+				   struct device_attribute *attr,	\
+				   char *buf)				\
+{									\
+	struct w8001 *w8001 = dev_get_drvdata(dev);			\
+									\
+	return sprintf(buf, "%lu\n", w8001->name);			\
+}									\
+static DEVICE_ATTR(name, S_IRUGO, w8001_##name##_show, NULL)
+
+W8001_STAT_ATTR(resyncs);
+W8001_STAT_ATTR(dropped);
+
+static struct attribute *w8001_attrs[] = {
+	&dev_attr_resyncs.attr,
+	&dev_attr_dropped.attr,
+	NULL
+};
+
+static struct attribute_group w8001_attr_group = {
+	.name = "w8001",
+	.attrs = w8001_attrs,
+};
+
 static void w8001_set_devdata(struct input_dev *dev, struct w8001 *w8001,
 			      struct serio *serio)
 {
@@ -573,6 +614,7 @@ static void w8001_disconnect(struct serio *serio)
 {
 	struct w8001 *w8001 = serio_get_drvdata(serio);
 
+	sysfs_remove_group(&serio->dev.kobj, &w8001_attr_group);
 	serio_close(serio);
 
 	if (w8001->pen_dev)
@@ -618,10 +660,14 @@ static int w8001_connect(struct serio *serio, struct serio_driver *drv)
 	if (err)
 		goto fail2;
 
-	err = w8001_detect(w8001);
+	err = sysfs_create_group(&serio->dev.kobj, &w8001_attr_group);
 	if (err)
 		goto fail3;
 
+	err = w8001_detect(w8001);
+	if (err)
+		goto fail4;
+
 	/* For backwards-compatibility we compose the basename based on
 	 * capabilities and then just append the tool type
 	 */
@@ -631,7 +677,7 @@ static int w8001_connect(struct serio *serio, struct serio_driver *drv)
 	err_touch = w8001_setup_touch(w8001, basename, sizeof(basename));
 	if (err_pen && err_touch) {
 		err = -ENXIO;
-		goto fail3;
+		goto fail4;
 	}
 
 	if (!err_pen) {
@@ -643,7 +689,7 @@ static int w8001_connect(struct serio *serio, struct serio_driver *drv)
 
 		err = input_register_device(w8001->pen_dev);
 		if (err)
-			goto fail3;
+			goto fail4;
 	} else {
 		input_free_device(input_dev_pen);
 		input_dev_pen = NULL;
@@ -660,7 +706,7 @@ static int w8001_connect(struct serio *serio, struct serio_driver *drv)
 
 		err = input_register_device(w8001->touch_dev);
 		if (err)
-			goto fail4;
+			goto fail5;
 	} else {
 		input_free_device(input_dev_touch);
 		input_dev_touch = NULL;
@@ -669,9 +715,11 @@ static int w8001_connect(struct serio *serio, struct serio_driver *drv)
 
 	return 0;
 
-fail4:
+fail5:
 	if (w8001->pen_dev)
 		input_unregister_device(w8001->pen_dev);
+fail4:
+	sysfs_remove_group(&serio->dev.kobj, &w8001_attr_group);
 fail3:
 	serio_close(serio);
 fail2:
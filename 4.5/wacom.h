@@ -89,6 +89,10 @@
 #include <linux/mod_devicetable.h>
 #include <linux/hid.h>
 #include <linux/kfifo.h>
+#include <linux/kref.h>
+#include <linux/hrtimer.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
 #include <linux/leds.h>
 #include <linux/usb/input.h>
 #include <linux/power_supply.h>
@@ -135,6 +139,29 @@ struct wacom_group_leds {
 	struct device *dev;
 };
 
+#define WACOM_OLED_BUTTONS	8
+
+/*
+ * Button images written to sysfs are queued here and sent by oled.work,
+ * all that are queued in one START/STOP session. lock covers everything
+ * but work and len; the images shown by the device are kept to drop
+ * rewrites of the same image.
+ */
+struct wacom_oled {
+	struct work_struct work;
+	struct mutex lock;
+	unsigned int len;	/* bytes per image */
+	u8 xfer_id;
+	u8 queued;		/* buttons with an image in images */
+	u8 inflight;		/* button being sent */
+	u8 shown;		/* buttons with their image in shown_images */
+	u8 failed;		/* buttons whose last transfer failed */
+	bool stopped;		/* device going away, don't schedule work */
+	u32 hash[WACOM_OLED_BUTTONS];	/* of shown_images */
+	u8 *images;
+	u8 *shown_images;
+};
+
 struct wacom_battery {
 	struct wacom *wacom;
 	struct power_supply_desc bat_desc;
@@ -160,6 +187,43 @@ struct wacom_remote {
 	} remotes[WACOM_MAX_REMOTES];
 };
 
+/* log2(ns) buckets, the last one collects everything slower */
+#define WACOM_STATS_LATENCY_BUCKETS	32
+
+/*
+ * Decode path statistics, kept per CPU so that the report path never
+ * takes a lock for them. Exposed through debugfs.
+ */
+struct wacom_stats {
+	unsigned long reports[HID_MAX_IDS];
+	unsigned long fifo_dropped;
+	unsigned long invalid_bt_frames;
+	unsigned long finger_overruns;
+	unsigned long touch_frames_partial;
+	unsigned long capture_dropped;
+	unsigned long latency[WACOM_STATS_LATENCY_BUCKETS];
+};
+
+#define wacom_stats_inc(wacom, name)	this_cpu_inc((wacom)->stats->name)
+
+/*
+ * Raw report capture. wacom_raw_event() is the only producer and the
+ * debugfs reader the only consumer; read_lock keeps the processes sharing
+ * an open file to one consumer at a time. The device and each open file
+ * hold a reference, so a reader can outlive the device: it drains what
+ * was captured, then gets -ENODEV.
+ */
+struct wacom_capture {
+	struct kref kref;
+	struct hid_device *hdev;
+	struct kfifo fifo;
+	struct mutex read_lock;
+	wait_queue_head_t wait;
+	unsigned long busy;
+	bool active;
+	bool dead;
+};
+
 struct wacom {
 	struct usb_device *usbdev;
 	struct usb_interface *intf;
@@ -170,6 +234,13 @@ struct wacom {
 	struct work_struct battery_work;
 	struct work_struct remote_work;
 	struct delayed_work init_work;
+	struct hrtimer touch_frame_timer;
+	struct hrtimer pen_fifo_timer;
+	spinlock_t touch_frame_lock;
+	struct wacom_stats __percpu *stats;
+	ktime_t stats_reset;
+	struct dentry *debugfs_dir;
+	struct wacom_capture __rcu *capture;
 	struct wacom_remote *remote;
 	struct work_struct mode_change_work;
 	bool generic_has_leds;
@@ -182,6 +253,7 @@ struct wacom {
 		u8 max_llv;   /* maximum brightness of LED (llv) */
 		u8 max_hlv;   /* maximum brightness of LED (hlv) */
 	} led;
+	struct wacom_oled oled;
 	struct wacom_battery battery;
 	bool resources;
 };
@@ -222,10 +294,23 @@ static inline __u32 wacom_s32tou(s32 value, __u8 n)
 	return value & (1 << (n - 1)) ? value & (~(~0U << n)) : value;
 }
 
+static inline struct wacom_report_plan *wacom_report_plan(
+		struct wacom_wac *wacom_wac, struct hid_report *report)
+{
+	if (!wacom_wac->report_plans)
+		return NULL;
+
+	return wacom_wac->report_plans[report->type * HID_MAX_IDS + report->id];
+}
+
 extern const struct hid_device_id wacom_ids[];
+extern const struct wacom_tool wacom_tools[];
 
+void wacom_wac_set_rx_time(struct wacom_wac *wacom_wac, ktime_t time);
 void wacom_wac_irq(struct wacom_wac *wacom_wac, size_t len);
+void wacom_wac_touch_frame_flush(struct wacom_wac *wacom_wac);
 void wacom_setup_device_quirks(struct wacom *wacom);
+void wacom_setup_irq_ops(struct wacom_wac *wacom_wac);
 int wacom_setup_pen_input_capabilities(struct input_dev *input_dev,
 				   struct wacom_wac *wacom_wac);
 int wacom_setup_touch_input_capabilities(struct input_dev *input_dev,
@@ -234,8 +319,7 @@ int wacom_setup_pad_input_capabilities(struct input_dev *input_dev,
 				       struct wacom_wac *wacom_wac);
 void wacom_wac_usage_mapping(struct hid_device *hdev,
 		struct hid_field *field, struct hid_usage *usage);
-void wacom_wac_event(struct hid_device *hdev, struct hid_field *field,
-		struct hid_usage *usage, __s32 value);
+int wacom_wac_setup_report_plans(struct hid_device *hdev);
 void wacom_wac_report(struct hid_device *hdev, struct hid_report *report);
 void wacom_battery_work(struct work_struct *work);
 enum led_brightness wacom_leds_brightness_get(struct wacom_led *led);
@@ -243,5 +327,6 @@ struct wacom_led *wacom_led_find(struct wacom *wacom, unsigned int group,
 				 unsigned int id);
 struct wacom_led *wacom_led_next(struct wacom *wacom, struct wacom_led *cur);
 int wacom_equivalent_usage(int usage);
+int wacom_intuos_id_mangle(int tool_id);
 int wacom_initialize_leds(struct wacom *wacom);
 #endif
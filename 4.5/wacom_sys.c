@@ -11,6 +11,13 @@
 #include "wacom_wac.h"
 #include "wacom.h"
 #include <linux/input/mt.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/poll.h>
+#include <linux/jhash.h>
+
+#define CREATE_TRACE_POINTS
+#include "wacom_trace.h"
 
 #define WAC_MSG_RETRIES		5
 #define WAC_CMD_RETRIES		10
@@ -19,6 +26,20 @@
 #define DEV_ATTR_WO_PERM (S_IWUSR | S_IWGRP)
 #define DEV_ATTR_RO_PERM (S_IRUSR | S_IRGRP)
 
+#define WACOM_PEN_FIFO_MAX_DEPTH	64
+
+static unsigned int pen_fifo_depth = 8;
+module_param(pen_fifo_depth, uint, 0644);
+MODULE_PARM_DESC(pen_fifo_depth, " pen reports held while the tool serial is unknown (1-64, default 8)");
+
+static unsigned int pen_fifo_timeout = 20;
+module_param(pen_fifo_timeout, uint, 0644);
+MODULE_PARM_DESC(pen_fifo_timeout, " ms a held pen report may wait before the next report flushes it, or before a quiet device's backlog is dropped (0 = never, default 20)");
+
+static unsigned int touch_frame_timeout = 10;
+module_param(touch_frame_timeout, uint, 0644);
+MODULE_PARM_DESC(touch_frame_timeout, " ms to wait for the rest of a multi-report touch frame (0 = until the next frame, default 10)");
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
 static int __wacom_is_usb_parent(struct usb_device *usbdev, void *ptr)
 {
@@ -77,37 +98,199 @@ static int wacom_set_report(struct hid_device *hdev, u8 type, u8 *buf,
 	return retval;
 }
 
+/* A queued pen report, replayed with the time it was received */
+struct wacom_pen_fifo_record {
+	ktime_t rx_time;
+	u8 data[WACOM_PKGLEN_MAX];
+};
+
+static int wacom_pen_fifo_alloc(struct kfifo_rec_ptr_2 *fifo,
+				unsigned int depth)
+{
+	/* each record carries a 2 byte length */
+	return kfifo_alloc(fifo,
+			   depth * (sizeof(struct wacom_pen_fifo_record) + 2),
+			   GFP_KERNEL);
+}
+
+/*
+ * The pen_fifo is filled and drained from wacom_raw_event(), changed by
+ * the depth store and emptied by pen_fifo_timer, so it is only touched
+ * under touch_frame_lock. Replaying a report goes back through
+ * wacom_raw_event(), which takes that lock itself, so the flush takes
+ * one report out at a time and replays it unlocked.
+ */
+static void wacom_pen_fifo_discard(struct wacom *wacom,
+				   struct kfifo_rec_ptr_2 *fifo)
+{
+	while (!kfifo_is_empty(fifo)) {
+		kfifo_skip(fifo);
+		wacom_stats_inc(wacom, fifo_dropped);
+	}
+}
+
 static void wacom_wac_queue_insert(struct hid_device *hdev,
 				   struct kfifo_rec_ptr_2 *fifo,
 				   u8 *raw_data, int size)
 {
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_pen_fifo_record rec;
+	unsigned int len = offsetof(struct wacom_pen_fifo_record, data) + size;
+	unsigned long flags;
 	bool warned = false;
 
-	while (kfifo_avail(fifo) < size) {
+	trace_wacom_queue_insert(hdev, &wacom->wacom_wac, raw_data[0], size);
+
+	rec.rx_time = wacom->wacom_wac.timestamp.rx_time;
+	memcpy(rec.data, raw_data, size);
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+
+	if (kfifo_is_empty(fifo))
+		wacom->wacom_wac.pen_fifo_time = rec.rx_time;
+
+	while (kfifo_avail(fifo) < len) {
 		if (!warned)
 			hid_warn(hdev, "%s: kfifo has filled, starting to drop events\n", __func__);
 		warned = true;
 
 		kfifo_skip(fifo);
+		wacom_stats_inc(wacom, fifo_dropped);
 	}
 
-	kfifo_in(fifo, raw_data, size);
+	kfifo_in(fifo, &rec, len);
+
+	/* restarted by every report, so it only fires once the device is quiet */
+	if (pen_fifo_timeout)
+		hrtimer_start(&wacom->pen_fifo_timer,
+			      ns_to_ktime(pen_fifo_timeout * NSEC_PER_MSEC),
+			      HRTIMER_MODE_REL);
+
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
 }
 
 static void wacom_wac_queue_flush(struct hid_device *hdev,
 				  struct kfifo_rec_ptr_2 *fifo)
 {
-	while (!kfifo_is_empty(fifo)) {
-		u8 buf[WACOM_PKGLEN_MAX];
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
+	ktime_t rx_time = wacom_wac->timestamp.rx_time;
+	unsigned long flags;
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+	hrtimer_try_to_cancel(&wacom->pen_fifo_timer);
+	wacom_wac->pen_fifo_replay = true;
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+	for (;;) {
+		struct wacom_pen_fifo_record rec;
+		unsigned int len;
 		int size;
 		int err;
 
-		size = kfifo_out(fifo, buf, sizeof(buf));
-		err = hid_report_raw_event(hdev, HID_INPUT_REPORT, buf, size, false);
+		spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+		len = kfifo_out(fifo, &rec, sizeof(rec));
+		if (len)
+			wacom_wac->pen_fifo_rx_time = rec.rx_time;
+		else
+			wacom_wac->pen_fifo_replay = false;
+		spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+		if (!len)
+			break;
+
+		size = len - offsetof(struct wacom_pen_fifo_record, data);
+
+		trace_wacom_queue_flush(hdev, wacom_wac, rec.data[0], size);
+		err = hid_report_raw_event(hdev, HID_INPUT_REPORT, rec.data,
+					   size, false);
 		if (err) {
 			hid_warn(hdev, "%s: unable to flush event due to error %d\n",
 				 __func__, err);
 		}
+		wacom_wac->pen_fifo_flushed++;
+	}
+
+	/* back to the report that triggered the flush */
+	wacom_wac_set_rx_time(wacom_wac, rx_time);
+}
+
+/*
+ * Bound how long pen reports wait for a tool serial number: once the
+ * oldest queued report is older than pen_fifo_timeout, the next report
+ * delivers the queue ahead of itself.
+ */
+static bool wacom_pen_fifo_expired(struct wacom *wacom)
+{
+	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
+	unsigned long flags;
+	bool expired;
+
+	if (!pen_fifo_timeout)
+		return false;
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+	expired = !kfifo_is_empty(&wacom_wac->pen_fifo) &&
+		  ktime_to_ms(ktime_sub(wacom_wac->timestamp.rx_time,
+					wacom_wac->pen_fifo_time)) >= pen_fifo_timeout;
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+	return expired;
+}
+
+/*
+ * A device that goes quiet with reports queued sends nothing to flush
+ * them, and they can't be replayed from here without re-entering the HID
+ * core. Drop them instead; they never named their tool anyway.
+ */
+static enum hrtimer_restart wacom_pen_fifo_timeout(struct hrtimer *timer)
+{
+	struct wacom *wacom = container_of(timer, struct wacom,
+					   pen_fifo_timer);
+	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
+	unsigned long flags;
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+	if (!wacom_wac->pen_fifo_replay &&
+	    !kfifo_is_empty(&wacom_wac->pen_fifo)) {
+		wacom_wac->pen_fifo_expired++;
+		wacom_pen_fifo_discard(wacom, &wacom_wac->pen_fifo);
+	}
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Sync a touch frame whose last report did not arrive in time. Decoding
+ * runs under touch_frame_lock rather than the HID core's
+ * driver_input_lock, so a live report waits for the flush instead of
+ * being dropped.
+ */
+static enum hrtimer_restart wacom_touch_frame_timeout(struct hrtimer *timer)
+{
+	struct wacom *wacom = container_of(timer, struct wacom,
+					   touch_frame_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+	wacom_wac_touch_frame_flush(&wacom->wacom_wac);
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+static void wacom_touch_frame_timer_update(struct wacom *wacom)
+{
+	struct hrtimer *timer = &wacom->touch_frame_timer;
+
+	if (wacom->wacom_wac.touch_frame_open) {
+		if (touch_frame_timeout && !hrtimer_active(timer))
+			hrtimer_start(timer,
+				      ns_to_ktime(touch_frame_timeout * NSEC_PER_MSEC),
+				      HRTIMER_MODE_REL);
+	} else if (hrtimer_active(timer)) {
+		hrtimer_try_to_cancel(timer);
 	}
 }
 
@@ -117,57 +300,60 @@ static int wacom_wac_pen_serial_enforce(struct hid_device *hdev,
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct wacom_features *features = &wacom_wac->features;
+	struct wacom_report_plan *plan;
 	bool flush = false;
 	bool insert = false;
-	int i, j;
+	unsigned int i;
+
+	/* reports replayed from the queue go straight to the decoders */
+	if (wacom_wac->pen_fifo_replay)
+		return 0;
 
 	if (wacom_wac->serial[0] || !(features->quirks & WACOM_QUIRK_TOOLSERIAL))
 		return 0;
 
+	plan = wacom_report_plan(wacom_wac, report);
+	if (!plan)
+		return 0;
+
 	/* Queue events which have invalid tool type or serial number */
-	for (i = 0; i < report->maxfield; i++) {
-		for (j = 0; j < report->field[i]->maxusage; j++) {
-			struct hid_field *field = report->field[i];
-			struct hid_usage *usage = &field->usage[j];
-			unsigned int equivalent_usage = wacom_equivalent_usage(usage->hid);
-			unsigned int offset;
-			unsigned int size;
-			unsigned int value;
-
-			if (equivalent_usage != HID_DG_INRANGE &&
-			    equivalent_usage != HID_DG_TOOLSERIALNUMBER &&
-			    equivalent_usage != WACOM_HID_WD_SERIALHI &&
-			    equivalent_usage != WACOM_HID_WD_TOOLTYPE)
-				continue;
+	for (i = 0; i < plan->num_serial_usages; i++) {
+		const struct wacom_serial_usage *serial_usage =
+			&plan->serial_usages[i];
+		unsigned int value;
+
+		value = hid_field_extract(hdev, raw_data+1,
+					  serial_usage->offset,
+					  serial_usage->size);
+
+		/* If we go out of range, we need to flush the queue ASAP */
+		if (serial_usage->usage == HID_DG_INRANGE)
+			value = !value;
+
+		if (value) {
+			flush = true;
+			switch (serial_usage->usage) {
+			case HID_DG_TOOLSERIALNUMBER:
+				wacom_wac->serial[0] = value;
+				break;
 
-			offset = field->report_offset;
-			size = field->report_size;
-			value = hid_field_extract(hdev, raw_data+1, offset + j * size, size);
-
-			/* If we go out of range, we need to flush the queue ASAP */
-			if (equivalent_usage == HID_DG_INRANGE)
-				value = !value;
-
-			if (value) {
-				flush = true;
-				switch (equivalent_usage) {
-				case HID_DG_TOOLSERIALNUMBER:
-					wacom_wac->serial[0] = value;
-					break;
-
-				case WACOM_HID_WD_SERIALHI:
-					wacom_wac->serial[0] |= ((__u64)value) << 32;
-					break;
-
-				case WACOM_HID_WD_TOOLTYPE:
-					wacom_wac->id[0] = value;
-					break;
-				}
-			}
-			else {
-				insert = true;
+			case WACOM_HID_WD_SERIALHI:
+				wacom_wac->serial[0] |= ((__u64)value) << 32;
+				break;
+
+			case WACOM_HID_WD_TOOLTYPE:
+				wacom_wac->id[0] = value;
+				break;
 			}
 		}
+		else {
+			insert = true;
+		}
+	}
+
+	if (!flush && wacom_pen_fifo_expired(wacom)) {
+		wacom_wac->pen_fifo_expired++;
+		flush = true;
 	}
 
 	if (flush)
@@ -179,24 +365,120 @@ static int wacom_wac_pen_serial_enforce(struct hid_device *hdev,
 	return insert && !flush;
 }
 
+static void wacom_stats_latency(struct wacom *wacom)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(),
+				       wacom->wacom_wac.timestamp.rx_time));
+	int bucket = ns > 1 ? ilog2(ns) : 0;
+
+	if (bucket >= WACOM_STATS_LATENCY_BUCKETS)
+		bucket = WACOM_STATS_LATENCY_BUCKETS - 1;
+
+	wacom_stats_inc(wacom, latency[bucket]);
+}
+
+/*
+ * Capture stream, as read from debugfs: a wacom_capture_header and the
+ * device's report descriptor, then one wacom_capture_record per report
+ * followed by the raw bytes. Everything is little endian.
+ */
+#define WACOM_CAPTURE_MAGIC	0x50414357	/* "WCAP" */
+#define WACOM_CAPTURE_VERSION	1
+#define WACOM_CAPTURE_SIZE	(1 << 17)
+
+struct wacom_capture_header {
+	__le32 magic;
+	__le16 version;
+	__le16 bus;
+	__le32 vendor;
+	__le32 product;
+	__le32 rdesc_size;
+} __packed;
+
+struct wacom_capture_record {
+	__le64 time_ns;		/* CLOCK_MONOTONIC, on entry to raw_event */
+	__le16 size;
+} __packed;
+
+static void wacom_capture_report(struct wacom *wacom,
+				 struct wacom_capture *capture,
+				 u8 *raw_data, int size)
+{
+	struct wacom_capture_record rec;
+
+	/* records are never split: drop the whole report if it won't fit */
+	if (kfifo_avail(&capture->fifo) < sizeof(rec) + size) {
+		wacom_stats_inc(wacom, capture_dropped);
+		return;
+	}
+
+	rec.time_ns = cpu_to_le64(ktime_to_ns(wacom->wacom_wac.timestamp.rx_time));
+	rec.size = cpu_to_le16(size);
+
+	kfifo_in(&capture->fifo, &rec, sizeof(rec));
+	kfifo_in(&capture->fifo, raw_data, size);
+	wake_up_interruptible(&capture->wait);
+}
+
 static int wacom_raw_event(struct hid_device *hdev, struct hid_report *report,
 		u8 *raw_data, int size)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_capture *capture;
+	unsigned long flags;
 
 	if (size > WACOM_PKGLEN_MAX)
 		return 1;
 
+	/* queued pen reports keep the time they were received */
+	if (wacom->wacom_wac.pen_fifo_replay)
+		wacom_wac_set_rx_time(&wacom->wacom_wac,
+				      wacom->wacom_wac.pen_fifo_rx_time);
+	else
+		wacom_wac_set_rx_time(&wacom->wacom_wac, ktime_get());
+	wacom_stats_inc(wacom, reports[report->id]);
+
+	rcu_read_lock();
+	capture = rcu_dereference(wacom->capture);
+	if (capture && smp_load_acquire(&capture->active))
+		wacom_capture_report(wacom, capture, raw_data, size);
+	rcu_read_unlock();
+
+	wacom->wacom_wac.report_seq++;
+	trace_wacom_raw_event(hdev, &wacom->wacom_wac, report->id, size);
+
 	if (wacom_wac_pen_serial_enforce(hdev, report, raw_data, size))
 		return -1;
 
 	memcpy(wacom->wacom_wac.data, raw_data, size);
 
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
 	wacom_wac_irq(&wacom->wacom_wac, size);
+	wacom_touch_frame_timer_update(wacom);
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+	/* HID_GENERIC reports are decoded later, in wacom_report() */
+	if (wacom->wacom_wac.features.type != HID_GENERIC)
+		wacom_stats_latency(wacom);
 
 	return 0;
 }
 
+static void wacom_report(struct hid_device *hdev, struct hid_report *report)
+{
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	unsigned long flags;
+
+	if (wacom->wacom_wac.features.type != HID_GENERIC)
+		return;
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+	wacom_wac_report(hdev, report);
+	wacom_touch_frame_timer_update(wacom);
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+	wacom_stats_latency(wacom);
+}
+
 static int wacom_open(struct input_dev *dev)
 {
 	struct wacom *wacom = input_get_drvdata(dev);
@@ -1031,26 +1313,23 @@ static int wacom_led_control(struct wacom *wacom)
 	return retval;
 }
 
-static int wacom_led_putimage(struct wacom *wacom, int button_id, u8 xfer_id,
-		const unsigned len, const void *img)
+static int wacom_led_icon_session(struct wacom *wacom, u8 *buf, bool start)
 {
-	unsigned char *buf;
-	int i, retval;
-	const unsigned chunk_len = len / 4; /* 4 chunks are needed to be sent */
-
-	buf = kzalloc(chunk_len + 3 , GFP_KERNEL);
-	if (!buf)
-		return -ENOMEM;
-
-	/* Send 'start' command */
 	buf[0] = WAC_CMD_ICON_START;
-	buf[1] = 1;
-	retval = wacom_set_report(wacom->hdev, HID_FEATURE_REPORT, buf, 2,
-				  WAC_CMD_RETRIES);
-	if (retval < 0)
-		goto out;
+	buf[1] = start;
+	return wacom_set_report(wacom->hdev, HID_FEATURE_REPORT, buf, 2,
+				WAC_CMD_RETRIES);
+}
 
-	buf[0] = xfer_id;
+/* Send one image within a START/STOP session; buf holds a chunk report */
+static int wacom_led_putimage(struct wacom *wacom, u8 *buf, int button_id,
+			      const void *img)
+{
+	struct wacom_oled *oled = &wacom->oled;
+	const unsigned chunk_len = oled->len / 4; /* 4 chunks are needed to be sent */
+	int i, retval = 0;
+
+	buf[0] = oled->xfer_id;
 	buf[1] = button_id & 0x07;
 	for (i = 0; i < 4; i++) {
 		buf[2] = i;
@@ -1062,15 +1341,120 @@ static int wacom_led_putimage(struct wacom *wacom, int button_id, u8 xfer_id,
 			break;
 	}
 
-	/* Send 'stop' */
-	buf[0] = WAC_CMD_ICON_START;
-	buf[1] = 0;
-	wacom_set_report(wacom->hdev, HID_FEATURE_REPORT, buf, 2,
-			 WAC_CMD_RETRIES);
+	return retval;
+}
+
+static void wacom_oled_work(struct work_struct *work)
+{
+	struct wacom *wacom = container_of(work, struct wacom, oled.work);
+	struct wacom_oled *oled = &wacom->oled;
+	unsigned int len = oled->len;
+	bool started = false;
+	u8 *buf, *img;
+	int id, retval = 0;
+
+	buf = kzalloc(len / 4 + 3, GFP_KERNEL);
+	img = kmalloc(len, GFP_KERNEL);
+	if (!buf || !img) {
+		mutex_lock(&oled->lock);
+		oled->failed |= oled->queued;
+		oled->queued = 0;
+		mutex_unlock(&oled->lock);
+		goto out;
+	}
+
+	mutex_lock(&wacom->lock);
+
+	/* images queued while the session is open go out in it too */
+	for (;;) {
+		mutex_lock(&oled->lock);
+		id = ffs(oled->queued) - 1;
+		if (id >= 0) {
+			memcpy(img, oled->images + id * len, len);
+			oled->queued &= ~BIT(id);
+			oled->inflight = BIT(id);
+		}
+		mutex_unlock(&oled->lock);
+
+		if (id < 0)
+			break;
+
+		if (!started) {
+			retval = wacom_led_icon_session(wacom, buf, true);
+			started = retval >= 0;
+		}
+		if (started)
+			retval = wacom_led_putimage(wacom, buf, id, img);
+
+		mutex_lock(&oled->lock);
+		oled->inflight = 0;
+		if (retval < 0) {
+			oled->failed |= BIT(id);
+			oled->shown &= ~BIT(id);
+		} else {
+			memcpy(oled->shown_images + id * len, img, len);
+			oled->hash[id] = jhash(img, len, 0);
+			oled->shown |= BIT(id);
+		}
+		mutex_unlock(&oled->lock);
+
+		if (retval < 0)
+			hid_warn(wacom->hdev,
+				 "failed to send button %d image: %d\n",
+				 id, retval);
+	}
+
+	if (started)
+		wacom_led_icon_session(wacom, buf, false);
+
+	mutex_unlock(&wacom->lock);
 
 out:
+	kfree(img);
 	kfree(buf);
-	return retval;
+	sysfs_notify(&wacom->hdev->dev.kobj, "wacom_led",
+		     "buttons_rawimg_pending");
+}
+
+static void wacom_oled_release(void *data)
+{
+	struct wacom *wacom = data;
+
+	cancel_work_sync(&wacom->oled.work);
+	wacom->oled.images = NULL;
+	wacom->oled.shown_images = NULL;
+}
+
+static int wacom_oled_init(struct wacom *wacom)
+{
+	struct hid_device *hdev = wacom->hdev;
+	struct wacom_oled *oled = &wacom->oled;
+	int error;
+
+	if (hdev->bus == BUS_BLUETOOTH) {
+		oled->len = 256;
+		oled->xfer_id = WAC_CMD_ICON_BT_XFER;
+	} else {
+		oled->len = 1024;
+		oled->xfer_id = WAC_CMD_ICON_XFER;
+	}
+
+	oled->images = devm_kcalloc(&hdev->dev, WACOM_OLED_BUTTONS,
+				    oled->len, GFP_KERNEL);
+	oled->shown_images = devm_kcalloc(&hdev->dev, WACOM_OLED_BUTTONS,
+					  oled->len, GFP_KERNEL);
+	if (!oled->images || !oled->shown_images)
+		return -ENOMEM;
+
+	oled->queued = oled->inflight = oled->shown = oled->failed = 0;
+
+	error = devm_add_action(&hdev->dev, wacom_oled_release, wacom);
+	if (error) {
+		wacom_oled_release(wacom);
+		return error;
+	}
+
+	return 0;
 }
 
 static ssize_t wacom_led_select_store(struct device *dev, int set_id,
@@ -1160,33 +1544,47 @@ DEVICE_LUMINANCE_ATTR(status0, llv);
 DEVICE_LUMINANCE_ATTR(status1, hlv);
 DEVICE_LUMINANCE_ATTR(buttons, img_lum);
 
+/*
+ * Queue the image and return; oled.work sends it. Writing the image the
+ * button already shows is a no-op, and an image still queued is simply
+ * replaced. buttons_rawimg_pending tells when the queue has drained.
+ *
+ * A store of the right size always succeeds, whether or not the image
+ * makes it to the device: transfer errors only show up afterwards, in
+ * buttons_rawimg_failed.
+ */
 static ssize_t wacom_button_image_store(struct device *dev, int button_id,
 					const char *buf, size_t count)
 {
 	struct hid_device *hdev = to_hid_device(dev);
 	struct wacom *wacom = hid_get_drvdata(hdev);
-	int err;
-	unsigned len;
-	u8 xfer_id;
-
-	if (hdev->bus == BUS_BLUETOOTH) {
-		len = 256;
-		xfer_id = WAC_CMD_ICON_BT_XFER;
-	} else {
-		len = 1024;
-		xfer_id = WAC_CMD_ICON_XFER;
-	}
+	struct wacom_oled *oled = &wacom->oled;
+	unsigned len = oled->len;
+	u32 hash;
 
 	if (count != len)
 		return -EINVAL;
 
-	mutex_lock(&wacom->lock);
+	hash = jhash(buf, len, 0);
 
-	err = wacom_led_putimage(wacom, button_id, xfer_id, len, buf);
+	mutex_lock(&oled->lock);
 
-	mutex_unlock(&wacom->lock);
+	oled->failed &= ~BIT(button_id);
+	if (!(oled->inflight & BIT(button_id)) &&
+	    (oled->shown & BIT(button_id)) && oled->hash[button_id] == hash &&
+	    !memcmp(oled->shown_images + button_id * len, buf, len)) {
+		/* back to what the button shows */
+		oled->queued &= ~BIT(button_id);
+	} else {
+		memcpy(oled->images + button_id * len, buf, len);
+		oled->queued |= BIT(button_id);
+		if (!oled->stopped)
+			schedule_work(&oled->work);
+	}
 
-	return err < 0 ? err : count;
+	mutex_unlock(&oled->lock);
+
+	return count;
 }
 
 #define DEVICE_BTNIMG_ATTR(BUTTON_ID)					\
@@ -1207,6 +1605,39 @@ DEVICE_BTNIMG_ATTR(5);
 DEVICE_BTNIMG_ATTR(6);
 DEVICE_BTNIMG_ATTR(7);
 
+/*
+ * Buttons whose image is not on the device yet, and those whose last
+ * transfer failed. A failed bit is only cleared by storing to that
+ * button's rawimg again; buttonN_rawimg itself never reports the error.
+ */
+static ssize_t wacom_buttons_rawimg_pending_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct hid_device *hdev = to_hid_device(dev);
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_oled *oled = &wacom->oled;
+	u8 pending;
+
+	mutex_lock(&oled->lock);
+	pending = oled->queued | oled->inflight;
+	mutex_unlock(&oled->lock);
+
+	return scnprintf(buf, PAGE_SIZE, "0x%02x\n", pending);
+}
+static DEVICE_ATTR(buttons_rawimg_pending, DEV_ATTR_RO_PERM,
+		   wacom_buttons_rawimg_pending_show, NULL);
+
+static ssize_t wacom_buttons_rawimg_failed_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct hid_device *hdev = to_hid_device(dev);
+	struct wacom *wacom = hid_get_drvdata(hdev);
+
+	return scnprintf(buf, PAGE_SIZE, "0x%02x\n", wacom->oled.failed);
+}
+static DEVICE_ATTR(buttons_rawimg_failed, DEV_ATTR_RO_PERM,
+		   wacom_buttons_rawimg_failed_show, NULL);
+
 static struct attribute *cintiq_led_attrs[] = {
 	&dev_attr_status_led0_select.attr,
 	&dev_attr_status_led1_select.attr,
@@ -1231,6 +1662,8 @@ static struct attribute *intuos4_led_attrs[] = {
 	&dev_attr_button5_rawimg.attr,
 	&dev_attr_button6_rawimg.attr,
 	&dev_attr_button7_rawimg.attr,
+	&dev_attr_buttons_rawimg_pending.attr,
+	&dev_attr_buttons_rawimg_failed.attr,
 	NULL
 };
 
@@ -1643,6 +2076,10 @@ int wacom_initialize_leds(struct wacom *wacom)
 			return error;
 		}
 
+		error = wacom_oled_init(wacom);
+		if (error)
+			return error;
+
 		error = wacom_devm_sysfs_create_group(wacom,
 						      &intuos4_led_attr_group);
 		break;
@@ -1842,6 +2279,84 @@ static void wacom_destroy_battery(struct wacom *wacom)
 	}
 }
 
+static ssize_t wacom_pen_fifo_depth_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	struct hid_device *hdev = to_hid_device(dev);
+	struct wacom *wacom = hid_get_drvdata(hdev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			wacom->wacom_wac.pen_fifo_depth);
+}
+
+static ssize_t wacom_pen_fifo_depth_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	struct hid_device *hdev = to_hid_device(dev);
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
+	struct kfifo_rec_ptr_2 fifo, old;
+	unsigned long flags;
+	unsigned int depth;
+	int err;
+
+	err = kstrtouint(buf, 10, &depth);
+	if (err)
+		return err;
+
+	if (depth < 1 || depth > WACOM_PEN_FIFO_MAX_DEPTH)
+		return -EINVAL;
+
+	err = wacom_pen_fifo_alloc(&fifo, depth);
+	if (err)
+		return err;
+
+	spin_lock_irqsave(&wacom->touch_frame_lock, flags);
+
+	old = wacom_wac->pen_fifo;
+	wacom_pen_fifo_discard(wacom, &old);
+	wacom_wac->pen_fifo = fifo;
+	wacom_wac->pen_fifo_depth = depth;
+
+	spin_unlock_irqrestore(&wacom->touch_frame_lock, flags);
+
+	kfifo_free(&old);
+
+	return count;
+}
+
+static DEVICE_ATTR(depth, DEV_ATTR_RW_PERM,
+		   wacom_pen_fifo_depth_show, wacom_pen_fifo_depth_store);
+
+#define DEVICE_PEN_FIFO_COUNTER_ATTR(name)				\
+static ssize_t wacom_pen_fifo_##name##_show(struct device *dev,	\
+	struct device_attribute *attr, char *buf)			\
+{									\
+	struct hid_device *hdev = to_hid_device(dev);			\
+	struct wacom *wacom = hid_get_drvdata(hdev);			\
+	return scnprintf(buf, PAGE_SIZE, "%lu\n",			\
+			 wacom->wacom_wac.pen_fifo_##name);		\
+}									\
+static DEVICE_ATTR(name, DEV_ATTR_RO_PERM,				\
+		   wacom_pen_fifo_##name##_show, NULL)
+
+DEVICE_PEN_FIFO_COUNTER_ATTR(flushed);
+DEVICE_PEN_FIFO_COUNTER_ATTR(expired);
+
+static struct attribute *pen_fifo_attrs[] = {
+	&dev_attr_depth.attr,
+	&dev_attr_flushed.attr,
+	&dev_attr_expired.attr,
+	NULL
+};
+
+static struct attribute_group pen_fifo_attr_group = {
+	.name = "pen_fifo",
+	.attrs = pen_fifo_attrs,
+};
+
 static ssize_t wacom_show_speed(struct device *dev,
 				struct device_attribute
 				*attr, char *buf)
@@ -1874,6 +2389,69 @@ static ssize_t wacom_store_speed(struct device *dev,
 static DEVICE_ATTR(speed, DEV_ATTR_RW_PERM,
 		wacom_show_speed, wacom_store_speed);
 
+static const char * const wacom_pen_frames_names[WACOM_PEN_FRAMES_MAX] = {
+	[WACOM_PEN_FRAMES_EACH]		= "each",
+	[WACOM_PEN_FRAMES_COALESCE]	= "coalesce",
+	[WACOM_PEN_FRAMES_SUMMARY]	= "summary",
+};
+
+/* The pen_frames modes of a device, none if its reports hold one frame */
+static unsigned int wacom_pen_frames_modes(struct wacom_features *features)
+{
+	switch (features->type) {
+	case INTUOS4WL:
+		return BIT(WACOM_PEN_FRAMES_EACH) | BIT(WACOM_PEN_FRAMES_COALESCE);
+	case INTUOSP2_BT:
+	case INTUOSHT3_BT:
+		return BIT(WACOM_PEN_FRAMES_MAX) - 1;
+	}
+	return 0;
+}
+
+static ssize_t wacom_show_pen_frames(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct hid_device *hdev = to_hid_device(dev);
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	unsigned int modes = wacom_pen_frames_modes(&wacom->wacom_wac.features);
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < WACOM_PEN_FRAMES_MAX; i++) {
+		if (!(modes & BIT(i)))
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 i == wacom->wacom_wac.pen_frames ? "[%s] " : "%s ",
+				 wacom_pen_frames_names[i]);
+	}
+	buf[len - 1] = '\n';
+
+	return len;
+}
+
+static ssize_t wacom_store_pen_frames(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct hid_device *hdev = to_hid_device(dev);
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	unsigned int modes = wacom_pen_frames_modes(&wacom->wacom_wac.features);
+	int i;
+
+	for (i = 0; i < WACOM_PEN_FRAMES_MAX; i++) {
+		if ((modes & BIT(i)) &&
+		    sysfs_streq(buf, wacom_pen_frames_names[i])) {
+			wacom->wacom_wac.pen_frames = i;
+			return count;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static DEVICE_ATTR(pen_frames, DEV_ATTR_RW_PERM,
+		   wacom_show_pen_frames, wacom_store_pen_frames);
+
 
 static ssize_t wacom_show_remote_mode(struct kobject *kobj,
 				      struct kobj_attribute *kattr,
@@ -2085,6 +2663,7 @@ static struct input_dev *wacom_allocate_input(struct wacom *wacom)
 	input_dev->id.vendor  = hdev->vendor;
 	input_dev->id.product = wacom_wac->pid ? wacom_wac->pid : hdev->product;
 	input_dev->id.version = hdev->version;
+	input_set_capability(input_dev, EV_MSC, MSC_TIMESTAMP);
 	input_set_drvdata(input_dev, wacom);
 
 	return input_dev;
@@ -2300,6 +2879,7 @@ static void wacom_release_resources(struct wacom *wacom)
 	wacom->wacom_wac.pen_input = NULL;
 	wacom->wacom_wac.touch_input = NULL;
 	wacom->wacom_wac.pad_input = NULL;
+	wacom->wacom_wac.report_plans = NULL;
 }
 
 static void wacom_set_shared_values(struct wacom_wac *wacom_wac)
@@ -2307,6 +2887,7 @@ static void wacom_set_shared_values(struct wacom_wac *wacom_wac)
 	if (wacom_wac->features.device_type & WACOM_DEVICETYPE_TOUCH) {
 		wacom_wac->shared->type = wacom_wac->features.type;
 		wacom_wac->shared->touch_input = wacom_wac->touch_input;
+		wacom_wac->shared->touch_contacts = 0;
 	}
 
 	if (wacom_wac->has_mute_touch_switch) {
@@ -2379,6 +2960,8 @@ static int wacom_parse_and_register(struct wacom *wacom, bool wireless)
 		features->device_type |= WACOM_DEVICETYPE_PEN;
 	}
 
+	wacom_setup_irq_ops(wacom_wac);
+
 	wacom_calculate_res(features);
 
 	wacom_update_name(wacom, wireless ? " (WL)" : "");
@@ -2406,6 +2989,17 @@ static int wacom_parse_and_register(struct wacom *wacom, bool wireless)
 	if (error)
 		goto fail;
 
+	error = wacom_wac_setup_report_plans(hdev);
+	if (error)
+		goto fail;
+
+	if (features->quirks & WACOM_QUIRK_TOOLSERIAL) {
+		error = wacom_devm_sysfs_create_group(wacom,
+						      &pen_fifo_attr_group);
+		if (error)
+			goto fail;
+	}
+
 	if (wacom->wacom_wac.features.device_type & WACOM_DEVICETYPE_PAD) {
 		error = wacom_initialize_leds(wacom);
 		if (error)
@@ -2748,6 +3342,295 @@ static void wacom_mode_change_work(struct work_struct *work)
 	return;
 }
 
+static void wacom_stats_free(void *data)
+{
+	struct wacom *wacom = data;
+
+	free_percpu(wacom->stats);
+}
+
+static int wacom_stats_alloc(struct wacom *wacom)
+{
+	int error;
+
+	wacom->stats = alloc_percpu(struct wacom_stats);
+	if (!wacom->stats)
+		return -ENOMEM;
+
+	error = devm_add_action(&wacom->hdev->dev, wacom_stats_free, wacom);
+	if (error) {
+		free_percpu(wacom->stats);
+		return error;
+	}
+
+	wacom->stats_reset = ktime_get();
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void wacom_stats_reset(struct wacom *wacom)
+{
+	int cpu;
+
+	/* increments racing with this on other CPUs may be lost */
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(wacom->stats, cpu), 0,
+		       sizeof(struct wacom_stats));
+
+	wacom->stats_reset = ktime_get();
+}
+
+static int wacom_stats_show(struct seq_file *m, void *unused)
+{
+	struct wacom *wacom = m->private;
+	struct wacom_stats *sum;
+	int cpu, i;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct wacom_stats *stats = per_cpu_ptr(wacom->stats, cpu);
+
+		for (i = 0; i < HID_MAX_IDS; i++)
+			sum->reports[i] += stats->reports[i];
+		for (i = 0; i < WACOM_STATS_LATENCY_BUCKETS; i++)
+			sum->latency[i] += stats->latency[i];
+		sum->fifo_dropped += stats->fifo_dropped;
+		sum->invalid_bt_frames += stats->invalid_bt_frames;
+		sum->finger_overruns += stats->finger_overruns;
+		sum->touch_frames_partial += stats->touch_frames_partial;
+		sum->capture_dropped += stats->capture_dropped;
+	}
+
+	seq_printf(m, "elapsed_ms: %lld\n",
+		   ktime_to_ms(ktime_sub(ktime_get(), wacom->stats_reset)));
+	seq_printf(m, "fifo_dropped: %lu\n", sum->fifo_dropped);
+	seq_printf(m, "invalid_bt_frames: %lu\n", sum->invalid_bt_frames);
+	seq_printf(m, "finger_overruns: %lu\n", sum->finger_overruns);
+	seq_printf(m, "touch_frames_partial: %lu\n", sum->touch_frames_partial);
+	seq_printf(m, "capture_dropped: %lu\n", sum->capture_dropped);
+
+	seq_puts(m, "reports:\n");
+	for (i = 0; i < HID_MAX_IDS; i++) {
+		if (sum->reports[i])
+			seq_printf(m, "  %3d: %lu\n", i, sum->reports[i]);
+	}
+
+	seq_puts(m, "latency_ns:\n");
+	for (i = 0; i < WACOM_STATS_LATENCY_BUCKETS; i++) {
+		if (sum->latency[i])
+			seq_printf(m, "  >= %llu: %lu\n",
+				   i ? 1ULL << i : 0ULL, sum->latency[i]);
+	}
+
+	kfree(sum);
+	return 0;
+}
+
+static int wacom_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wacom_stats_show, inode->i_private);
+}
+
+/* any write clears the counters */
+static ssize_t wacom_stats_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+
+	wacom_stats_reset(m->private);
+	return count;
+}
+
+static const struct file_operations wacom_stats_fops = {
+	.owner =	THIS_MODULE,
+	.open =		wacom_stats_open,
+	.read =		seq_read,
+	.write =	wacom_stats_write,
+	.llseek =	seq_lseek,
+	.release =	single_release,
+};
+
+static void wacom_capture_free(struct kref *kref)
+{
+	struct wacom_capture *capture =
+		container_of(kref, struct wacom_capture, kref);
+
+	if (kfifo_initialized(&capture->fifo))
+		kfifo_free(&capture->fifo);
+	kfree(capture);
+}
+
+/*
+ * Opening "capture" starts recording into a fresh ring, closing it stops.
+ * Reports that arrive while the ring is full are dropped and counted.
+ */
+static int wacom_capture_open(struct inode *inode, struct file *file)
+{
+	struct wacom_capture *capture = inode->i_private;
+	struct hid_device *hdev = capture->hdev;
+	struct wacom_capture_header hdr;
+	int error;
+
+	if (test_and_set_bit(0, &capture->busy))
+		return -EBUSY;
+
+	if (!kfifo_initialized(&capture->fifo)) {
+		error = kfifo_alloc(&capture->fifo, WACOM_CAPTURE_SIZE,
+				    GFP_KERNEL);
+		if (error) {
+			clear_bit(0, &capture->busy);
+			return error;
+		}
+	}
+
+	hdr.magic = cpu_to_le32(WACOM_CAPTURE_MAGIC);
+	hdr.version = cpu_to_le16(WACOM_CAPTURE_VERSION);
+	hdr.bus = cpu_to_le16(hdev->bus);
+	hdr.vendor = cpu_to_le32(hdev->vendor);
+	hdr.product = cpu_to_le32(hdev->product);
+	hdr.rdesc_size = cpu_to_le32(hdev->dev_rsize);
+
+	kfifo_reset(&capture->fifo);
+	kfifo_in(&capture->fifo, &hdr, sizeof(hdr));
+	kfifo_in(&capture->fifo, hdev->dev_rdesc, hdev->dev_rsize);
+
+	kref_get(&capture->kref);
+	file->private_data = capture;
+	smp_store_release(&capture->active, true);
+
+	return nonseekable_open(inode, file);
+}
+
+static int wacom_capture_release(struct inode *inode, struct file *file)
+{
+	struct wacom_capture *capture = file->private_data;
+
+	/* wait out any raw_event still writing before the ring is reused */
+	smp_store_release(&capture->active, false);
+	synchronize_rcu();
+
+	clear_bit(0, &capture->busy);
+	kref_put(&capture->kref, wacom_capture_free);
+	return 0;
+}
+
+static ssize_t wacom_capture_read(struct file *file, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct wacom_capture *capture = file->private_data;
+	unsigned int copied;
+	int error;
+
+	error = mutex_lock_interruptible(&capture->read_lock);
+	if (error)
+		return error;
+
+	/* a dead device's last reports are still handed out */
+	while (kfifo_is_empty(&capture->fifo)) {
+		if (READ_ONCE(capture->dead)) {
+			error = -ENODEV;
+			goto out;
+		}
+
+		if (file->f_flags & O_NONBLOCK) {
+			error = -EAGAIN;
+			goto out;
+		}
+
+		error = wait_event_interruptible(capture->wait,
+				!kfifo_is_empty(&capture->fifo) ||
+				READ_ONCE(capture->dead));
+		if (error)
+			goto out;
+	}
+
+	error = kfifo_to_user(&capture->fifo, buf, count, &copied);
+
+out:
+	mutex_unlock(&capture->read_lock);
+	return error ? error : copied;
+}
+
+static unsigned int wacom_capture_poll(struct file *file, poll_table *wait)
+{
+	struct wacom_capture *capture = file->private_data;
+
+	poll_wait(file, &capture->wait, wait);
+
+	if (!kfifo_is_empty(&capture->fifo))
+		return POLLIN | POLLRDNORM;
+
+	return READ_ONCE(capture->dead) ? POLLHUP | POLLERR : 0;
+}
+
+static const struct file_operations wacom_capture_fops = {
+	.owner =	THIS_MODULE,
+	.open =		wacom_capture_open,
+	.read =		wacom_capture_read,
+	.poll =		wacom_capture_poll,
+	.llseek =	no_llseek,
+	.release =	wacom_capture_release,
+};
+
+static void wacom_debugfs_init(struct wacom *wacom)
+{
+	struct hid_device *hdev = wacom->hdev;
+	struct wacom_capture *capture;
+
+	if (IS_ERR_OR_NULL(hdev->debug_dir))
+		return;
+
+	wacom->debugfs_dir = debugfs_create_dir("wacom", hdev->debug_dir);
+	if (IS_ERR_OR_NULL(wacom->debugfs_dir))
+		return;
+
+	debugfs_create_file("stats", 0600, wacom->debugfs_dir, wacom,
+			    &wacom_stats_fops);
+
+	capture = kzalloc(sizeof(*capture), GFP_KERNEL);
+	if (!capture)
+		return;
+
+	kref_init(&capture->kref);
+	capture->hdev = hdev;
+	mutex_init(&capture->read_lock);
+	init_waitqueue_head(&capture->wait);
+	rcu_assign_pointer(wacom->capture, capture);
+
+	debugfs_create_file("capture", 0400, wacom->debugfs_dir, capture,
+			    &wacom_capture_fops);
+}
+
+static void wacom_debugfs_exit(struct wacom *wacom)
+{
+	struct wacom_capture *capture = rcu_dereference_protected(wacom->capture, 1);
+
+	/*
+	 * debugfs_remove_recursive() waits for readers inside read(), so
+	 * wake them up first; a file still open afterwards keeps the
+	 * capture alive until it is released.
+	 */
+	if (capture) {
+		WRITE_ONCE(capture->dead, true);
+		wake_up_interruptible(&capture->wait);
+	}
+
+	debugfs_remove_recursive(wacom->debugfs_dir);
+	wacom->debugfs_dir = NULL;
+
+	if (capture) {
+		RCU_INIT_POINTER(wacom->capture, NULL);
+		kref_put(&capture->kref, wacom_capture_free);
+	}
+}
+#else
+static inline void wacom_debugfs_init(struct wacom *wacom) {}
+static inline void wacom_debugfs_exit(struct wacom *wacom) {}
+#endif /* CONFIG_DEBUG_FS */
+
 static int wacom_probe(struct hid_device *hdev,
 		const struct hid_device_id *id)
 {
@@ -2780,7 +3663,21 @@ static int wacom_probe(struct hid_device *hdev,
 	if (features->check_for_hid_type && features->hid_type != hdev->type)
 		return -ENODEV;
 
-	error = kfifo_alloc(&wacom_wac->pen_fifo, WACOM_PKGLEN_MAX, GFP_KERNEL);
+	wacom_wac->pen_fifo_depth = clamp_val(pen_fifo_depth, 1,
+					      WACOM_PEN_FIFO_MAX_DEPTH);
+	error = wacom_pen_fifo_alloc(&wacom_wac->pen_fifo,
+				     wacom_wac->pen_fifo_depth);
+	if (error)
+		return error;
+
+	spin_lock_init(&wacom->touch_frame_lock);
+	hrtimer_init(&wacom->touch_frame_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	wacom->touch_frame_timer.function = wacom_touch_frame_timeout;
+	hrtimer_init(&wacom->pen_fifo_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	wacom->pen_fifo_timer.function = wacom_pen_fifo_timeout;
+
+	error = wacom_stats_alloc(wacom);
 	if (error)
 		return error;
 
@@ -2795,6 +3692,8 @@ static int wacom_probe(struct hid_device *hdev,
 	INIT_WORK(&wacom->battery_work, wacom_battery_work);
 	INIT_WORK(&wacom->remote_work, wacom_remote_work);
 	INIT_WORK(&wacom->mode_change_work, wacom_mode_change_work);
+	INIT_WORK(&wacom->oled.work, wacom_oled_work);
+	mutex_init(&wacom->oled.lock);
 
 	/* ask for the report descriptor to be loaded by HID */
 	error = hid_parse(hdev);
@@ -2815,6 +3714,16 @@ static int wacom_probe(struct hid_device *hdev,
 				 error);
 	}
 
+	if (wacom_pen_frames_modes(&wacom->wacom_wac.features)) {
+		error = device_create_file(&hdev->dev, &dev_attr_pen_frames);
+		if (error)
+			hid_warn(hdev,
+				 "can't create sysfs pen_frames attribute err: %d\n",
+				 error);
+	}
+
+	wacom_debugfs_init(wacom);
+
 	return 0;
 }
 
@@ -2824,11 +3733,23 @@ static void wacom_remove(struct hid_device *hdev)
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct wacom_features *features = &wacom_wac->features;
 
+	/* the OLED work talks to the device, finish it while we still can */
+	mutex_lock(&wacom->oled.lock);
+	wacom->oled.stopped = true;
+	mutex_unlock(&wacom->oled.lock);
+	cancel_work_sync(&wacom->oled.work);
+
 	if (features->device_type & WACOM_DEVICETYPE_WL_MONITOR)
 		hid_hw_close(hdev);
 
 	hid_hw_stop(hdev);
 
+	/* no more reports can re-arm them now */
+	hrtimer_cancel(&wacom->touch_frame_timer);
+	hrtimer_cancel(&wacom->pen_fifo_timer);
+
+	wacom_debugfs_exit(wacom);
+
 	cancel_delayed_work_sync(&wacom->init_work);
 	cancel_work_sync(&wacom->wireless_work);
 	cancel_work_sync(&wacom->battery_work);
@@ -2836,6 +3757,8 @@ static void wacom_remove(struct hid_device *hdev)
 	cancel_work_sync(&wacom->mode_change_work);
 	if (hdev->bus == BUS_BLUETOOTH)
 		device_remove_file(&hdev->dev, &dev_attr_speed);
+	if (wacom_pen_frames_modes(features))
+		device_remove_file(&hdev->dev, &dev_attr_pen_frames);
 
 	/* make sure we don't trigger the LEDs */
 	wacom_led_groups_release(wacom);
@@ -2859,6 +3782,11 @@ static int wacom_resume(struct hid_device *hdev)
 
 	mutex_unlock(&wacom->lock);
 
+	/* don't trust the button images to have survived */
+	mutex_lock(&wacom->oled.lock);
+	wacom->oled.shown = 0;
+	mutex_unlock(&wacom->oled.lock);
+
 	return 0;
 }
 
@@ -2868,17 +3796,70 @@ static int wacom_reset_resume(struct hid_device *hdev)
 }
 #endif /* CONFIG_PM */
 
+static const char *wacom_tool_type_name(u16 type)
+{
+	switch (type) {
+	case BTN_TOOL_PEN:	return "pen";
+	case BTN_TOOL_RUBBER:	return "rubber";
+	case BTN_TOOL_BRUSH:	return "brush";
+	case BTN_TOOL_PENCIL:	return "pencil";
+	case BTN_TOOL_AIRBRUSH:	return "airbrush";
+	case BTN_TOOL_MOUSE:	return "mouse";
+	case BTN_TOOL_LENS:	return "lens";
+	}
+	return "?";
+}
+
+/*
+ * One line per known Intuos protocol tool: the ID from the prox-in report,
+ * the ID as reported in ABS_MISC, the tool type and the capability flags
+ * (eraser, pressure, tilt, rotation, wheel), then the tool name.
+ */
+static ssize_t tools_show(struct device_driver *driver, char *buf)
+{
+	const struct wacom_tool *tool;
+	ssize_t len = 0;
+
+	for (tool = wacom_tools; tool->id; tool++) {
+		u16 flags = tool->flags;
+
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%05x %06x %-8s %c%c%c%c%c %s\n",
+				 tool->id, wacom_intuos_id_mangle(tool->id),
+				 wacom_tool_type_name(tool->type),
+				 flags & WACOM_TOOL_IS_ERASER ? 'e' : '-',
+				 flags & WACOM_TOOL_PRESSURE ? 'p' : '-',
+				 flags & WACOM_TOOL_TILT ? 't' : '-',
+				 flags & WACOM_TOOL_ROTATION ? 'r' : '-',
+				 flags & WACOM_TOOL_WHEEL ? 'w' : '-',
+				 tool->name);
+	}
+
+	return len;
+}
+
+static DRIVER_ATTR_RO(tools);
+
+static struct attribute *wacom_driver_attrs[] = {
+	&driver_attr_tools.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(wacom_driver);
+
 static struct hid_driver wacom_driver = {
 	.name =		"wacom",
 	.id_table =	wacom_ids,
 	.probe =	wacom_probe,
 	.remove =	wacom_remove,
-	.report =	wacom_wac_report,
+	.report =	wacom_report,
 #ifdef CONFIG_PM
 	.resume =	wacom_resume,
 	.reset_resume =	wacom_reset_resume,
 #endif
 	.raw_event =	wacom_raw_event,
+	.driver = {
+		.groups = wacom_driver_groups,
+	},
 };
 module_hid_driver(wacom_driver);
 
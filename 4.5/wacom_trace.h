@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * drivers/input/tablet/wacom_trace.h
+ *
+ *  Tracepoints along the report path, from wacom_raw_event() through
+ *  the decoders to input_sync(). Every event carries the sequence
+ *  number of the report being handled, so per-report latency and event
+ *  fan-out can be reconstructed from a trace.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wacom
+
+#if !defined(_WACOM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _WACOM_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/hid.h>
+#include <linux/input.h>
+#include "wacom_wac.h"
+
+DECLARE_EVENT_CLASS(wacom_report,
+
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 int report_id, int len),
+
+	TP_ARGS(hdev, wacom_wac, report_id, len),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, dev)
+		__field(u32, seq)
+		__field(int, type)
+		__field(int, report_id)
+		__field(int, len)
+	),
+
+	TP_fast_assign(
+		__entry->dev = hdev->id;
+		__entry->seq = wacom_wac->report_seq;
+		__entry->type = wacom_wac->features.type;
+		__entry->report_id = report_id;
+		__entry->len = len;
+	),
+
+	TP_printk("dev=%u seq=%u type=%d id=%d len=%d",
+		  __entry->dev, __entry->seq, __entry->type,
+		  __entry->report_id, __entry->len)
+);
+
+DEFINE_EVENT(wacom_report, wacom_raw_event,
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 int report_id, int len),
+	TP_ARGS(hdev, wacom_wac, report_id, len)
+);
+
+DEFINE_EVENT(wacom_report, wacom_wac_irq,
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 int report_id, int len),
+	TP_ARGS(hdev, wacom_wac, report_id, len)
+);
+
+DEFINE_EVENT(wacom_report, wacom_wac_report,
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 int report_id, int len),
+	TP_ARGS(hdev, wacom_wac, report_id, len)
+);
+
+DEFINE_EVENT(wacom_report, wacom_queue_insert,
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 int report_id, int len),
+	TP_ARGS(hdev, wacom_wac, report_id, len)
+);
+
+DEFINE_EVENT(wacom_report, wacom_queue_flush,
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 int report_id, int len),
+	TP_ARGS(hdev, wacom_wac, report_id, len)
+);
+
+TRACE_EVENT(wacom_input_sync,
+
+	TP_PROTO(struct hid_device *hdev, struct wacom_wac *wacom_wac,
+		 struct input_dev *input, bool stamp),
+
+	TP_ARGS(hdev, wacom_wac, input, stamp),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, dev)
+		__field(u32, seq)
+		__field(int, type)
+		__field(int, report_id)
+		__field(bool, stamp)
+		__string(input, input->name)
+	),
+
+	TP_fast_assign(
+		__entry->dev = hdev->id;
+		__entry->seq = wacom_wac->report_seq;
+		__entry->type = wacom_wac->features.type;
+		__entry->report_id = wacom_wac->data[0];
+		__entry->stamp = stamp;
+		__assign_str(input, input->name);
+	),
+
+	TP_printk("dev=%u seq=%u type=%d id=%d input=\"%s\" stamp=%d",
+		  __entry->dev, __entry->seq, __entry->type,
+		  __entry->report_id, __get_str(input), __entry->stamp)
+);
+
+#endif /* _WACOM_TRACE_H */
+
+/* this part must be outside the protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE wacom_trace
+#include <trace/define_trace.h>
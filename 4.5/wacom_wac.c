@@ -10,7 +10,9 @@
 
 #include "wacom_wac.h"
 #include "wacom.h"
+#include "wacom_trace.h"
 #include <linux/input/mt.h>
+#include <linux/hash.h>
 
 #ifndef KEY_ONSCREEN_KEYBOARD
 #define KEY_ONSCREEN_KEYBOARD	0x278
@@ -28,6 +30,15 @@
 #define WACOM_DTU_OFFSET	200
 #define WACOM_CINTIQ_OFFSET	400
 
+/* Frame intervals of reports that pack several device frames */
+#define WACOM_PRO2_BT_PEN_FRAME_NS	(5 * NSEC_PER_MSEC)
+#define WACOM_GEN3_BT_PEN_FRAME_NS	(7500 * NSEC_PER_USEC)
+#define WACOM_PRO2_BT_TOUCH_FRAME_NS	(7500 * NSEC_PER_USEC)
+#define WACOM_INTUOS4WL_BT_PEN_FRAME_NS	(5 * NSEC_PER_MSEC)
+
+/* Resynchronize HID_DG_SCANTIME to the receive time after such a gap */
+#define WACOM_SCANTIME_RESYNC_US	USEC_PER_SEC
+
 /*
  * Scale factor relating reported contact size to logical contact area.
  * 2^14/pi is a good approximation on Intuos5 and 3rd-gen Bamboo
@@ -89,7 +100,90 @@ static void wacom_notify_battery(struct wacom_wac *wacom_wac,
 			       bat_charging, bat_connected, ps_connected);
 }
 
-static int wacom_penpartner_irq(struct wacom_wac *wacom)
+void wacom_wac_set_rx_time(struct wacom_wac *wacom_wac, ktime_t time)
+{
+	struct wacom_timestamp *ts = &wacom_wac->timestamp;
+
+	ts->last_rx_time = ts->rx_time;
+	ts->rx_time = time;
+	ts->stamp = (u32)ktime_to_us(time);
+}
+
+/*
+ * Stamp frame @frame of the @frames packed into the current report,
+ * taking the last one as sampled when the report arrived. Never go back
+ * past the previous report so that stamps stay monotonic.
+ */
+static void wacom_frame_time(struct wacom_wac *wacom_wac, int frame,
+			     int frames, unsigned int frame_ns)
+{
+	struct wacom_timestamp *ts = &wacom_wac->timestamp;
+	ktime_t time;
+
+	time = ktime_sub_ns(ts->rx_time, (u64)(frames - 1 - frame) * frame_ns);
+	if (ktime_compare(time, ts->last_rx_time) < 0)
+		time = ts->last_rx_time;
+
+	ts->stamp = (u32)ktime_to_us(time);
+}
+
+static void wacom_scan_time(struct wacom_wac *wacom_wac,
+			    struct hid_field *field, __s32 value)
+{
+	struct wacom_timestamp *ts = &wacom_wac->timestamp;
+	u32 scan_time = wacom_s32tou(value, field->report_size);
+	s64 delta = (s64)scan_time - ts->scan_time;
+
+	if (delta < 0)
+		delta += (s64)field->logical_maximum + 1;
+
+	if (ktime_us_delta(ts->rx_time, ts->scan_rx_time) > WACOM_SCANTIME_RESYNC_US)
+		ts->device_time = (u32)ktime_to_us(ts->rx_time);
+	else
+		ts->device_time += delta * 100;
+
+	ts->scan_rx_time = ts->rx_time;
+	ts->scan_time = scan_time;
+	ts->stamp = ts->device_time;
+}
+
+/*
+ * input_sync(), carrying the current frame's MSC_TIMESTAMP when stamp is
+ * set. Only frames a decoder put data in are stamped: inputs a report did
+ * not touch (see frame_data) and switch-only frames are synced unstamped,
+ * so the input core still drops them when they are empty.
+ */
+static void __wacom_input_sync(struct wacom_wac *wacom_wac,
+			       struct input_dev *input, bool stamp)
+{
+	struct wacom *wacom = container_of(wacom_wac, struct wacom, wacom_wac);
+
+	if (stamp)
+		input_event(input, EV_MSC, MSC_TIMESTAMP,
+			    wacom_wac->timestamp.stamp);
+	trace_wacom_input_sync(wacom->hdev, wacom_wac, input, stamp);
+	input_sync(input);
+}
+
+static void wacom_input_sync(struct wacom_wac *wacom_wac,
+			     struct input_dev *input)
+{
+	__wacom_input_sync(wacom_wac, input, true);
+}
+
+/*
+ * Some protocols resend the pad with every report. Its frame only has
+ * data when the pad bytes, packed into state, changed since the last one.
+ */
+static bool wacom_pad_changed(struct wacom_wac *wacom_wac, u32 state)
+{
+	bool changed = state != wacom_wac->pad_state;
+
+	wacom_wac->pad_state = state;
+	return changed;
+}
+
+static int wacom_penpartner_irq(struct wacom_wac *wacom, size_t len)
 {
 	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pen_input;
@@ -130,10 +224,11 @@ static int wacom_penpartner_irq(struct wacom_wac *wacom)
 		return 0;
         }
 
+	wacom->frame_data |= WACOM_DEVICETYPE_PEN;
 	return 1;
 }
 
-static int wacom_pl_irq(struct wacom_wac *wacom)
+static int wacom_pl_irq(struct wacom_wac *wacom, size_t len)
 {
 	struct wacom_features *features = &wacom->features;
 	unsigned char *data = wacom->data;
@@ -166,7 +261,7 @@ static int wacom_pl_irq(struct wacom_wac *wacom)
 	if (wacom->tool[0] == BTN_TOOL_RUBBER && !(data[4] & 0x20)) {
 		input_report_key(input, BTN_TOOL_RUBBER, 0);
 		input_report_abs(input, ABS_MISC, 0);
-		input_sync(input);
+		wacom_input_sync(wacom, input);
 		wacom->tool[0] = BTN_TOOL_PEN;
 		wacom->id[0] = STYLUS_DEVICE_ID;
 	}
@@ -191,10 +286,11 @@ static int wacom_pl_irq(struct wacom_wac *wacom)
 		wacom->id[0] = 0;
 	input_report_key(input, wacom->tool[0], prox);
 	input_report_abs(input, ABS_MISC, wacom->id[0]);
+	wacom->frame_data |= WACOM_DEVICETYPE_PEN;
 	return 1;
 }
 
-static int wacom_ptu_irq(struct wacom_wac *wacom)
+static int wacom_ptu_irq(struct wacom_wac *wacom, size_t len)
 {
 	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pen_input;
@@ -220,10 +316,11 @@ static int wacom_ptu_irq(struct wacom_wac *wacom)
 	input_report_abs(input, ABS_PRESSURE, le16_to_cpup((__le16 *)&data[6]));
 	input_report_key(input, BTN_STYLUS, data[1] & 0x02);
 	input_report_key(input, BTN_STYLUS2, data[1] & 0x10);
+	wacom->frame_data |= WACOM_DEVICETYPE_PEN;
 	return 1;
 }
 
-static int wacom_dtu_irq(struct wacom_wac *wacom)
+static int wacom_dtu_irq(struct wacom_wac *wacom, size_t len)
 {
 	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pen_input;
@@ -250,10 +347,11 @@ static int wacom_dtu_irq(struct wacom_wac *wacom)
 		wacom->id[0] = 0;
 	input_report_key(input, wacom->tool[0], prox);
 	input_report_abs(input, ABS_MISC, wacom->id[0]);
+	wacom->frame_data |= WACOM_DEVICETYPE_PEN;
 	return 1;
 }
 
-static int wacom_dtus_irq(struct wacom_wac *wacom)
+static int wacom_dtus_irq(struct wacom_wac *wacom, size_t len)
 {
 	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pen_input;
@@ -271,6 +369,7 @@ static int wacom_dtus_irq(struct wacom_wac *wacom)
 		input_report_key(input, BTN_3, (data[1] & 0x08));
 		input_report_abs(input, ABS_MISC,
 				 data[1] & 0x0f ? PAD_DEVICE_ID : 0);
+		wacom->frame_data |= WACOM_DEVICETYPE_PAD;
 		return 1;
 	} else {
 		prox = data[1] & 0x80;
@@ -300,11 +399,12 @@ static int wacom_dtus_irq(struct wacom_wac *wacom)
 			wacom->id[0] = 0;
 		input_report_key(input, wacom->tool[0], prox);
 		input_report_abs(input, ABS_MISC, wacom->id[0]);
+		wacom->frame_data |= WACOM_DEVICETYPE_PEN;
 		return 1;
 	}
 }
 
-static int wacom_graphire_irq(struct wacom_wac *wacom)
+static int wacom_graphire_irq(struct wacom_wac *wacom, size_t len)
 {
 	struct wacom_features *features = &wacom->features;
 	unsigned char *data = wacom->data;
@@ -397,7 +497,7 @@ static int wacom_graphire_irq(struct wacom_wac *wacom)
 			wacom->id[0] = 0;
 		input_report_abs(input, ABS_MISC, wacom->id[0]); /* report tool id */
 		input_report_key(input, wacom->tool[0], prox);
-		input_sync(input); /* sync last event */
+		wacom_input_sync(wacom, input); /* sync last event */
 	}
 
 	/* send pad data */
@@ -455,6 +555,8 @@ static int wacom_graphire_irq(struct wacom_wac *wacom)
 				     battery_capacity, ps_connected, 1,
 				     ps_connected);
 	}
+	if (retval)
+		wacom->frame_data |= WACOM_DEVICETYPE_PAD;
 exit:
 	return retval;
 }
@@ -476,10 +578,10 @@ static void wacom_intuos_schedule_prox_event(struct wacom_wac *wacom_wac)
 	}
 }
 
-static int wacom_intuos_pad(struct wacom_wac *wacom)
+static int wacom_intuos_pad(struct wacom_wac *wacom,
+			    const unsigned char *data)
 {
 	struct wacom_features *features = &wacom->features;
-	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pad_input;
 	int i;
 	int buttons = 0, nbuttons = features->numbered_buttons;
@@ -620,7 +722,7 @@ static int wacom_intuos_pad(struct wacom_wac *wacom)
 		input_report_switch(wacom->shared->touch_input,
 				    SW_MUTE_DEVICE,
 				    !wacom->shared->is_touch_on);
-		input_sync(wacom->shared->touch_input);
+		__wacom_input_sync(wacom, wacom->shared->touch_input, false);
 	}
 
 	input_report_abs(input, ABS_RX, strip1);
@@ -637,105 +739,113 @@ static int wacom_intuos_pad(struct wacom_wac *wacom)
 	return 1;
 }
 
-static int wacom_intuos_id_mangle(int tool_id)
+int wacom_intuos_id_mangle(int tool_id)
 {
 	return (tool_id & ~0xFFF) << 4 | (tool_id & 0xFFF);
 }
 
+/*
+ * Tools of the Intuos protocol family, keyed on the tool ID as assembled
+ * from the prox-in report (the unmangled form). Kept sorted by ID so that
+ * the prox-in lookup is a binary search; new tools only need a line here.
+ * The table is also shown to userspace in the driver's "tools" attribute.
+ */
+#define WACOM_TOOL_STYLUS	(WACOM_TOOL_PRESSURE | WACOM_TOOL_TILT)
+#define WACOM_TOOL_ERASER	(WACOM_TOOL_STYLUS | WACOM_TOOL_IS_ERASER)
+#define WACOM_TOOL_AIRBRUSH	(WACOM_TOOL_STYLUS | WACOM_TOOL_WHEEL)
+
+const struct wacom_tool wacom_tools[] = {
+	{ 0x00006, BTN_TOOL_LENS,	0,	"Intuos4 Lens cursor" },
+	{ 0x00007, BTN_TOOL_MOUSE,	0,	"Mouse 4D and 2D" },
+	{ 0x00012, BTN_TOOL_PENCIL,	WACOM_TOOL_STYLUS,	"Inking pen" },
+	{ 0x00017, BTN_TOOL_MOUSE,	0,	"Intuos3 2D Mouse" },
+	{ 0x00022, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Pen" },
+	{ 0x00032, BTN_TOOL_BRUSH,	WACOM_TOOL_STYLUS,	"Stroke pen" },
+	{ 0x00094, BTN_TOOL_MOUSE,	0,	"Mouse 4D and 2D" },
+	{ 0x00096, BTN_TOOL_LENS,	0,	"Lens cursor" },
+	{ 0x00097, BTN_TOOL_LENS,	0,	"Intuos3 Lens cursor" },
+	{ 0x0009c, BTN_TOOL_MOUSE,	0,	"Mouse 4D and 2D" },
+	{ 0x000fa, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Eraser" },
+	{ 0x00112, BTN_TOOL_AIRBRUSH,	WACOM_TOOL_AIRBRUSH,	"Airbrush" },
+	{ 0x00801, BTN_TOOL_PENCIL,	WACOM_TOOL_STYLUS,	"Intuos3 Inking pen" },
+	{ 0x00802, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Intuos4/5 13HD/24HD General Pen" },
+	{ 0x00804, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS | WACOM_TOOL_ROTATION,	"Intuos4/5 13HD/24HD Marker Pen" },
+	{ 0x00806, BTN_TOOL_MOUSE,	0,	"Intuos4 Mouse" },
+	{ 0x0080a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD General Pen Eraser" },
+	{ 0x0080c, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD Marker Pen Eraser" },
+	{ 0x00812, BTN_TOOL_PENCIL,	WACOM_TOOL_STYLUS,	"Inking pen" },
+	{ 0x00813, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Intuos3 Classic Pen" },
+	{ 0x0081b, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos3 Classic Pen Eraser" },
+	{ 0x00822, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Pen" },
+	{ 0x00823, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Intuos3 Grip Pen" },
+	{ 0x0082a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Eraser" },
+	{ 0x0082b, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos3 Grip Pen Eraser" },
+	{ 0x00832, BTN_TOOL_BRUSH,	WACOM_TOOL_STYLUS,	"Stroke pen" },
+	{ 0x00842, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Pen" },
+	{ 0x0084a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Eraser" },
+	{ 0x00852, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Pen" },
+	{ 0x0085a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Eraser" },
+	{ 0x00885, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS | WACOM_TOOL_ROTATION,	"Intuos3 Marker Pen" },
+	{ 0x008e2, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"IntuosHT2 pen" },
+	{ 0x00902, BTN_TOOL_AIRBRUSH,	WACOM_TOOL_AIRBRUSH,	"Intuos4/5 13HD/24HD Airbrush" },
+	{ 0x0090a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD Airbrush Eraser" },
+	{ 0x00912, BTN_TOOL_AIRBRUSH,	WACOM_TOOL_AIRBRUSH,	"Airbrush" },
+	{ 0x00913, BTN_TOOL_AIRBRUSH,	WACOM_TOOL_AIRBRUSH,	"Intuos3 Airbrush" },
+	{ 0x0091a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Eraser" },
+	{ 0x0091b, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos3 Airbrush Eraser" },
+	{ 0x00d12, BTN_TOOL_AIRBRUSH,	WACOM_TOOL_AIRBRUSH,	"Airbrush" },
+	{ 0x00d1a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Eraser" },
+	{ 0x10802, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Intuos4/5 13HD/24HD General Pen" },
+	{ 0x10804, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS | WACOM_TOOL_ROTATION,	"Intuos4/5 13HD/24HD Art Pen" },
+	{ 0x1080a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD General Pen Eraser" },
+	{ 0x1080c, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD Art Pen Eraser" },
+	{ 0x10842, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"MobileStudio Pro Pro Pen slim" },
+	{ 0x1084a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"MobileStudio Pro Pro Pen slim Eraser" },
+	{ 0x10902, BTN_TOOL_AIRBRUSH,	WACOM_TOOL_AIRBRUSH,	"Intuos4/5 13HD/24HD Airbrush" },
+	{ 0x1090a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD Airbrush Eraser" },
+	{ 0x12802, BTN_TOOL_PENCIL,	WACOM_TOOL_STYLUS,	"Intuos4/5 Inking Pen" },
+	{ 0x14802, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Intuos4/5 13HD/24HD Classic Pen" },
+	{ 0x1480a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Intuos4/5 13HD/24HD Classic Pen Eraser" },
+	{ 0x16802, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"Cintiq 13HD Pro Pen" },
+	{ 0x1680a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"Cintiq 13HD Pro Pen Eraser" },
+	{ 0x18802, BTN_TOOL_PEN,	WACOM_TOOL_STYLUS,	"DTH2242 Pen" },
+	{ 0x1880a, BTN_TOOL_RUBBER,	WACOM_TOOL_ERASER,	"DTH2242 Eraser" },
+	{ }
+};
+
+static const struct wacom_tool *wacom_intuos_get_tool(u32 tool_id)
+{
+	unsigned int lo = 0, hi = ARRAY_SIZE(wacom_tools) - 1;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		const struct wacom_tool *tool = &wacom_tools[mid];
+
+		if (tool->id == tool_id)
+			return tool;
+		if (tool->id < tool_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
 static int wacom_intuos_get_tool_type(int tool_id)
 {
-	int tool_type;
-
-	switch (tool_id) {
-	case 0x812: /* Inking pen */
-	case 0x801: /* Intuos3 Inking pen */
-	case 0x12802: /* Intuos4/5 Inking Pen */
-	case 0x012:
-		tool_type = BTN_TOOL_PENCIL;
-		break;
-
-	case 0x822: /* Pen */
-	case 0x842:
-	case 0x852:
-	case 0x823: /* Intuos3 Grip Pen */
-	case 0x813: /* Intuos3 Classic Pen */
-	case 0x885: /* Intuos3 Marker Pen */
-	case 0x802: /* Intuos4/5 13HD/24HD General Pen */
-	case 0x804: /* Intuos4/5 13HD/24HD Marker Pen */
-	case 0x8e2: /* IntuosHT2 pen */
-	case 0x022:
-	case 0x10804: /* Intuos4/5 13HD/24HD Art Pen */
-	case 0x10842: /* MobileStudio Pro Pro Pen slim */
-	case 0x14802: /* Intuos4/5 13HD/24HD Classic Pen */
-	case 0x16802: /* Cintiq 13HD Pro Pen */
-	case 0x18802: /* DTH2242 Pen */
-	case 0x10802: /* Intuos4/5 13HD/24HD General Pen */
-		tool_type = BTN_TOOL_PEN;
-		break;
-
-	case 0x832: /* Stroke pen */
-	case 0x032:
-		tool_type = BTN_TOOL_BRUSH;
-		break;
-
-	case 0x007: /* Mouse 4D and 2D */
-	case 0x09c:
-	case 0x094:
-	case 0x017: /* Intuos3 2D Mouse */
-	case 0x806: /* Intuos4 Mouse */
-		tool_type = BTN_TOOL_MOUSE;
-		break;
-
-	case 0x096: /* Lens cursor */
-	case 0x097: /* Intuos3 Lens cursor */
-	case 0x006: /* Intuos4 Lens cursor */
-		tool_type = BTN_TOOL_LENS;
-		break;
-
-	case 0x82a: /* Eraser */
-	case 0x84a:
-	case 0x85a:
-	case 0x91a:
-	case 0xd1a:
-	case 0x0fa:
-	case 0x82b: /* Intuos3 Grip Pen Eraser */
-	case 0x81b: /* Intuos3 Classic Pen Eraser */
-	case 0x91b: /* Intuos3 Airbrush Eraser */
-	case 0x80c: /* Intuos4/5 13HD/24HD Marker Pen Eraser */
-	case 0x80a: /* Intuos4/5 13HD/24HD General Pen Eraser */
-	case 0x90a: /* Intuos4/5 13HD/24HD Airbrush Eraser */
-	case 0x1480a: /* Intuos4/5 13HD/24HD Classic Pen Eraser */
-	case 0x1090a: /* Intuos4/5 13HD/24HD Airbrush Eraser */
-	case 0x1080c: /* Intuos4/5 13HD/24HD Art Pen Eraser */
-	case 0x1084a: /* MobileStudio Pro Pro Pen slim Eraser */
-	case 0x1680a: /* Cintiq 13HD Pro Pen Eraser */
-	case 0x1880a: /* DTH2242 Eraser */
-	case 0x1080a: /* Intuos4/5 13HD/24HD General Pen Eraser */
-		tool_type = BTN_TOOL_RUBBER;
-		break;
-
-	case 0xd12:
-	case 0x912:
-	case 0x112:
-	case 0x913: /* Intuos3 Airbrush */
-	case 0x902: /* Intuos4/5 13HD/24HD Airbrush */
-	case 0x10902: /* Intuos4/5 13HD/24HD Airbrush */
-		tool_type = BTN_TOOL_AIRBRUSH;
-		break;
-
-	default: /* Unknown tool */
-		tool_type = BTN_TOOL_PEN;
-		break;
-	}
-	return tool_type;
+	const struct wacom_tool *tool = wacom_intuos_get_tool(tool_id);
+
+	/* Unknown tool */
+	return tool ? tool->type : BTN_TOOL_PEN;
 }
 
-static void wacom_exit_report(struct wacom_wac *wacom)
+static void wacom_exit_report(struct wacom_wac *wacom,
+			      const unsigned char *data)
 {
 	struct input_dev *input = wacom->pen_input;
 	struct wacom_features *features = &wacom->features;
-	unsigned char *data = wacom->data;
-	int idx = (features->type == INTUOS) ? (data[1] & 0x01) : 0;
+	int idx = (features->caps & WACOM_CAP_DUAL_TOOL) ? (data[1] & 0x01) : 0;
 
 	/*
 	 * Reset all states otherwise we lose the initial states
@@ -760,7 +870,7 @@ static void wacom_exit_report(struct wacom_wac *wacom)
 		input_report_key(input, BTN_STYLUS2, 0);
 		input_report_key(input, BTN_TOUCH, 0);
 		input_report_abs(input, ABS_WHEEL, 0);
-		if (features->type >= INTUOS3S)
+		if (!(features->caps & WACOM_CAP_PRE_INTUOS3))
 			input_report_abs(input, ABS_Z, 0);
 	}
 	input_report_key(input, wacom->tool[idx], 0);
@@ -769,20 +879,64 @@ static void wacom_exit_report(struct wacom_wac *wacom)
 	wacom->id[idx] = 0;
 }
 
-static int wacom_intuos_inout(struct wacom_wac *wacom)
+enum wacom_intuos_packet_kind {
+	WACOM_INTUOS_GENERAL,	/* tool data, of the type in data[1] */
+	WACOM_INTUOS_ENTER,	/* tool enters prox, with its serial and ID */
+	WACOM_INTUOS_RANGE,	/* tool in range */
+	WACOM_INTUOS_EXIT,	/* tool leaves prox */
+};
+
+static enum wacom_intuos_packet_kind
+wacom_intuos_packet_kind(const unsigned char *data)
+{
+	if ((data[1] & 0xfc) == 0xc0)
+		return WACOM_INTUOS_ENTER;
+	if ((data[1] & 0xfe) == 0x20)
+		return WACOM_INTUOS_RANGE;
+	if ((data[1] & 0xfe) == 0x80)
+		return WACOM_INTUOS_EXIT;
+	return WACOM_INTUOS_GENERAL;
+}
+
+static unsigned char wacom_intuos_packet_type(const unsigned char *data)
+{
+	return (data[1] >> 1) & 0x0f;
+}
+
+/* Types 0 to 3 are general pen packets, the others mouse and airbrush */
+static bool wacom_intuos_is_pen_packet(const unsigned char *data)
+{
+	return wacom_intuos_packet_kind(data) == WACOM_INTUOS_GENERAL &&
+	       wacom_intuos_packet_type(data) <= 0x03;
+}
+
+static unsigned int wacom_intuos_pressure(struct wacom_features *features,
+					  const unsigned char *data)
+{
+	unsigned int t = (data[6] << 3) | ((data[7] & 0xC0) >> 5) | (data[1] & 1);
+
+	if (features->pressure_max < 2047)
+		t >>= 1;
+	return t;
+}
+
+static bool wacom_intuos_tip(unsigned int pressure)
+{
+	return pressure > 10;
+}
+
+static int wacom_intuos_inout(struct wacom_wac *wacom,
+			      const unsigned char *data)
 {
 	struct wacom_features *features = &wacom->features;
-	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pen_input;
-	int idx = (features->type == INTUOS) ? (data[1] & 0x01) : 0;
+	int idx = (features->caps & WACOM_CAP_DUAL_TOOL) ? (data[1] & 0x01) : 0;
 
-	if (!(((data[1] & 0xfc) == 0xc0) ||  /* in prox */
-	    ((data[1] & 0xfe) == 0x20) ||    /* in range */
-	    ((data[1] & 0xfe) == 0x80)))     /* out prox */
+	switch (wacom_intuos_packet_kind(data)) {
+	case WACOM_INTUOS_GENERAL:
 		return 0;
 
-	/* Enter report */
-	if ((data[1] & 0xfc) == 0xc0) {
+	case WACOM_INTUOS_ENTER:
 		/* serial number of the tool */
 		wacom->serial[idx] = ((data[3] & 0x0f) << 28) +
 			(data[4] << 20) + (data[5] << 12) +
@@ -795,11 +949,9 @@ static int wacom_intuos_inout(struct wacom_wac *wacom)
 
 		wacom->shared->stylus_in_proximity = true;
 		return 1;
-	}
 
-	/* in Range */
-	if ((data[1] & 0xfe) == 0x20) {
-		if (features->type != INTUOSHT2)
+	case WACOM_INTUOS_RANGE:
+		if (!(features->caps & WACOM_CAP_RANGE_NOT_PROX))
 			wacom->shared->stylus_in_proximity = true;
 
 		/* in Range while exiting */
@@ -810,10 +962,8 @@ static int wacom_intuos_inout(struct wacom_wac *wacom)
 			return 2;
 		}
 		return 1;
-	}
 
-	/* Exit report */
-	if ((data[1] & 0xfe) == 0x80) {
+	case WACOM_INTUOS_EXIT:
 		wacom->shared->stylus_in_proximity = false;
 		wacom->reporting_data = false;
 
@@ -821,7 +971,7 @@ static int wacom_intuos_inout(struct wacom_wac *wacom)
 		if (!wacom->id[idx])
 			return 1;
 
-		wacom_exit_report(wacom);
+		wacom_exit_report(wacom, data);
 		return 2;
 	}
 
@@ -838,13 +988,13 @@ static inline bool delay_pen_events(struct wacom_wac *wacom)
 	return (wacom->shared->touch_down && touch_arbitration);
 }
 
-static int wacom_intuos_general(struct wacom_wac *wacom)
+static int wacom_intuos_general(struct wacom_wac *wacom,
+				const unsigned char *data)
 {
 	struct wacom_features *features = &wacom->features;
-	unsigned char *data = wacom->data;
 	struct input_dev *input = wacom->pen_input;
-	int idx = (features->type == INTUOS) ? (data[1] & 0x01) : 0;
-	unsigned char type = (data[1] >> 1) & 0x0F;
+	int idx = (features->caps & WACOM_CAP_DUAL_TOOL) ? (data[1] & 0x01) : 0;
+	unsigned char type = wacom_intuos_packet_type(data);
 	unsigned int x, y, distance, t;
 
 	if (data[0] != WACOM_REPORT_PENABLED && data[0] != WACOM_REPORT_CINTIQ &&
@@ -866,30 +1016,23 @@ static int wacom_intuos_general(struct wacom_wac *wacom)
 	 */
 	/* older I4 styli don't work with new Cintiqs */
 	if ((!((wacom->id[idx] >> 16) & 0x01) &&
-			(features->type == WACOM_21UX2)) ||
+			(features->caps & WACOM_CAP_I4_STYLUS_ONLY)) ||
 	    /* Only large Intuos support Lense Cursor */
 	    (wacom->tool[idx] == BTN_TOOL_LENS &&
-		(features->type == INTUOS3 ||
-		 features->type == INTUOS3S ||
-		 features->type == INTUOS4 ||
-		 features->type == INTUOS4S ||
-		 features->type == INTUOS5 ||
-		 features->type == INTUOS5S ||
-		 features->type == INTUOSPM ||
-		 features->type == INTUOSPS)) ||
+		(features->caps & WACOM_CAP_NO_LENS)) ||
 	   /* Cintiq doesn't send data when RDY bit isn't set */
-	   (features->type == CINTIQ && !(data[1] & 0x40)))
+	   ((features->caps & WACOM_CAP_NEEDS_RDY) && !(data[1] & 0x40)))
 		return 1;
 
 	x = (be16_to_cpup((__be16 *)&data[2]) << 1) | ((data[9] >> 1) & 1);
 	y = (be16_to_cpup((__be16 *)&data[4]) << 1) | (data[9] & 1);
 	distance = data[9] >> 2;
-	if (features->type < INTUOS3S) {
+	if (features->caps & WACOM_CAP_PRE_INTUOS3) {
 		x >>= 1;
 		y >>= 1;
 		distance >>= 1;
 	}
-	if (features->type == INTUOSHT2)
+	if (features->caps & WACOM_CAP_INVERT_DISTANCE)
 		distance = features->distance_max - distance;
 	input_report_abs(input, ABS_X, x);
 	input_report_abs(input, ABS_Y, y);
@@ -901,18 +1044,16 @@ static int wacom_intuos_general(struct wacom_wac *wacom)
 	case 0x02:
 	case 0x03:
 		/* general pen packet */
-		t = (data[6] << 3) | ((data[7] & 0xC0) >> 5) | (data[1] & 1);
-		if (features->pressure_max < 2047)
-			t >>= 1;
+		t = wacom_intuos_pressure(features, data);
 		input_report_abs(input, ABS_PRESSURE, t);
-		if (features->type != INTUOSHT2) {
+		if (features->caps & WACOM_CAP_TILT) {
 		    input_report_abs(input, ABS_TILT_X,
 				 (((data[7] << 1) & 0x7e) | (data[8] >> 7)) - 64);
 		    input_report_abs(input, ABS_TILT_Y, (data[8] & 0x7f) - 64);
 		}
 		input_report_key(input, BTN_STYLUS, data[1] & 2);
 		input_report_key(input, BTN_STYLUS2, data[1] & 4);
-		input_report_key(input, BTN_TOUCH, t > 10);
+		input_report_key(input, BTN_TOUCH, wacom_intuos_tip(t));
 		break;
 
 	case 0x0a:
@@ -926,7 +1067,7 @@ static int wacom_intuos_general(struct wacom_wac *wacom)
 
 	case 0x05:
 		/* Rotation packet */
-		if (features->type >= INTUOS3S) {
+		if (!(features->caps & WACOM_CAP_PRE_INTUOS3)) {
 			/* I3 marker pen rotation */
 			t = (data[6] << 3) | ((data[7] >> 5) & 7);
 			t = (data[7] & 0x20) ? ((t > 900) ? ((t-1) / 2 - 1350) :
@@ -977,7 +1118,7 @@ static int wacom_intuos_general(struct wacom_wac *wacom)
 					 - ((data[8] & 0x02) >> 1));
 
 			/* I3 2D mouse side buttons */
-			if (features->type >= INTUOS3S && features->type <= INTUOS3L) {
+			if (features->caps & WACOM_CAP_MOUSE_SIDE_BUTTONS) {
 				input_report_key(input, BTN_SIDE,   data[8] & 0x40);
 				input_report_key(input, BTN_EXTRA,  data[8] & 0x20);
 			}
@@ -1011,43 +1152,43 @@ static int wacom_intuos_general(struct wacom_wac *wacom)
 	return 2;
 }
 
-static int wacom_intuos_irq(struct wacom_wac *wacom)
+/* One Intuos protocol pen packet */
+static int wacom_intuos_pen_packet(struct wacom_wac *wacom,
+				   const unsigned char *data)
 {
-	unsigned char *data = wacom->data;
-	struct input_dev *input = wacom->pen_input;
 	int result;
 
-	if (data[0] != WACOM_REPORT_PENABLED &&
-	    data[0] != WACOM_REPORT_INTUOS_ID1 &&
-	    data[0] != WACOM_REPORT_INTUOS_ID2 &&
-	    data[0] != WACOM_REPORT_INTUOSPAD &&
-	    data[0] != WACOM_REPORT_INTUOS_PEN &&
-	    data[0] != WACOM_REPORT_CINTIQ &&
-	    data[0] != WACOM_REPORT_CINTIQPAD &&
-	    data[0] != WACOM_REPORT_INTUOS5PAD) {
-		dev_dbg(input->dev.parent,
-			"%s: received unknown report #%d\n", __func__, data[0]);
-                return 0;
-	}
-
-	/* process pad events */
-	result = wacom_intuos_pad(wacom);
-	if (result)
-		return result;
-
 	/* process in/out prox events */
-	result = wacom_intuos_inout(wacom);
+	result = wacom_intuos_inout(wacom, data);
 	if (result)
 		return result - 1;
 
 	/* process general packets */
-	result = wacom_intuos_general(wacom);
+	result = wacom_intuos_general(wacom, data);
 	if (result)
 		return result - 1;
 
 	return 0;
 }
 
+static int wacom_intuos_pen_irq(struct wacom_wac *wacom, size_t len)
+{
+	int result = wacom_intuos_pen_packet(wacom, wacom->data);
+
+	if (result)
+		wacom->frame_data |= WACOM_DEVICETYPE_PEN;
+	return result;
+}
+
+static int wacom_intuos_pad_irq(struct wacom_wac *wacom, size_t len)
+{
+	int result = wacom_intuos_pad(wacom, wacom->data);
+
+	if (result)
+		wacom->frame_data |= WACOM_DEVICETYPE_PAD;
+	return result;
+}
+
 static int wacom_remote_irq(struct wacom_wac *wacom_wac, size_t len)
 {
 	unsigned char *data = wacom_wac->data;
@@ -1118,7 +1259,7 @@ static int wacom_remote_irq(struct wacom_wac *wacom_wac, size_t len)
 
 	input_event(input, EV_MSC, MSC_SERIAL, serial);
 
-	input_sync(input);
+	wacom_input_sync(wacom_wac, input);
 
 	/*Which mode select (LED light) is currently on?*/
 	touch_ring_mode = (data[11] & 0xC0) >> 6;
@@ -1182,50 +1323,69 @@ static int int_dist(int x1, int y1, int x2, int y2)
 	return int_sqrt(x*x + y*y);
 }
 
-static void wacom_intuos_bt_process_data(struct wacom_wac *wacom,
-		unsigned char *data)
+/*
+ * The key state a plain pen packet reports, or -1 for any other packet
+ * (prox, pad, mouse, airbrush). Only pen packets can be coalesced.
+ */
+static int wacom_intuos_bt_pen_state(struct wacom_wac *wacom,
+				     const unsigned char *data)
 {
-	memcpy(wacom->data, data, 10);
-	wacom_intuos_irq(wacom);
+	unsigned int t;
 
-	input_sync(wacom->pen_input);
-	if (wacom->pad_input)
-		input_sync(wacom->pad_input);
+	if (data[0] != WACOM_REPORT_PENABLED || !wacom_intuos_is_pen_packet(data))
+		return -1;
+
+	t = wacom_intuos_pressure(&wacom->features, data);
+
+	return (data[1] & 0xfe) | wacom_intuos_tip(t);
 }
 
-static int wacom_intuos_bt_irq(struct wacom_wac *wacom, size_t len)
+/*
+ * Each report carries two or three 10 byte Intuos packets, decoded where
+ * they lie, followed by the battery state. In WACOM_PEN_FRAMES_COALESCE
+ * mode a pen packet is skipped when the next one reports the same buttons
+ * and tip state, so only the newest position of such a run is reported
+ * and transitions keep their frames.
+ */
+static int wacom_intuos_bt_pen_irq(struct wacom_wac *wacom, size_t len)
 {
-	unsigned char data[WACOM_PKGLEN_MAX];
-	int i = 1;
+	const unsigned char *data = wacom->data;
+	struct input_dev *pen_input = wacom->pen_input;
+	int frames = data[0] == 0x04 ? 3 : 2;
+	int i;
 	unsigned power_raw, battery_capacity, bat_charging, ps_connected;
 
-	memcpy(data, wacom->data, len);
+	for (i = 0; i < frames; i++) {
+		const unsigned char *frame = &data[1 + i * 10];
 
-	switch (data[0]) {
-	case 0x04:
-		wacom_intuos_bt_process_data(wacom, data + i);
-		i += 10;
-		/* fall through */
-	case 0x03:
-		wacom_intuos_bt_process_data(wacom, data + i);
-		i += 10;
-		wacom_intuos_bt_process_data(wacom, data + i);
-		i += 10;
-		power_raw = data[i];
-		bat_charging = (power_raw & 0x08) ? 1 : 0;
-		ps_connected = (power_raw & 0x10) ? 1 : 0;
-		battery_capacity = batcap_i4[power_raw & 0x07];
-		wacom_notify_battery(wacom, WACOM_POWER_SUPPLY_STATUS_AUTO,
-				     battery_capacity, bat_charging,
-				     battery_capacity || bat_charging,
-				     ps_connected);
-		break;
-	default:
-		dev_dbg(wacom->pen_input->dev.parent,
-				"Unknown report: %d,%d size:%zu\n",
-				data[0], data[1], len);
-		return 0;
+		if (wacom->pen_frames == WACOM_PEN_FRAMES_COALESCE &&
+		    i < frames - 1) {
+			int state = wacom_intuos_bt_pen_state(wacom, frame);
+
+			if (state >= 0 &&
+			    state == wacom_intuos_bt_pen_state(wacom, frame + 10))
+				continue;
+		}
+
+		wacom_frame_time(wacom, i, frames,
+				 WACOM_INTUOS4WL_BT_PEN_FRAME_NS);
+		if (wacom_intuos_pad(wacom, frame)) {
+			if (wacom->pad_input)
+				wacom_input_sync(wacom, wacom->pad_input);
+		} else if (wacom_intuos_pen_packet(wacom, frame)) {
+			wacom_input_sync(wacom, pen_input);
+		}
 	}
+
+	power_raw = data[1 + frames * 10];
+	bat_charging = (power_raw & 0x08) ? 1 : 0;
+	ps_connected = (power_raw & 0x10) ? 1 : 0;
+	battery_capacity = batcap_i4[power_raw & 0x07];
+	wacom_notify_battery(wacom, WACOM_POWER_SUPPLY_STATUS_AUTO,
+			     battery_capacity, bat_charging,
+			     battery_capacity || bat_charging,
+			     ps_connected);
+
 	return 0;
 }
 
@@ -1233,8 +1393,6 @@ static int wacom_wac_finger_count_touches(struct wacom_wac *wacom)
 {
 	struct input_dev *input = wacom->touch_input;
 	unsigned touch_max = wacom->features.touch_max;
-	int count = 0;
-	int i;
 
 	if (!touch_max)
 		return 0;
@@ -1243,35 +1401,170 @@ static int wacom_wac_finger_count_touches(struct wacom_wac *wacom)
 		return test_bit(BTN_TOUCH, input->key) &&
 			report_touch_events(wacom);
 
-	for (i = 0; i < input->mt->num_slots; i++) {
-		struct input_mt_slot *ps = &input->mt->slots[i];
-		int id = input_mt_get_value(ps, ABS_MT_TRACKING_ID);
-		if (id >= 0)
-			count++;
+	return wacom->shared->touch_contacts;
+}
+
+static u8 *wacom_mt_keys_find(struct wacom_mt_keys *keys, int key,
+			      bool insert)
+{
+	unsigned int i, h;
+
+	if (key >= 0 && key < WACOM_MT_KEYS_DIRECT)
+		return &keys->direct[key];
+
+	h = hash_32(key, WACOM_MT_KEYS_HASH_BITS);
+	for (i = 0; i < WACOM_MT_KEYS_PROBES; i++) {
+		unsigned int n = (h + i) & (ARRAY_SIZE(keys->hashed) - 1);
+
+		if (keys->hashed[n].slot && keys->hashed[n].key == key)
+			return &keys->hashed[n].slot;
+		if (insert && !keys->hashed[n].slot) {
+			keys->hashed[n].key = key;
+			return &keys->hashed[n].slot;
+		}
+	}
+
+	if (!insert)
+		return NULL;
+
+	/* full run, evict the home entry; it is only a hint */
+	keys->hashed[h].key = key;
+	return &keys->hashed[h].slot;
+}
+
+/*
+ * input_mt_get_slot_by_key() through wacom->mt_keys. At most one active
+ * slot carries a given key, so a cached slot that is still active with
+ * the key is the one the scan would find.
+ */
+static int wacom_mt_get_slot_by_key(struct wacom_wac *wacom,
+				    struct input_dev *input, int key)
+{
+	struct input_mt *mt = input->mt;
+	u8 *entry;
+	int slot;
+
+	if (!mt)
+		return -1;
+
+	entry = wacom_mt_keys_find(&wacom->mt_keys, key, false);
+	if (entry && *entry && *entry <= mt->num_slots) {
+		struct input_mt_slot *s = &mt->slots[*entry - 1];
+
+		if (input_mt_is_active(s) && s->key == (unsigned int)key)
+			return *entry - 1;
+	}
+
+	slot = input_mt_get_slot_by_key(input, key);
+	if (slot >= 0 && slot < U8_MAX) {
+		entry = wacom_mt_keys_find(&wacom->mt_keys, key, true);
+		*entry = slot + 1;
 	}
 
-	return count;
+	return slot;
+}
+
+static void wacom_mt_keys_drop(struct wacom_wac *wacom, int key, int slot)
+{
+	u8 *entry = wacom_mt_keys_find(&wacom->mt_keys, key, false);
+
+	if (entry && *entry == slot + 1)
+		*entry = 0;
 }
 
+/*
+ * input_mt_report_slot_state() for the current slot of the touch device,
+ * keeping shared->touch_contacts in step with the slots that hold a contact
+ * so that nobody has to scan them.
+ */
+static void wacom_mt_report_slot_state(struct wacom_wac *wacom,
+				       struct input_dev *input, bool active)
+{
+	struct input_mt_slot *ps;
+	bool was_active;
+
+	if (!input->mt)
+		return;
+
+	ps = &input->mt->slots[input->mt->slot];
+	was_active = input_mt_get_value(ps, ABS_MT_TRACKING_ID) >= 0;
+
+	input_mt_report_slot_state(input, MT_TOOL_FINGER, active);
+
+	active = input_mt_get_value(ps, ABS_MT_TRACKING_ID) >= 0;
+	if (active && !was_active) {
+		wacom->shared->touch_contacts++;
+	} else if (!active && was_active) {
+		wacom->shared->touch_contacts--;
+		wacom_mt_keys_drop(wacom, ps->key, input->mt->slot);
+	}
+}
+
+/*
+ * A touch frame of the 24HDT, 27QHDT, MTTPC and HID_GENERIC panels may
+ * span several reports. Only the last one is synced, so the input core
+ * holds the slot updates of the earlier ones and userspace sees the whole
+ * frame at once.
+ */
+static void wacom_touch_frame_end(struct wacom_wac *wacom)
+{
+	wacom->touch_frame_open = false;
+	if (wacom->features.touch_max > 1)
+		input_mt_sync_frame(wacom->touch_input);
+
+	/* keep touch state for pen event */
+	wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
+	wacom->frame_data |= WACOM_DEVICETYPE_TOUCH;
+}
+
+/*
+ * Syncs a frame whose remaining reports are late or lost: when the next
+ * frame starts, or from wacom_sys.c's touch_frame_timer. A late tail is
+ * still decoded, as a frame of its own.
+ */
+void wacom_wac_touch_frame_flush(struct wacom_wac *wacom)
+{
+	if (!wacom->touch_frame_open || !wacom->touch_input)
+		return;
+
+	wacom_stats_inc(container_of(wacom, struct wacom, wacom_wac),
+			touch_frames_partial);
+	wacom_touch_frame_end(wacom);
+	wacom_input_sync(wacom, wacom->touch_input);
+}
+
+/*
+ * Unless pen_frames is WACOM_PEN_FRAMES_EACH, a frame is only reported
+ * when it is the first or the last of a run of frames with the same pen
+ * state (proximity, range, eraser and buttons), so every transition keeps
+ * the frame it happened in and the newest frame of a report always goes
+ * out. The frames in between are skipped; SUMMARY gives the frame that
+ * is reported their highest pressure.
+ */
+#define WACOM_PRO2_BT_PEN_STATE	0x7f
+
 static void wacom_intuos_pro2_bt_pen(struct wacom_wac *wacom)
 {
 	int pen_frame_len, pen_frames;
+	unsigned int pen_frame_ns;
 
 	struct input_dev *pen_input = wacom->pen_input;
 	unsigned char *data = wacom->data;
-	int i;
+	int pressure_max = 0;
+	int i, next;
 
-	if (wacom->features.type == INTUOSP2_BT ||
-	    wacom->features.type == INTUOSP2S_BT) {
+	if (wacom->features.caps & WACOM_CAP_PRO2_FRAMES) {
 		wacom->serial[0] = get_unaligned_le64(&data[99]);
 		wacom->id[0]     = get_unaligned_le16(&data[107]);
 		pen_frame_len = 14;
 		pen_frames = 7;
+		pen_frame_ns = WACOM_PRO2_BT_PEN_FRAME_NS;
 	} else {
 		wacom->serial[0] = get_unaligned_le64(&data[33]);
 		wacom->id[0]     = get_unaligned_le16(&data[41]);
 		pen_frame_len = 8;
 		pen_frames = 4;
+		pen_frame_ns = WACOM_GEN3_BT_PEN_FRAME_NS;
 	}
 
 	if (wacom->serial[0] >> 52 == 1) {
@@ -1285,14 +1578,37 @@ static void wacom_intuos_pro2_bt_pen(struct wacom_wac *wacom)
 		bool prox = frame[0] & 0x40;
 		bool range = frame[0] & 0x20;
 		bool invert = frame[0] & 0x10;
+		u8 state = frame[0] & WACOM_PRO2_BT_PEN_STATE;
+		int pressure = get_unaligned_le16(&frame[5]);
+		bool sync;
 
 		if (!valid)
 			continue;
 
+		for (next = i + 1; next < pen_frames; next++)
+			if (data[next*pen_frame_len + 1] & 0x80)
+				break;
+
+		sync = wacom->pen_frames == WACOM_PEN_FRAMES_EACH ||
+		       state != wacom->pen_frame_state || next == pen_frames ||
+		       state != (data[next*pen_frame_len + 1] & WACOM_PRO2_BT_PEN_STATE);
+		wacom->pen_frame_state = state;
+
+		if (!sync) {
+			pressure_max = max(pressure_max, pressure);
+			continue;
+		}
+		if (wacom->pen_frames == WACOM_PEN_FRAMES_SUMMARY) {
+			pressure = max(pressure, pressure_max);
+			pressure_max = 0;
+		}
+
+		wacom_frame_time(wacom, i, pen_frames, pen_frame_ns);
+
 		if (!prox) {
 			wacom->shared->stylus_in_proximity = false;
-			wacom_exit_report(wacom);
-			input_sync(pen_input);
+			wacom_exit_report(wacom, wacom->data);
+			wacom_input_sync(wacom, pen_input);
 
 			wacom->tool[0] = 0;
 			wacom->id[0] = 0;
@@ -1314,8 +1630,7 @@ static void wacom_intuos_pro2_bt_pen(struct wacom_wac *wacom)
 			input_report_abs(pen_input, ABS_X, get_unaligned_le16(&frame[1]));
 			input_report_abs(pen_input, ABS_Y, get_unaligned_le16(&frame[3]));
 
-			if (wacom->features.type == INTUOSP2_BT ||
-			    wacom->features.type == INTUOSP2S_BT) {
+			if (wacom->features.caps & WACOM_CAP_PRO2_FRAMES) {
 				/* Fix rotation alignment: userspace expects zero at left */
 				int16_t rotation =
 					(int16_t)get_unaligned_le16(&frame[9]);
@@ -1335,9 +1650,8 @@ static void wacom_intuos_pro2_bt_pen(struct wacom_wac *wacom)
 		}
 
 		if (wacom->tool[0]) {
-			input_report_abs(pen_input, ABS_PRESSURE, get_unaligned_le16(&frame[5]));
-			if (wacom->features.type == INTUOSP2_BT ||
-			    wacom->features.type == INTUOSP2S_BT) {
+			input_report_abs(pen_input, ABS_PRESSURE, pressure);
+			if (wacom->features.caps & WACOM_CAP_PRO2_FRAMES) {
 				input_report_abs(pen_input, ABS_DISTANCE,
 						 range ? frame[13] : wacom->features.distance_max);
 			} else {
@@ -1357,7 +1671,7 @@ static void wacom_intuos_pro2_bt_pen(struct wacom_wac *wacom)
 
 		wacom->shared->stylus_in_proximity = prox;
 
-		input_sync(pen_input);
+		wacom_input_sync(wacom, pen_input);
 	}
 }
 
@@ -1391,7 +1705,7 @@ static void wacom_intuos_pro2_bt_touch(struct wacom_wac *wacom)
 
 		for (j = 0; j < contacts_to_send; j++) {
 			unsigned char *touch = &frame[j*finger_touch_len + 1];
-			int slot = input_mt_get_slot_by_key(touch_input, touch[0]);
+			int slot = wacom_mt_get_slot_by_key(wacom, touch_input, touch[0]);
 			int x = get_unaligned_le16(&touch[2]);
 			int y = get_unaligned_le16(&touch[4]);
 			int w = touch[6] * input_abs_get_res(touch_input, ABS_MT_POSITION_X);
@@ -1401,7 +1715,7 @@ static void wacom_intuos_pro2_bt_touch(struct wacom_wac *wacom)
 				continue;
 
 			input_mt_slot(touch_input, slot);
-			input_mt_report_slot_state(touch_input, MT_TOOL_FINGER, touch[1] & 0x01);
+			wacom_mt_report_slot_state(wacom, touch_input, touch[1] & 0x01);
 			input_report_abs(touch_input, ABS_MT_POSITION_X, x);
 			input_report_abs(touch_input, ABS_MT_POSITION_Y, y);
 			input_report_abs(touch_input, ABS_MT_TOUCH_MAJOR, max(w, h));
@@ -1415,7 +1729,9 @@ static void wacom_intuos_pro2_bt_touch(struct wacom_wac *wacom)
 		if (wacom->num_contacts_left <= 0) {
 			wacom->num_contacts_left = 0;
 			wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
-			input_sync(touch_input);
+			wacom_frame_time(wacom, i, finger_frames,
+					 WACOM_PRO2_BT_TOUCH_FRAME_NS);
+			wacom_input_sync(wacom, touch_input);
 		}
 	}
 
@@ -1423,7 +1739,7 @@ static void wacom_intuos_pro2_bt_touch(struct wacom_wac *wacom)
 		// Be careful that we don't accidentally call input_sync with
 		// only a partial set of fingers of processed
 		input_report_switch(touch_input, SW_MUTE_DEVICE, !(data[281] >> 7));
-		input_sync(touch_input);
+		__wacom_input_sync(wacom, touch_input, false);
 	}
 
 }
@@ -1455,7 +1771,9 @@ static void wacom_intuos_pro2_bt_pad(struct wacom_wac *wacom)
 	input_report_abs(pad_input, ABS_MISC, prox ? PAD_DEVICE_ID : 0);
 	input_event(pad_input, EV_MSC, MSC_SERIAL, 0xffffffff);
 
-	input_sync(pad_input);
+	__wacom_input_sync(wacom, pad_input,
+			   wacom_pad_changed(wacom, expresskeys |
+					     center << 8 | data[285] << 16));
 }
 
 static void wacom_intuos_pro2_bt_battery(struct wacom_wac *wacom)
@@ -1482,7 +1800,7 @@ static void wacom_intuos_gen3_bt_pad(struct wacom_wac *wacom)
 	input_report_abs(pad_input, ABS_MISC, buttons ? PAD_DEVICE_ID : 0);
 	input_event(pad_input, EV_MSC, MSC_SERIAL, 0xffffffff);
 
-	input_sync(pad_input);
+	__wacom_input_sync(wacom, pad_input, wacom_pad_changed(wacom, buttons));
 }
 
 static void wacom_intuos_gen3_bt_battery(struct wacom_wac *wacom)
@@ -1507,19 +1825,22 @@ static int wacom_intuos_pro2_bt_irq(struct wacom_wac *wacom, size_t len)
 	}
 
 	wacom_intuos_pro2_bt_pen(wacom);
-	if (wacom->features.type == INTUOSP2_BT ||
-	    wacom->features.type == INTUOSP2S_BT) {
+
+	/* touch stamps its own frames, the pad is current */
+	if (wacom->features.caps & WACOM_CAP_PRO2_FRAMES) {
 		wacom_intuos_pro2_bt_touch(wacom);
+		wacom_frame_time(wacom, 0, 1, 0);
 		wacom_intuos_pro2_bt_pad(wacom);
 		wacom_intuos_pro2_bt_battery(wacom);
 	} else {
+		wacom_frame_time(wacom, 0, 1, 0);
 		wacom_intuos_gen3_bt_pad(wacom);
 		wacom_intuos_gen3_bt_battery(wacom);
 	}
 	return 0;
 }
 
-static int wacom_24hdt_irq(struct wacom_wac *wacom)
+static int wacom_24hdt_irq(struct wacom_wac *wacom, size_t len)
 {
 	struct input_dev *input = wacom->touch_input;
 	unsigned char *data = wacom->data;
@@ -1536,7 +1857,7 @@ static int wacom_24hdt_irq(struct wacom_wac *wacom)
 			return 0;
 	}
 
-	if (wacom->features.type == WACOM_27QHDT) {
+	if (wacom->features.caps & WACOM_CAP_QHDT_LAYOUT) {
 		current_num_contacts = data[63];
 		num_contacts_left = 10;
 		byte_per_packet = WACOM_BYTES_PER_QHDTHID_PACKET;
@@ -1547,20 +1868,22 @@ static int wacom_24hdt_irq(struct wacom_wac *wacom)
 	 * First packet resets the counter since only the first
 	 * packet in series will have non-zero current_num_contacts.
 	 */
-	if (current_num_contacts)
+	if (current_num_contacts) {
+		wacom_wac_touch_frame_flush(wacom);
 		wacom->num_contacts_left = current_num_contacts;
+	}
 
 	contacts_to_send = min(num_contacts_left, wacom->num_contacts_left);
 
 	for (i = 0; i < contacts_to_send; i++) {
 		int offset = (byte_per_packet * i) + 1;
 		bool touch = (data[offset] & 0x1) && report_touch_events(wacom);
-		int slot = input_mt_get_slot_by_key(input, data[offset + 1]);
+		int slot = wacom_mt_get_slot_by_key(wacom, input, data[offset + 1]);
 
 		if (slot < 0)
 			continue;
 		input_mt_slot(input, slot);
-		input_mt_report_slot_state(input, MT_TOOL_FINGER, touch);
+		wacom_mt_report_slot_state(wacom, input, touch);
 
 		if (touch) {
 			int t_x = get_unaligned_le16(&data[offset + 2]);
@@ -1569,7 +1892,7 @@ static int wacom_24hdt_irq(struct wacom_wac *wacom)
 			input_report_abs(input, ABS_MT_POSITION_X, t_x);
 			input_report_abs(input, ABS_MT_POSITION_Y, t_y);
 
-			if (wacom->features.type != WACOM_27QHDT) {
+			if (!(wacom->features.caps & WACOM_CAP_QHDT_LAYOUT)) {
 				int c_x = get_unaligned_le16(&data[offset + 4]);
 				int c_y = get_unaligned_le16(&data[offset + 8]);
 				int w = get_unaligned_le16(&data[offset + 10]);
@@ -1583,13 +1906,16 @@ static int wacom_24hdt_irq(struct wacom_wac *wacom)
 			}
 		}
 	}
-	input_mt_sync_frame(input);
 
 	wacom->num_contacts_left -= contacts_to_send;
-	if (wacom->num_contacts_left <= 0) {
-		wacom->num_contacts_left = 0;
-		wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
+	if (wacom->num_contacts_left > 0) {
+		/* the rest of the frame is in the next report */
+		wacom->touch_frame_open = true;
+		return 0;
 	}
+
+	wacom->num_contacts_left = 0;
+	wacom_touch_frame_end(wacom);
 	return 1;
 }
 
@@ -1603,15 +1929,17 @@ static int wacom_mt_touch(struct wacom_wac *wacom)
 	int x_offset = 0;
 
 	/* MTTPC does not support Height and Width */
-	if (wacom->features.type == MTTPC || wacom->features.type == MTTPC_B)
+	if (wacom->features.caps & WACOM_CAP_MT_NO_SIZE)
 		x_offset = -4;
 
 	/*
 	 * First packet resets the counter since only the first
 	 * packet in series will have non-zero current_num_contacts.
 	 */
-	if (current_num_contacts)
+	if (current_num_contacts) {
+		wacom_wac_touch_frame_flush(wacom);
 		wacom->num_contacts_left = current_num_contacts;
+	}
 
 	/* There are at most 5 contacts per packet */
 	contacts_to_send = min(5, wacom->num_contacts_left);
@@ -1620,13 +1948,13 @@ static int wacom_mt_touch(struct wacom_wac *wacom)
 		int offset = (WACOM_BYTES_PER_MT_PACKET + x_offset) * i + 3;
 		bool touch = (data[offset] & 0x1) && report_touch_events(wacom);
 		int id = get_unaligned_le16(&data[offset + 1]);
-		int slot = input_mt_get_slot_by_key(input, id);
+		int slot = wacom_mt_get_slot_by_key(wacom, input, id);
 
 		if (slot < 0)
 			continue;
 
 		input_mt_slot(input, slot);
-		input_mt_report_slot_state(input, MT_TOOL_FINGER, touch);
+		wacom_mt_report_slot_state(wacom, input, touch);
 		if (touch) {
 			int x = get_unaligned_le16(&data[offset + x_offset + 7]);
 			int y = get_unaligned_le16(&data[offset + x_offset + 9]);
@@ -1634,13 +1962,16 @@ static int wacom_mt_touch(struct wacom_wac *wacom)
 			input_report_abs(input, ABS_MT_POSITION_Y, y);
 		}
 	}
-	input_mt_sync_frame(input);
 
 	wacom->num_contacts_left -= contacts_to_send;
-	if (wacom->num_contacts_left <= 0) {
-		wacom->num_contacts_left = 0;
-		wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
+	if (wacom->num_contacts_left > 0) {
+		/* the rest of the frame is in the next report */
+		wacom->touch_frame_open = true;
+		return 0;
 	}
+
+	wacom->num_contacts_left = 0;
+	wacom_touch_frame_end(wacom);
 	return 1;
 }
 
@@ -1655,7 +1986,7 @@ static int wacom_tpc_mt_touch(struct wacom_wac *wacom)
 		bool touch = p && report_touch_events(wacom);
 
 		input_mt_slot(input, i);
-		input_mt_report_slot_state(input, MT_TOOL_FINGER, touch);
+		wacom_mt_report_slot_state(wacom, input, touch);
 		if (touch) {
 			int x = le16_to_cpup((__le16 *)&data[i * 2 + 2]) & 0x7fff;
 			int y = le16_to_cpup((__le16 *)&data[i * 2 + 6]) & 0x7fff;
@@ -1669,6 +2000,7 @@ static int wacom_tpc_mt_touch(struct wacom_wac *wacom)
 	/* keep touch state for pen event */
 	wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
 
+	wacom->frame_data |= WACOM_DEVICETYPE_TOUCH;
 	return 1;
 }
 
@@ -1705,6 +2037,7 @@ static int wacom_tpc_single_touch(struct wacom_wac *wacom, size_t len)
 	/* keep touch state for pen events */
 	wacom->shared->touch_down = prox;
 
+	wacom->frame_data |= WACOM_DEVICETYPE_TOUCH;
 	return 1;
 }
 
@@ -1732,6 +2065,7 @@ static int wacom_tpc_pen(struct wacom_wac *wacom)
 		input_report_abs(input, ABS_PRESSURE, ((data[7] & 0x07) << 8) | data[6]);
 		input_report_key(input, BTN_TOUCH, data[1] & 0x05);
 		input_report_key(input, wacom->tool[0], prox);
+		wacom->frame_data |= WACOM_DEVICETYPE_PEN;
 		return 1;
 	}
 
@@ -1908,11 +2242,10 @@ static void wacom_wac_battery_usage_mapping(struct hid_device *hdev,
 }
 
 static void wacom_wac_battery_event(struct hid_device *hdev, struct hid_field *field,
-		struct hid_usage *usage, __s32 value)
+		struct hid_usage *usage, unsigned equivalent_usage, __s32 value)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
-	unsigned equivalent_usage = wacom_equivalent_usage(usage->hid);
 
 	switch (equivalent_usage) {
 	case HID_DG_BATTERYSTRENGTH:
@@ -2074,13 +2407,12 @@ static void wacom_wac_pad_usage_mapping(struct hid_device *hdev,
 }
 
 static void wacom_wac_pad_event(struct hid_device *hdev, struct hid_field *field,
-		struct hid_usage *usage, __s32 value)
+		struct hid_usage *usage, unsigned equivalent_usage, __s32 value)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct input_dev *input = wacom_wac->pad_input;
 	struct wacom_features *features = &wacom_wac->features;
-	unsigned equivalent_usage = wacom_equivalent_usage(usage->hid);
 	int i;
 	bool do_report = false;
 
@@ -2143,7 +2475,8 @@ static void wacom_wac_pad_event(struct hid_device *hdev, struct hid_field *field
 
 			input_report_switch(wacom_wac->shared->touch_input,
 					    SW_MUTE_DEVICE, !(*is_touch_on));
-			input_sync(wacom_wac->shared->touch_input);
+			__wacom_input_sync(wacom_wac, wacom_wac->shared->touch_input,
+					   false);
 		}
 		break;
 
@@ -2191,7 +2524,7 @@ static void wacom_wac_pad_report(struct hid_device *hdev,
 	/* report prox for expresskey events */
 	if (wacom_wac->hid_data.pad_input_event_flag) {
 		input_event(input, EV_ABS, ABS_MISC, active ? PAD_DEVICE_ID : 0);
-		input_sync(input);
+		wacom_input_sync(wacom_wac, input);
 		if (!active)
 			wacom_wac->hid_data.pad_input_event_flag = false;
 	}
@@ -2277,13 +2610,12 @@ static void wacom_wac_pen_usage_mapping(struct hid_device *hdev,
 }
 
 static void wacom_wac_pen_event(struct hid_device *hdev, struct hid_field *field,
-		struct hid_usage *usage, __s32 value)
+		struct hid_usage *usage, unsigned equivalent_usage, __s32 value)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct wacom_features *features = &wacom_wac->features;
 	struct input_dev *input = wacom_wac->pen_input;
-	unsigned equivalent_usage = wacom_equivalent_usage(usage->hid);
 
 	if (wacom_wac->is_invalid_bt_frame)
 		return;
@@ -2315,6 +2647,9 @@ static void wacom_wac_pen_event(struct hid_device *hdev, struct hid_field *field
 	case HID_DG_BARRELSWITCH2:
 		wacom_wac->hid_data.barrelswitch2 = value;
 		return;
+	case HID_DG_SCANTIME:
+		wacom_scan_time(wacom_wac, field, value);
+		return;
 	case HID_DG_TOOLSERIALNUMBER:
 		if (value) {
 			wacom_wac->serial[0] = (wacom_wac->serial[0] & ~0xFFFFFFFFULL);
@@ -2388,6 +2723,8 @@ static void wacom_wac_pen_event(struct hid_device *hdev, struct hid_field *field
 		return;
 	case WACOM_HID_WD_REPORT_VALID:
 		wacom_wac->is_invalid_bt_frame = !value;
+		if (!value)
+			wacom_stats_inc(wacom, invalid_bt_frames);
 		return;
 	}
 
@@ -2470,7 +2807,7 @@ static void wacom_wac_pen_report(struct hid_device *hdev,
 
 		wacom_wac->hid_data.tipswitch = false;
 
-		input_sync(input);
+		wacom_input_sync(wacom_wac, input);
 	}
 
 	if (!sense) {
@@ -2547,15 +2884,18 @@ static void wacom_wac_finger_slot(struct wacom_wac *wacom_wac,
 	}
 
 	wacom_wac->hid_data.num_received++;
-	if (wacom_wac->hid_data.num_received > wacom_wac->hid_data.num_expected)
+	if (wacom_wac->hid_data.num_received > wacom_wac->hid_data.num_expected) {
+		wacom_stats_inc(container_of(wacom_wac, struct wacom, wacom_wac),
+				finger_overruns);
 		return;
+	}
 
 	if (mt) {
 		int slot;
 
-		slot = input_mt_get_slot_by_key(input, hid_data->id);
+		slot = wacom_mt_get_slot_by_key(wacom_wac, input, hid_data->id);
 		input_mt_slot(input, slot);
-		input_mt_report_slot_state(input, MT_TOOL_FINGER, prox);
+		wacom_mt_report_slot_state(wacom_wac, input, prox);
 	}
 	else {
 		input_report_key(input, BTN_TOUCH, prox);
@@ -2577,11 +2917,11 @@ static void wacom_wac_finger_slot(struct wacom_wac *wacom_wac,
 }
 
 static void wacom_wac_finger_event(struct hid_device *hdev,
-		struct hid_field *field, struct hid_usage *usage, __s32 value)
+		struct hid_field *field, struct hid_usage *usage,
+		unsigned equivalent_usage, __s32 value)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
-	unsigned equivalent_usage = wacom_equivalent_usage(usage->hid);
 	struct wacom_features *features = &wacom->wacom_wac.features;
 
 	if (wacom_wac->is_invalid_bt_frame)
@@ -2608,10 +2948,15 @@ static void wacom_wac_finger_event(struct hid_device *hdev,
 		break;
 	case WACOM_HID_WT_REPORT_VALID:
 		wacom_wac->is_invalid_bt_frame = !value;
+		if (!value)
+			wacom_stats_inc(wacom, invalid_bt_frames);
 		return;
 	case HID_DG_CONTACTMAX:
 		features->touch_max = value;
 		return;
+	case HID_DG_SCANTIME:
+		wacom_scan_time(wacom_wac, field, value);
+		return;
 	}
 
 	if (usage->usage_index + 1 == field->report_count) {
@@ -2621,50 +2966,33 @@ static void wacom_wac_finger_event(struct hid_device *hdev,
 }
 
 static void wacom_wac_finger_pre_report(struct hid_device *hdev,
-		struct hid_report *report)
+		struct hid_report *report, const struct wacom_report_plan *plan)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct hid_data* hid_data = &wacom_wac->hid_data;
-	int i;
 
 	wacom_wac->is_invalid_bt_frame = false;
 
-	for (i = 0; i < report->maxfield; i++) {
-		struct hid_field *field = report->field[i];
-		int j;
-
-		for (j = 0; j < field->maxusage; j++) {
-			struct hid_usage *usage = &field->usage[j];
-			unsigned int equivalent_usage =
-				wacom_equivalent_usage(usage->hid);
+	/* the report's layout was recorded when its plan was built */
+	if (plan->last_slot_field)
+		hid_data->last_slot_field = plan->last_slot_field;
 
-			switch (equivalent_usage) {
-			case HID_GD_X:
-			case HID_GD_Y:
-			case HID_DG_WIDTH:
-			case HID_DG_HEIGHT:
-			case HID_DG_CONTACTID:
-			case HID_DG_INRANGE:
-			case HID_DG_INVERT:
-			case HID_DG_TIPSWITCH:
-				hid_data->last_slot_field = equivalent_usage;
-				break;
-			case HID_DG_CONTACTCOUNT:
-				hid_data->cc_report = report->id;
-				hid_data->cc_index = i;
-				hid_data->cc_value_index = j;
-				break;
-			}
-		}
+	if (plan->cc_index >= 0) {
+		hid_data->cc_report = report->id;
+		hid_data->cc_index = plan->cc_index;
+		hid_data->cc_value_index = plan->cc_value_index;
 	}
 
 	if (hid_data->cc_report != 0 &&
 	    hid_data->cc_index >= 0) {
 		struct hid_field *field = report->field[hid_data->cc_index];
 		int value = field->value[hid_data->cc_value_index];
-		if (value)
+		if (value) {
+			wacom_wac_touch_frame_flush(wacom_wac);
 			hid_data->num_expected = value;
+			hid_data->num_received = 0;
+		}
 	}
 	else {
 		hid_data->num_expected = wacom_wac->features.touch_max;
@@ -2677,23 +3005,20 @@ static void wacom_wac_finger_report(struct hid_device *hdev,
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct input_dev *input = wacom_wac->touch_input;
-	unsigned touch_max = wacom_wac->features.touch_max;
 
 	/* If more packets of data are expected, give us a chance to
 	 * process them rather than immediately syncing a partial
 	 * update.
 	 */
-	if (wacom_wac->hid_data.num_received < wacom_wac->hid_data.num_expected)
+	if (wacom_wac->hid_data.num_received < wacom_wac->hid_data.num_expected) {
+		if (wacom_wac->hid_data.num_received)
+			wacom_wac->touch_frame_open = true;
 		return;
+	}
 
-	if (touch_max > 1)
-		input_mt_sync_frame(input);
-
-	input_sync(input);
 	wacom_wac->hid_data.num_received = 0;
-
-	/* keep touch state for pen event */
-	wacom_wac->shared->touch_down = wacom_wac_finger_count_touches(wacom_wac);
+	wacom_touch_frame_end(wacom_wac);
+	wacom_input_sync(wacom_wac, input);
 }
 
 void wacom_wac_usage_mapping(struct hid_device *hdev,
@@ -2717,36 +3042,227 @@ void wacom_wac_usage_mapping(struct hid_device *hdev,
 		wacom_wac_finger_usage_mapping(hdev, field, usage);
 }
 
-void wacom_wac_event(struct hid_device *hdev, struct hid_field *field,
-		struct hid_usage *usage, __s32 value)
+static u8 wacom_wac_usage_handler(struct wacom_wac *wacom_wac,
+		struct hid_field *field, struct hid_usage *usage)
+{
+	/* usage tests must precede field tests */
+	if (WACOM_BATTERY_USAGE(usage))
+		return WACOM_HANDLER_BATTERY;
+	else if (WACOM_PAD_FIELD(field) && wacom_wac->pad_input)
+		return WACOM_HANDLER_PAD;
+	else if (WACOM_PEN_FIELD(field) && wacom_wac->pen_input)
+		return WACOM_HANDLER_PEN;
+	else if (WACOM_FINGER_FIELD(field) && wacom_wac->touch_input)
+		return WACOM_HANDLER_FINGER;
+
+	return WACOM_HANDLER_NONE;
+}
+
+static bool wacom_is_serial_usage(unsigned int equivalent_usage)
+{
+	return equivalent_usage == HID_DG_INRANGE ||
+	       equivalent_usage == HID_DG_TOOLSERIALNUMBER ||
+	       equivalent_usage == WACOM_HID_WD_SERIALHI ||
+	       equivalent_usage == WACOM_HID_WD_TOOLTYPE;
+}
+
+/*
+ * Record where the usages that wacom_wac_pen_serial_enforce() inspects
+ * sit in the raw report, so it can extract them directly.
+ */
+static int wacom_wac_plan_serial_usages(struct hid_device *hdev,
+		struct hid_report *report, struct wacom_report_plan *plan)
+{
+	struct wacom_serial_usage *serial_usage;
+	int r;
+	unsigned n;
+
+	serial_usage = devm_kcalloc(&hdev->dev, plan->num_serial_usages,
+				    sizeof(*serial_usage), GFP_KERNEL);
+	if (!serial_usage)
+		return -ENOMEM;
+
+	plan->serial_usages = serial_usage;
+
+	for (r = 0; r < report->maxfield; r++) {
+		struct hid_field *field = report->field[r];
+
+		for (n = 0; n < field->maxusage; n++) {
+			unsigned int equivalent_usage =
+				plan->field[r].equivalent_usage[n];
+
+			if (!wacom_is_serial_usage(equivalent_usage))
+				continue;
+
+			serial_usage->usage = equivalent_usage;
+			serial_usage->size = field->report_size;
+			serial_usage->offset = field->report_offset +
+					       n * field->report_size;
+			serial_usage++;
+		}
+	}
+
+	return 0;
+}
+
+static struct wacom_report_plan *wacom_wac_build_report_plan(
+		struct hid_device *hdev, struct hid_report *report)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
+	struct wacom_report_plan *plan;
+	unsigned int nusages = 0;
+	unsigned int *equivalent;
+	u8 *handlers;
+	int r;
+	unsigned n;
 
-	if (wacom->wacom_wac.features.type != HID_GENERIC)
-		return;
+	for (r = 0; r < report->maxfield; r++)
+		nusages += report->field[r]->maxusage;
 
+	plan = devm_kzalloc(&hdev->dev, sizeof(*plan) +
+			    report->maxfield * sizeof(plan->field[0]) +
+			    nusages * (sizeof(*equivalent) + sizeof(*handlers)),
+			    GFP_KERNEL);
+	if (!plan)
+		return NULL;
+
+	equivalent = (unsigned int *)&plan->field[report->maxfield];
+	handlers = (u8 *)&equivalent[nusages];
+	plan->cc_index = -1;
+
+	for (r = 0; r < report->maxfield; r++) {
+		struct hid_field *field = report->field[r];
+		struct wacom_field_plan *field_plan = &plan->field[r];
+
+		if (WACOM_PAD_FIELD(field) && wacom_wac->pad_input)
+			plan->flags |= WACOM_PLAN_PAD;
+		if (WACOM_PEN_FIELD(field) && wacom_wac->pen_input)
+			plan->flags |= WACOM_PLAN_PEN;
+		if (WACOM_FINGER_FIELD(field) && wacom_wac->touch_input)
+			plan->flags |= WACOM_PLAN_FINGER;
+		if (wacom_equivalent_usage(field->physical) == HID_DG_TABLETFUNCTIONKEY &&
+		    wacom_wac->pad_input)
+			plan->flags |= WACOM_PLAN_TRUE_PAD;
+
+		if (WACOM_PEN_FIELD(field) && wacom_wac->pen_input)
+			field_plan->report = WACOM_HANDLER_PEN;
+		else if (WACOM_FINGER_FIELD(field) && wacom_wac->touch_input)
+			field_plan->report = WACOM_HANDLER_FINGER;
+
+		field_plan->usage = handlers;
+		field_plan->equivalent_usage = equivalent;
+		for (n = 0; n < field->maxusage; n++) {
+			unsigned int equivalent_usage =
+				wacom_equivalent_usage(field->usage[n].hid);
+
+			field_plan->usage[n] = wacom_wac_usage_handler(wacom_wac,
+						field, &field->usage[n]);
+			field_plan->equivalent_usage[n] = equivalent_usage;
+
+			switch (equivalent_usage) {
+			case HID_GD_X:
+			case HID_GD_Y:
+			case HID_DG_WIDTH:
+			case HID_DG_HEIGHT:
+			case HID_DG_CONTACTID:
+			case HID_DG_INRANGE:
+			case HID_DG_INVERT:
+			case HID_DG_TIPSWITCH:
+				plan->last_slot_field = equivalent_usage;
+				break;
+			case HID_DG_CONTACTCOUNT:
+				plan->cc_index = r;
+				plan->cc_value_index = n;
+				break;
+			}
+
+			if (wacom_is_serial_usage(equivalent_usage))
+				plan->num_serial_usages++;
+		}
+		handlers += field->maxusage;
+		equivalent += field->maxusage;
+	}
+
+	if (plan->num_serial_usages &&
+	    wacom_wac_plan_serial_usages(hdev, report, plan))
+		return NULL;
+
+	return plan;
+}
+
+/*
+ * Classify every field and usage of every report once the inputs are
+ * registered (an input whose capabilities could not be set up is gone
+ * by then), so that wacom_wac_report() only has to walk the plan.
+ */
+int wacom_wac_setup_report_plans(struct hid_device *hdev)
+{
+	struct wacom *wacom = hid_get_drvdata(hdev);
+	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
+	struct wacom_report_plan **plans;
+	int type, id;
+
+	if (wacom_wac->features.type != HID_GENERIC)
+		return 0;
+
+	plans = devm_kcalloc(&hdev->dev, HID_REPORT_TYPES * HID_MAX_IDS,
+			     sizeof(*plans), GFP_KERNEL);
+	if (!plans)
+		return -ENOMEM;
+
+	for (type = 0; type < HID_REPORT_TYPES; type++) {
+		for (id = 0; id < HID_MAX_IDS; id++) {
+			struct hid_report *report =
+				hdev->report_enum[type].report_id_hash[id];
+
+			if (!report)
+				continue;
+
+			plans[type * HID_MAX_IDS + id] =
+				wacom_wac_build_report_plan(hdev, report);
+			if (!plans[type * HID_MAX_IDS + id])
+				return -ENOMEM;
+		}
+	}
+
+	wacom_wac->report_plans = plans;
+	return 0;
+}
+
+static void wacom_wac_event(struct hid_device *hdev, struct hid_field *field,
+		struct hid_usage *usage, unsigned equivalent_usage, __s32 value,
+		u8 handler)
+{
 	if (value > field->logical_maximum || value < field->logical_minimum)
 		return;
 
-	/* usage tests must precede field tests */
-	if (WACOM_BATTERY_USAGE(usage))
-		wacom_wac_battery_event(hdev, field, usage, value);
-	else if (WACOM_PAD_FIELD(field) && wacom->wacom_wac.pad_input)
-		wacom_wac_pad_event(hdev, field, usage, value);
-	else if (WACOM_PEN_FIELD(field) && wacom->wacom_wac.pen_input)
-		wacom_wac_pen_event(hdev, field, usage, value);
-	else if (WACOM_FINGER_FIELD(field) && wacom->wacom_wac.touch_input)
-		wacom_wac_finger_event(hdev, field, usage, value);
+	switch (handler) {
+	case WACOM_HANDLER_BATTERY:
+		wacom_wac_battery_event(hdev, field, usage, equivalent_usage, value);
+		break;
+	case WACOM_HANDLER_PAD:
+		wacom_wac_pad_event(hdev, field, usage, equivalent_usage, value);
+		break;
+	case WACOM_HANDLER_PEN:
+		wacom_wac_pen_event(hdev, field, usage, equivalent_usage, value);
+		break;
+	case WACOM_HANDLER_FINGER:
+		wacom_wac_finger_event(hdev, field, usage, equivalent_usage, value);
+		break;
+	}
 }
 
 static void wacom_report_events(struct hid_device *hdev,
-				struct hid_report *report, int collection_index,
-				int field_index)
+				struct hid_report *report,
+				const struct wacom_report_plan *plan,
+				int collection_index, int field_index)
 {
 	int r;
 
 	for (r = field_index; r < report->maxfield; r++) {
 		struct hid_field *field;
+		const struct wacom_field_plan *field_plan = &plan->field[r];
 		unsigned count, n;
 
 		field = report->field[r];
@@ -2756,22 +3272,22 @@ static void wacom_report_events(struct hid_device *hdev,
 			continue;
 
 		for (n = 0 ; n < count; n++) {
-			if (field->usage[n].collection_index == collection_index)
-				wacom_wac_event(hdev, field, &field->usage[n],
-						field->value[n]);
-			else
+			if (field->usage[n].collection_index != collection_index)
 				return;
+			if (field_plan->usage[n] != WACOM_HANDLER_NONE)
+				wacom_wac_event(hdev, field, &field->usage[n],
+						field_plan->equivalent_usage[n],
+						field->value[n],
+						field_plan->usage[n]);
 		}
 	}
 }
 
 static int wacom_wac_collection(struct hid_device *hdev, struct hid_report *report,
-			 int collection_index, struct hid_field *field,
-			 int field_index)
+			 const struct wacom_report_plan *plan,
+			 int collection_index, int field_index)
 {
-	struct wacom *wacom = hid_get_drvdata(hdev);
-
-	wacom_report_events(hdev, report, collection_index, field_index);
+	wacom_report_events(hdev, report, plan, collection_index, field_index);
 
 	/*
 	 * Non-input reports may be sent prior to the device being
@@ -2783,10 +3299,14 @@ static int wacom_wac_collection(struct hid_device *hdev, struct hid_report *repo
 	if (report->type != HID_INPUT_REPORT)
 		return -1;
 
-	if (WACOM_PEN_FIELD(field) && wacom->wacom_wac.pen_input)
+	switch (plan->field[field_index].report) {
+	case WACOM_HANDLER_PEN:
 		wacom_wac_pen_report(hdev, report);
-	else if (WACOM_FINGER_FIELD(field) && wacom->wacom_wac.touch_input)
+		break;
+	case WACOM_HANDLER_FINGER:
 		wacom_wac_finger_report(hdev, report);
+		break;
+	}
 
 	return 0;
 }
@@ -2795,43 +3315,36 @@ void wacom_wac_report(struct hid_device *hdev, struct hid_report *report)
 {
 	struct wacom *wacom = hid_get_drvdata(hdev);
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
-	struct hid_field *field;
-	bool pad_in_hid_field = false, pen_in_hid_field = false,
-		finger_in_hid_field = false, true_pad = false;
+	const struct wacom_report_plan *plan;
+	struct hid_field *field = NULL;
 	int r;
 	int prev_collection = -1;
 
 	if (wacom_wac->features.type != HID_GENERIC)
 		return;
 
-	for (r = 0; r < report->maxfield; r++) {
-		field = report->field[r];
+	trace_wacom_wac_report(hdev, wacom_wac, report->id,
+			       hid_report_len(report));
 
-		if (WACOM_PAD_FIELD(field))
-			pad_in_hid_field = true;
-		if (WACOM_PEN_FIELD(field))
-			pen_in_hid_field = true;
-		if (WACOM_FINGER_FIELD(field))
-			finger_in_hid_field = true;
-		if (wacom_equivalent_usage(field->physical) == HID_DG_TABLETFUNCTIONKEY)
-			true_pad = true;
-	}
+	plan = wacom_report_plan(wacom_wac, report);
+	if (!plan)
+		return;
 
 	wacom_wac_battery_pre_report(hdev, report);
 
-	if (pad_in_hid_field && wacom->wacom_wac.pad_input)
+	if (plan->flags & WACOM_PLAN_PAD)
 		wacom_wac_pad_pre_report(hdev, report);
-	if (pen_in_hid_field && wacom->wacom_wac.pen_input)
+	if (plan->flags & WACOM_PLAN_PEN)
 		wacom_wac_pen_pre_report(hdev, report);
-	if (finger_in_hid_field && wacom->wacom_wac.touch_input)
-		wacom_wac_finger_pre_report(hdev, report);
+	if (plan->flags & WACOM_PLAN_FINGER)
+		wacom_wac_finger_pre_report(hdev, report, plan);
 
 	for (r = 0; r < report->maxfield; r++) {
 		field = report->field[r];
 
 		if (field->usage[0].collection_index != prev_collection) {
-			if (wacom_wac_collection(hdev, report,
-				field->usage[0].collection_index, field, r) < 0)
+			if (wacom_wac_collection(hdev, report, plan,
+				field->usage[0].collection_index, r) < 0)
 				return;
 			prev_collection = field->usage[0].collection_index;
 		}
@@ -2839,7 +3352,7 @@ void wacom_wac_report(struct hid_device *hdev, struct hid_report *report)
 
 	wacom_wac_battery_report(hdev, report);
 
-	if (true_pad && wacom->wacom_wac.pad_input)
+	if (plan->flags & WACOM_PLAN_TRUE_PAD)
 		wacom_wac_pad_report(hdev, report, field);
 }
 
@@ -2860,7 +3373,7 @@ static int wacom_bpt_touch(struct wacom_wac *wacom)
 			   && (data[offset + 3] & 0x80);
 
 		input_mt_slot(input, i);
-		input_mt_report_slot_state(input, MT_TOOL_FINGER, touch);
+		wacom_mt_report_slot_state(wacom, input, touch);
 		if (touch) {
 			int x = get_unaligned_be16(&data[offset + 3]) & 0x7ff;
 			int y = get_unaligned_be16(&data[offset + 5]) & 0x7ff;
@@ -2881,6 +3394,10 @@ static int wacom_bpt_touch(struct wacom_wac *wacom)
 	input_report_key(pad_input, BTN_RIGHT, (data[1] & 0x01) != 0);
 	wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
 
+	if (wacom_pad_changed(wacom, data[1] & 0x0f))
+		wacom->frame_data |= WACOM_DEVICETYPE_PAD;
+	wacom->frame_data |= WACOM_DEVICETYPE_TOUCH;
+
 	return 1;
 }
 
@@ -2889,7 +3406,7 @@ static void wacom_bpt3_touch_msg(struct wacom_wac *wacom, unsigned char *data)
 	struct wacom_features *features = &wacom->features;
 	struct input_dev *input = wacom->touch_input;
 	bool touch = data[1] & 0x80;
-	int slot = input_mt_get_slot_by_key(input, data[0]);
+	int slot = wacom_mt_get_slot_by_key(wacom, input, data[0]);
 
 	if (slot < 0)
 		return;
@@ -2897,14 +3414,14 @@ static void wacom_bpt3_touch_msg(struct wacom_wac *wacom, unsigned char *data)
 	touch = touch && report_touch_events(wacom);
 
 	input_mt_slot(input, slot);
-	input_mt_report_slot_state(input, MT_TOOL_FINGER, touch);
+	wacom_mt_report_slot_state(wacom, input, touch);
 
 	if (touch) {
 		int x = (data[2] << 4) | (data[4] >> 4);
 		int y = (data[3] << 4) | (data[4] & 0x0f);
 		int width, height;
 
-		if (features->type >= INTUOSPS && features->type <= INTUOSHT2) {
+		if (features->caps & WACOM_CAP_WIDTH_100UM) {
 			width  = data[5] * 100;
 			height = data[6] * 100;
 		} else {
@@ -2932,7 +3449,7 @@ static void wacom_bpt3_button_msg(struct wacom_wac *wacom, unsigned char *data)
 	struct input_dev *input = wacom->pad_input;
 	struct wacom_features *features = &wacom->features;
 
-	if (features->type == INTUOSHT || features->type == INTUOSHT2) {
+	if (features->caps & WACOM_CAP_HT_BUTTONS) {
 		input_report_key(input, BTN_LEFT, (data[1] & 0x02) != 0);
 		input_report_key(input, BTN_BACK, (data[1] & 0x08) != 0);
 	} else {
@@ -2941,6 +3458,8 @@ static void wacom_bpt3_button_msg(struct wacom_wac *wacom, unsigned char *data)
 	}
 	input_report_key(input, BTN_FORWARD, (data[1] & 0x04) != 0);
 	input_report_key(input, BTN_RIGHT, (data[1] & 0x01) != 0);
+	if (wacom_pad_changed(wacom, data[1] & 0x0f))
+		wacom->frame_data |= WACOM_DEVICETYPE_PAD;
 }
 
 static int wacom_bpt3_touch(struct wacom_wac *wacom)
@@ -2969,6 +3488,7 @@ static int wacom_bpt3_touch(struct wacom_wac *wacom)
 	if (wacom->touch_input && touch_changed) {
 		input_mt_sync_frame(wacom->touch_input);
 		wacom->shared->touch_down = wacom_wac_finger_count_touches(wacom);
+		wacom->frame_data |= WACOM_DEVICETYPE_TOUCH;
 	}
 
 	return 1;
@@ -3049,23 +3569,6 @@ static int wacom_bpt_pen(struct wacom_wac *wacom)
 	return 1;
 }
 
-static int wacom_bpt_irq(struct wacom_wac *wacom, size_t len)
-{
-	struct wacom_features *features = &wacom->features;
-
-	if ((features->type == INTUOSHT2) &&
-	    (features->device_type & WACOM_DEVICETYPE_PEN))
-		return wacom_intuos_irq(wacom);
-	else if (len == WACOM_PKGLEN_BBTOUCH)
-		return wacom_bpt_touch(wacom);
-	else if (len == WACOM_PKGLEN_BBTOUCH3)
-		return wacom_bpt3_touch(wacom);
-	else if (len == WACOM_PKGLEN_BBFUN || len == WACOM_PKGLEN_BBPEN)
-		return wacom_bpt_pen(wacom);
-
-	return 0;
-}
-
 static void wacom_bamboo_pad_pen_event(struct wacom_wac *wacom,
 		unsigned char *data)
 {
@@ -3108,7 +3611,7 @@ static int wacom_bamboo_pad_touch_event(struct wacom_wac *wacom,
 			report_touch_events(wacom);
 
 		input_mt_slot(input, id);
-		input_mt_report_slot_state(input, MT_TOOL_FINGER, valid);
+		wacom_mt_report_slot_state(wacom, input, valid);
 
 		if (!valid)
 			continue;
@@ -3129,6 +3632,7 @@ static int wacom_bamboo_pad_touch_event(struct wacom_wac *wacom,
 	/* keep touch state for pen event */
 	wacom->shared->touch_down = !!prefix && report_touch_events(wacom);
 
+	wacom->frame_data |= WACOM_DEVICETYPE_TOUCH;
 	return 1;
 }
 
@@ -3168,7 +3672,8 @@ static int wacom_wireless_irq(struct wacom_wac *wacom, size_t len)
 		    wacom->shared->touch_max) {
 			input_report_switch(wacom->shared->touch_input,
 					SW_MUTE_DEVICE, data[5] & 0x40);
-			input_sync(wacom->shared->touch_input);
+			__wacom_input_sync(wacom, wacom->shared->touch_input,
+					   false);
 		}
 
 		pid = get_unaligned_be16(&data[6]);
@@ -3207,7 +3712,8 @@ static int wacom_status_irq(struct wacom_wac *wacom_wac, size_t len)
 	    features->touch_max) {
 		input_report_switch(wacom_wac->shared->touch_input,
 				    SW_MUTE_DEVICE, data[8] & 0x40);
-		input_sync(wacom_wac->shared->touch_input);
+		__wacom_input_sync(wacom_wac, wacom_wac->shared->touch_input,
+				   false);
 	}
 
 	if (data[9] & 0x02) { /* wireless module is attached */
@@ -3232,37 +3738,216 @@ static int wacom_status_irq(struct wacom_wac *wacom_wac, size_t len)
 	return 0;
 }
 
-void wacom_wac_irq(struct wacom_wac *wacom_wac, size_t len)
+static int wacom_none_irq(struct wacom_wac *wacom, size_t len)
 {
-	bool sync;
+	return 0;
+}
+
+static int wacom_unknown_irq(struct wacom_wac *wacom_wac, size_t len)
+{
+	struct wacom *wacom = container_of(wacom_wac, struct wacom, wacom_wac);
+
+	hid_dbg(wacom->hdev, "%s: received unknown report #%d, size %zu\n",
+		__func__, wacom_wac->data[0], len);
+	return 0;
+}
+
+/* Bamboo touch interfaces of the 2nd and 3rd generation */
+static int wacom_bpt_touch_irq(struct wacom_wac *wacom, size_t len)
+{
+	if (len == WACOM_PKGLEN_BBTOUCH3)
+		return wacom_bpt3_touch(wacom);
+	else if (len == WACOM_PKGLEN_BBTOUCH)
+		return wacom_bpt_touch(wacom);
+
+	return 0;
+}
 
-	switch (wacom_wac->features.type) {
+static int wacom_bpt_pen_irq(struct wacom_wac *wacom, size_t len)
+{
+	if (len != WACOM_PKGLEN_BBFUN && len != WACOM_PKGLEN_BBPEN)
+		return 0;
+
+	wacom->frame_data |= WACOM_DEVICETYPE_PEN;
+	return wacom_bpt_pen(wacom);
+}
+
+static int wacom_remote_list_irq(struct wacom_wac *wacom, size_t len)
+{
+	wacom_remote_status_irq(wacom, len);
+	return 0;
+}
+
+static const u8 wacom_intuos_pen_ids[] = {
+	WACOM_REPORT_PENABLED, WACOM_REPORT_INTUOS_ID1,
+	WACOM_REPORT_INTUOS_ID2, WACOM_REPORT_INTUOS_PEN, 0
+};
+static const u8 wacom_intuos_pad_ids[] = {
+	WACOM_REPORT_INTUOSPAD, WACOM_REPORT_INTUOS5PAD,
+	WACOM_REPORT_CINTIQPAD, 0
+};
+static const u8 wacom_intuos_bt_pen_ids[] = { 0x03, 0x04, 0 };
+static const u8 wacom_bpt_ids[] = { WACOM_REPORT_PENABLED, 0 };
+static const u8 wacom_usb_status_ids[] = { WACOM_REPORT_USB, 0 };
+static const u8 wacom_device_list_ids[] = { WACOM_REPORT_DEVICE_LIST, 0 };
+
+static const struct wacom_wac_ops wacom_none_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_none_irq,
+};
+
+static const struct wacom_wac_ops wacom_penpartner_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_penpartner_irq,
+};
+
+static const struct wacom_wac_ops wacom_pl_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_pl_irq,
+};
+
+static const struct wacom_wac_ops wacom_graphire_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_graphire_irq,
+};
+
+static const struct wacom_wac_ops wacom_ptu_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_ptu_irq,
+};
+
+static const struct wacom_wac_ops wacom_dtu_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_dtu_irq,
+};
+
+static const struct wacom_wac_ops wacom_dtus_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_dtus_irq,
+};
+
+static const struct wacom_wac_ops wacom_intuos_ops = {
+	.irq = {
+		[WACOM_IRQ_OTHER] = wacom_unknown_irq,
+		[WACOM_IRQ_PEN] = wacom_intuos_pen_irq,
+		[WACOM_IRQ_PAD] = wacom_intuos_pad_irq,
+	},
+	.ids = {
+		[WACOM_IRQ_PEN] = wacom_intuos_pen_ids,
+		[WACOM_IRQ_PAD] = wacom_intuos_pad_ids,
+	},
+};
+
+static const struct wacom_wac_ops wacom_intuos_bt_ops = {
+	.irq = {
+		[WACOM_IRQ_OTHER] = wacom_unknown_irq,
+		[WACOM_IRQ_PEN] = wacom_intuos_bt_pen_irq,
+	},
+	.ids = {
+		[WACOM_IRQ_PEN] = wacom_intuos_bt_pen_ids,
+	},
+};
+
+static const struct wacom_wac_ops wacom_24hdt_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_24hdt_irq,
+};
+
+/* Intuos5/Pro pen interfaces and INTUOSHT2 pens speak the Intuos protocol */
+static const struct wacom_wac_ops wacom_intuos5_pen_ops = {
+	.irq = {
+		[WACOM_IRQ_OTHER] = wacom_unknown_irq,
+		[WACOM_IRQ_PEN] = wacom_intuos_pen_irq,
+		[WACOM_IRQ_PAD] = wacom_intuos_pad_irq,
+		[WACOM_IRQ_STATUS] = wacom_status_irq,
+	},
+	.ids = {
+		[WACOM_IRQ_PEN] = wacom_intuos_pen_ids,
+		[WACOM_IRQ_PAD] = wacom_intuos_pad_ids,
+		[WACOM_IRQ_STATUS] = wacom_usb_status_ids,
+	},
+};
+
+/* Intuos5/Pro and Bamboo touch interfaces carry Bamboo touch packets */
+static const struct wacom_wac_ops wacom_bpt_touch_ops = {
+	.irq = {
+		[WACOM_IRQ_OTHER] = wacom_unknown_irq,
+		[WACOM_IRQ_TOUCH] = wacom_bpt_touch_irq,
+		[WACOM_IRQ_STATUS] = wacom_status_irq,
+	},
+	.ids = {
+		[WACOM_IRQ_TOUCH] = wacom_bpt_ids,
+		[WACOM_IRQ_STATUS] = wacom_usb_status_ids,
+	},
+};
+
+static const struct wacom_wac_ops wacom_bpt_pen_ops = {
+	.irq = {
+		[WACOM_IRQ_OTHER] = wacom_unknown_irq,
+		[WACOM_IRQ_PEN] = wacom_bpt_pen_irq,
+		[WACOM_IRQ_STATUS] = wacom_status_irq,
+	},
+	.ids = {
+		[WACOM_IRQ_PEN] = wacom_bpt_ids,
+		[WACOM_IRQ_STATUS] = wacom_usb_status_ids,
+	},
+};
+
+/* Each Pro 2 report carries the pen, touch, pad and battery state at once */
+static const struct wacom_wac_ops wacom_intuos_pro2_bt_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_intuos_pro2_bt_irq,
+};
+
+static const struct wacom_wac_ops wacom_tpc_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_tpc_irq,
+};
+
+static const struct wacom_wac_ops wacom_bamboo_pad_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_bamboo_pad_irq,
+};
+
+static const struct wacom_wac_ops wacom_wireless_ops = {
+	.irq[WACOM_IRQ_OTHER] = wacom_wireless_irq,
+};
+
+static const struct wacom_wac_ops wacom_remote_ops = {
+	.irq = {
+		[WACOM_IRQ_OTHER] = wacom_remote_irq,
+		[WACOM_IRQ_STATUS] = wacom_remote_list_irq,
+	},
+	.ids = {
+		[WACOM_IRQ_STATUS] = wacom_device_list_ids,
+	},
+};
+
+/*
+ * Pick the report decoders for this interface once its type and
+ * device_type are final, so wacom_wac_irq() doesn't have to.
+ */
+void wacom_setup_irq_ops(struct wacom_wac *wacom_wac)
+{
+	struct wacom_features *features = &wacom_wac->features;
+	int kind;
+
+	switch (features->type) {
 	case PENPARTNER:
-		sync = wacom_penpartner_irq(wacom_wac);
+		wacom_wac->ops = &wacom_penpartner_ops;
 		break;
 
 	case PL:
-		sync = wacom_pl_irq(wacom_wac);
+		wacom_wac->ops = &wacom_pl_ops;
 		break;
 
 	case WACOM_G4:
 	case GRAPHIRE:
 	case GRAPHIRE_BT:
 	case WACOM_MO:
-		sync = wacom_graphire_irq(wacom_wac);
+		wacom_wac->ops = &wacom_graphire_ops;
 		break;
 
 	case PTU:
-		sync = wacom_ptu_irq(wacom_wac);
+		wacom_wac->ops = &wacom_ptu_ops;
 		break;
 
 	case DTU:
-		sync = wacom_dtu_irq(wacom_wac);
+		wacom_wac->ops = &wacom_dtu_ops;
 		break;
 
 	case DTUS:
 	case DTUSX:
-		sync = wacom_dtus_irq(wacom_wac);
+		wacom_wac->ops = &wacom_dtus_ops;
 		break;
 
 	case INTUOS:
@@ -3282,16 +3967,16 @@ void wacom_wac_irq(struct wacom_wac *wacom_wac, size_t len)
 	case DTK:
 	case CINTIQ_HYBRID:
 	case CINTIQ_COMPANION_2:
-		sync = wacom_intuos_irq(wacom_wac);
+		wacom_wac->ops = &wacom_intuos_ops;
 		break;
 
 	case INTUOS4WL:
-		sync = wacom_intuos_bt_irq(wacom_wac, len);
+		wacom_wac->ops = &wacom_intuos_bt_ops;
 		break;
 
 	case WACOM_24HDT:
 	case WACOM_27QHDT:
-		sync = wacom_24hdt_irq(wacom_wac);
+		wacom_wac->ops = &wacom_24hdt_ops;
 		break;
 
 	case INTUOS5S:
@@ -3300,18 +3985,16 @@ void wacom_wac_irq(struct wacom_wac *wacom_wac, size_t len)
 	case INTUOSPS:
 	case INTUOSPM:
 	case INTUOSPL:
-		if (len == WACOM_PKGLEN_BBTOUCH3)
-			sync = wacom_bpt3_touch(wacom_wac);
-		else if (wacom_wac->data[0] == WACOM_REPORT_USB)
-			sync = wacom_status_irq(wacom_wac, len);
+		if (features->pktlen == WACOM_PKGLEN_BBTOUCH3)
+			wacom_wac->ops = &wacom_bpt_touch_ops;
 		else
-			sync = wacom_intuos_irq(wacom_wac);
+			wacom_wac->ops = &wacom_intuos5_pen_ops;
 		break;
 
 	case INTUOSP2_BT:
 	case INTUOSP2S_BT:
 	case INTUOSHT3_BT:
-		sync = wacom_intuos_pro2_bt_irq(wacom_wac, len);
+		wacom_wac->ops = &wacom_intuos_pro2_bt_ops;
 		break;
 
 	case TABLETPC:
@@ -3320,48 +4003,73 @@ void wacom_wac_irq(struct wacom_wac *wacom_wac, size_t len)
 	case MTSCREEN:
 	case MTTPC:
 	case MTTPC_B:
-		sync = wacom_tpc_irq(wacom_wac, len);
+		wacom_wac->ops = &wacom_tpc_ops;
 		break;
 
+	case INTUOSHT2:
+		if (features->device_type & WACOM_DEVICETYPE_PEN) {
+			wacom_wac->ops = &wacom_intuos5_pen_ops;
+			break;
+		}
+		/* fall through */
 	case BAMBOO_PT:
 	case BAMBOO_PEN:
 	case BAMBOO_TOUCH:
 	case INTUOSHT:
-	case INTUOSHT2:
-		if (wacom_wac->data[0] == WACOM_REPORT_USB)
-			sync = wacom_status_irq(wacom_wac, len);
+		if (features->pktlen == WACOM_PKGLEN_BBTOUCH ||
+		    features->pktlen == WACOM_PKGLEN_BBTOUCH3)
+			wacom_wac->ops = &wacom_bpt_touch_ops;
 		else
-			sync = wacom_bpt_irq(wacom_wac, len);
+			wacom_wac->ops = &wacom_bpt_pen_ops;
 		break;
 
 	case BAMBOO_PAD:
-		sync = wacom_bamboo_pad_irq(wacom_wac, len);
+		wacom_wac->ops = &wacom_bamboo_pad_ops;
 		break;
 
 	case WIRELESS:
-		sync = wacom_wireless_irq(wacom_wac, len);
+		wacom_wac->ops = &wacom_wireless_ops;
 		break;
 
 	case REMOTE:
-		sync = false;
-		if (wacom_wac->data[0] == WACOM_REPORT_DEVICE_LIST)
-			wacom_remote_status_irq(wacom_wac, len);
-		else
-			sync = wacom_remote_irq(wacom_wac, len);
+		wacom_wac->ops = &wacom_remote_ops;
 		break;
 
 	default:
-		sync = false;
+		wacom_wac->ops = &wacom_none_ops;
 		break;
 	}
 
+	memset(wacom_wac->irq_kind, WACOM_IRQ_OTHER, sizeof(wacom_wac->irq_kind));
+	for (kind = WACOM_IRQ_OTHER; kind < WACOM_IRQ_KINDS; kind++) {
+		const u8 *id = wacom_wac->ops->ids[kind];
+
+		while (id && *id)
+			wacom_wac->irq_kind[*id++] = kind;
+	}
+}
+
+void wacom_wac_irq(struct wacom_wac *wacom_wac, size_t len)
+{
+	struct wacom *wacom = container_of(wacom_wac, struct wacom, wacom_wac);
+	u8 id = wacom_wac->data[0];
+	bool sync;
+
+	trace_wacom_wac_irq(wacom->hdev, wacom_wac, id, len);
+
+	wacom_wac->frame_data = 0;
+	sync = wacom_wac->ops->irq[wacom_wac->irq_kind[id]](wacom_wac, len);
+
 	if (sync) {
 		if (wacom_wac->pen_input)
-			input_sync(wacom_wac->pen_input);
+			__wacom_input_sync(wacom_wac, wacom_wac->pen_input,
+					   wacom_wac->frame_data & WACOM_DEVICETYPE_PEN);
 		if (wacom_wac->touch_input)
-			input_sync(wacom_wac->touch_input);
+			__wacom_input_sync(wacom_wac, wacom_wac->touch_input,
+					   wacom_wac->frame_data & WACOM_DEVICETYPE_TOUCH);
 		if (wacom_wac->pad_input)
-			input_sync(wacom_wac->pad_input);
+			__wacom_input_sync(wacom_wac, wacom_wac->pad_input,
+					   wacom_wac->frame_data & WACOM_DEVICETYPE_PAD);
 	}
 }
 
@@ -3419,11 +4127,101 @@ static void wacom_setup_intuos(struct wacom_wac *wacom_wac)
 	input_set_abs_params(input_dev, ABS_THROTTLE, -1023, 1023, 0, 0);
 }
 
+static unsigned wacom_type_caps(int type)
+{
+	unsigned caps = 0;
+
+	switch (type) {
+	case PENPARTNER:
+	case GRAPHIRE:
+	case GRAPHIRE_BT:
+	case WACOM_G4:
+	case PTU:
+	case PL:
+	case DTU:
+	case DTUS:
+	case DTUSX:
+		caps |= WACOM_CAP_PRE_INTUOS3;
+		break;
+
+	case INTUOS:
+		caps |= WACOM_CAP_PRE_INTUOS3 | WACOM_CAP_DUAL_TOOL;
+		break;
+
+	case INTUOS3S:
+	case INTUOS3:
+		caps |= WACOM_CAP_NO_LENS | WACOM_CAP_MOUSE_SIDE_BUTTONS;
+		break;
+
+	case INTUOS3L:
+		caps |= WACOM_CAP_MOUSE_SIDE_BUTTONS;
+		break;
+
+	case INTUOS4S:
+	case INTUOS4:
+	case INTUOS5S:
+	case INTUOS5:
+		caps |= WACOM_CAP_NO_LENS;
+		break;
+
+	case INTUOSPS:
+	case INTUOSPM:
+		caps |= WACOM_CAP_NO_LENS | WACOM_CAP_WIDTH_100UM;
+		break;
+
+	case INTUOSPL:
+	case BAMBOO_PEN:
+		caps |= WACOM_CAP_WIDTH_100UM;
+		break;
+
+	case INTUOSP2_BT:
+		caps |= WACOM_CAP_PRO2_FRAMES | WACOM_CAP_LED_BUTTON8;
+		break;
+
+	case INTUOSP2S_BT:
+		caps |= WACOM_CAP_PRO2_FRAMES;
+		break;
+
+	case WACOM_21UX2:
+		caps |= WACOM_CAP_I4_STYLUS_ONLY | WACOM_CAP_LED_GROUPS_SWAPPED;
+		break;
+
+	case CINTIQ:
+		caps |= WACOM_CAP_NEEDS_RDY;
+		break;
+
+	case INTUOSHT:
+		caps |= WACOM_CAP_WIDTH_100UM | WACOM_CAP_HT_BUTTONS;
+		break;
+
+	case INTUOSHT2:
+		caps |= WACOM_CAP_WIDTH_100UM | WACOM_CAP_HT_BUTTONS |
+			WACOM_CAP_INVERT_DISTANCE | WACOM_CAP_RANGE_NOT_PROX;
+		break;
+
+	case WACOM_27QHDT:
+		caps |= WACOM_CAP_QHDT_LAYOUT;
+		break;
+
+	case MTTPC:
+	case MTTPC_B:
+		caps |= WACOM_CAP_MT_NO_SIZE;
+		break;
+	}
+
+	if (type != INTUOSHT2)
+		caps |= WACOM_CAP_TILT;
+
+	return caps;
+}
+
 void wacom_setup_device_quirks(struct wacom *wacom)
 {
 	struct wacom_wac *wacom_wac = &wacom->wacom_wac;
 	struct wacom_features *features = &wacom->wacom_wac.features;
 
+	features->caps = wacom_type_caps(features->type);
+
 	/* The pen and pad share the same interface on most devices */
 	if (features->type == GRAPHIRE_BT || features->type == WACOM_G4 ||
 	    features->type == DTUS ||
@@ -3943,12 +4741,12 @@ static bool wacom_is_led_toggled(struct wacom *wacom, int button_count,
 	 * to the right. We need to reverse the group to match this
 	 * historical behavior.
 	 */
-	if (wacom->wacom_wac.features.type == WACOM_21UX2)
+	if (wacom->wacom_wac.features.caps & WACOM_CAP_LED_GROUPS_SWAPPED)
 		group = 1 - group;
 
 	group_button = group * (button_count/wacom->led.count);
 
-	if (wacom->wacom_wac.features.type == INTUOSP2_BT)
+	if (wacom->wacom_wac.features.caps & WACOM_CAP_LED_BUTTON8)
 		group_button = 8;
 
 	return mask & (1 << group_button);
@@ -8,6 +8,7 @@
 #include <linux/types.h>
 #include <linux/hid.h>
 #include <linux/kfifo.h>
+#include <linux/ktime.h>
 
 /* maximum packet length for USB/BT devices */
 #define WACOM_PKGLEN_MAX	361
@@ -87,6 +88,24 @@
 #define WACOM_QUIRK_BATTERY		0x0008
 #define WACOM_QUIRK_TOOLSERIAL		0x0010
 
+/* protocol capabilities, derived from features.type */
+#define WACOM_CAP_PRE_INTUOS3		0x0001	/* half-res x/y/distance, no ABS_Z */
+#define WACOM_CAP_DUAL_TOOL		0x0002	/* two tools, index in data[1] bit 0 */
+#define WACOM_CAP_NO_LENS		0x0004	/* no lens cursor support */
+#define WACOM_CAP_I4_STYLUS_ONLY	0x0008	/* older I4 styli are unsupported */
+#define WACOM_CAP_NEEDS_RDY		0x0010	/* no valid data without RDY bit */
+#define WACOM_CAP_TILT			0x0020	/* pen packets carry tilt */
+#define WACOM_CAP_INVERT_DISTANCE	0x0040	/* distance counts up to the surface */
+#define WACOM_CAP_RANGE_NOT_PROX	0x0080	/* in-range is not proximity */
+#define WACOM_CAP_MOUSE_SIDE_BUTTONS	0x0100	/* 2D mouse has side buttons */
+#define WACOM_CAP_WIDTH_100UM		0x0200	/* contact size in 100um units */
+#define WACOM_CAP_PRO2_FRAMES		0x0400	/* Intuos Pro 2 BT frame layout */
+#define WACOM_CAP_QHDT_LAYOUT		0x0800	/* 27QHD touch contact layout */
+#define WACOM_CAP_MT_NO_SIZE		0x1000	/* MT contacts lack width/height */
+#define WACOM_CAP_LED_GROUPS_SWAPPED	0x2000	/* LED group 1 is on the left */
+#define WACOM_CAP_LED_BUTTON8		0x4000	/* mode LED follows button 8 */
+#define WACOM_CAP_HT_BUTTONS		0x8000	/* Intuos HT pad button order */
+
 /* device types */
 #define WACOM_DEVICETYPE_NONE           0x0000
 #define WACOM_DEVICETYPE_PEN            0x0001
@@ -115,6 +134,14 @@
 #define BTN_STYLUS3                     0x149
 #endif
 
+#ifndef HID_DG_SCANTIME
+#define HID_DG_SCANTIME                 (HID_UP_DIGITIZER | 0x56)
+#endif
+
+#ifndef MSC_TIMESTAMP
+#define MSC_TIMESTAMP                   0x05
+#endif
+
 #define WACOM_POWER_SUPPLY_STATUS_AUTO  -1
 
 #define WACOM_HID_UP_WACOMDIGITIZER     0xff0d0000
@@ -265,6 +292,20 @@ enum {
 	MAX_TYPE
 };
 
+/* wacom_tool flags */
+#define WACOM_TOOL_IS_ERASER		0x0001	/* eraser end of a pen */
+#define WACOM_TOOL_PRESSURE		0x0002
+#define WACOM_TOOL_TILT			0x0004
+#define WACOM_TOOL_ROTATION		0x0008	/* barrel rotation */
+#define WACOM_TOOL_WHEEL		0x0010	/* airbrush fingerwheel */
+
+struct wacom_tool {
+	u32 id;
+	u16 type;	/* BTN_TOOL_* reported at prox-in */
+	u16 flags;
+	const char *name;
+};
+
 struct wacom_features {
 	const char *name;
 	int x_max;
@@ -290,6 +331,7 @@ struct wacom_features {
 	int distance_fuzz;
 	int tilt_fuzz;
 	unsigned quirks;
+	unsigned caps;
 	unsigned touch_max;
 	int oVid;
 	int oPid;
@@ -301,6 +343,7 @@ struct wacom_features {
 struct wacom_shared {
 	bool stylus_in_proximity;
 	bool touch_down;
+	unsigned touch_contacts;	/* touch_input slots holding a contact */
 	/* for wireless device to access USB interfaces */
 	unsigned touch_max;
 	int type;
@@ -311,6 +354,32 @@ struct wacom_shared {
 	bool is_touch_on;
 };
 
+/*
+ * Contact ID to MT slot cache of the touch decoders. IDs below
+ * WACOM_MT_KEYS_DIRECT index an array; others go to a small open-addressed
+ * table. Entries hold slot + 1 (0 is empty) and are only hints: a hit is
+ * used only while the slot is active with the same key.
+ */
+#define WACOM_MT_KEYS_DIRECT	256
+#define WACOM_MT_KEYS_HASH_BITS	6
+#define WACOM_MT_KEYS_PROBES	4
+
+struct wacom_mt_keys {
+	u8 direct[WACOM_MT_KEYS_DIRECT];
+	struct {
+		int key;
+		u8 slot;
+	} hashed[1 << WACOM_MT_KEYS_HASH_BITS];
+};
+
+/* How pen reports packing several device frames are synced */
+enum wacom_pen_frames {
+	WACOM_PEN_FRAMES_EACH = 0,	/* every frame, with its own timestamp */
+	WACOM_PEN_FRAMES_COALESCE,	/* newest frame of each button state */
+	WACOM_PEN_FRAMES_SUMMARY,	/* as COALESCE, with the highest pressure */
+	WACOM_PEN_FRAMES_MAX
+};
+
 struct hid_data {
 	__s16 inputmode;	/* InputMode HID feature, -1 if non-existent */
 	__s16 inputmode_index;	/* InputMode HID feature index in the report */
@@ -340,6 +409,69 @@ struct hid_data {
 	bool pad_input_event_flag;
 };
 
+/* Handlers a HID_GENERIC usage or field is dispatched to */
+enum wacom_hid_handler {
+	WACOM_HANDLER_NONE = 0,
+	WACOM_HANDLER_BATTERY,
+	WACOM_HANDLER_PAD,
+	WACOM_HANDLER_PEN,
+	WACOM_HANDLER_FINGER,
+};
+
+#define WACOM_PLAN_PAD		0x0001	/* has a pad field, call pad_pre_report */
+#define WACOM_PLAN_PEN		0x0002	/* has a pen field, call pen_pre_report */
+#define WACOM_PLAN_FINGER	0x0004	/* has a finger field, call finger_pre_report */
+#define WACOM_PLAN_TRUE_PAD	0x0008	/* has a tablet function key, call pad_report */
+
+struct wacom_field_plan {
+	u8 report;		/* handler for the end of the field's collection */
+	u8 *usage;		/* event handler of each usage */
+	unsigned int *equivalent_usage;	/* wacom_equivalent_usage() of each usage */
+};
+
+/* A usage wacom_wac_pen_serial_enforce() has to check in the raw report */
+struct wacom_serial_usage {
+	unsigned int usage;	/* equivalent usage */
+	unsigned int offset;	/* in bits, after the report ID */
+	unsigned int size;	/* in bits */
+};
+
+/*
+ * Dispatch decisions for one hid_report, made once when the device is
+ * registered instead of for every value of every report.
+ */
+struct wacom_report_plan {
+	unsigned int flags;
+	unsigned int last_slot_field;	/* last per-contact usage, 0 if none */
+	int cc_index;			/* field holding HID_DG_CONTACTCOUNT, or -1 */
+	int cc_value_index;
+	unsigned int num_serial_usages;
+	struct wacom_serial_usage *serial_usages;
+	struct wacom_field_plan field[];
+};
+
+struct wacom_wac;
+
+enum wacom_irq_kind {
+	WACOM_IRQ_OTHER,
+	WACOM_IRQ_PEN,
+	WACOM_IRQ_TOUCH,
+	WACOM_IRQ_PAD,
+	WACOM_IRQ_STATUS,
+	WACOM_IRQ_KINDS
+};
+
+/*
+ * Report decoders of an interface, one per kind of report. ids[kind]
+ * lists the report IDs that go to irq[kind], zero-terminated; reports
+ * with any other ID go to irq[WACOM_IRQ_OTHER]. All return non-zero
+ * when the inputs need to be synced.
+ */
+struct wacom_wac_ops {
+	int (*irq[WACOM_IRQ_KINDS])(struct wacom_wac *wacom_wac, size_t len);
+	const u8 *ids[WACOM_IRQ_KINDS];
+};
+
 struct wacom_remote_data {
 	struct {
 		u32 serial;
@@ -347,6 +479,20 @@ struct wacom_remote_data {
 	} remote[WACOM_MAX_REMOTES];
 };
 
+/*
+ * MSC_TIMESTAMP state. Reports are stamped with their receive time,
+ * multi-frame reports spread their frames back from it, and devices
+ * reporting HID_DG_SCANTIME (100us units) are stamped from that.
+ */
+struct wacom_timestamp {
+	ktime_t rx_time;	/* receive time of the current report */
+	ktime_t last_rx_time;	/* receive time of the previous report */
+	ktime_t scan_rx_time;	/* receive time of the last scan time */
+	u32 scan_time;		/* last HID_DG_SCANTIME value */
+	u32 device_time;	/* scan time accumulated in us */
+	u32 stamp;		/* MSC_TIMESTAMP of the frame being decoded */
+};
+
 struct wacom_wac {
 	char name[WACOM_NAME_MAX];
 	char pen_name[WACOM_NAME_MAX];
@@ -358,18 +504,35 @@ struct wacom_wac {
 	__u64 serial[2];
 	bool reporting_data;
 	struct wacom_features features;
+	const struct wacom_wac_ops *ops;
+	u8 irq_kind[256];
 	struct wacom_shared *shared;
 	struct input_dev *pen_input;
 	struct input_dev *touch_input;
 	struct input_dev *pad_input;
 	struct kfifo_rec_ptr_2 pen_fifo;
+	struct wacom_timestamp timestamp;
+	u32 report_seq;
+	unsigned int pen_fifo_depth;
+	unsigned long pen_fifo_flushed;
+	unsigned long pen_fifo_expired;
+	ktime_t pen_fifo_time;
+	ktime_t pen_fifo_rx_time;
+	bool pen_fifo_replay;
 	int pid;
 	int num_contacts_left;
+	bool touch_frame_open;
+	struct wacom_mt_keys mt_keys;
 	u8 bt_features;
 	u8 bt_high_speed;
+	u8 pen_frames;
+	u8 pen_frame_state;
+	u32 pad_state;		/* pad bytes of the last report, see wacom_pad_changed() */
+	unsigned int frame_data;	/* WACOM_DEVICETYPE_* inputs with data */
 	int mode_report;
 	int mode_value;
 	struct hid_data hid_data;
+	struct wacom_report_plan **report_plans;
 	bool has_mute_touch_switch;
 	bool has_mode_change;
 	bool is_direct_mode;
@@ -0,0 +1,6 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Stand-in for the autoconf-generated config.h when building the
+ * userspace benchmark; wacom.h includes it as "../config.h".
+ */
+#define WACOM_VERSION_SUFFIX "-bench"
@@ -0,0 +1,719 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * bench/include/kshim.h
+ *
+ *  Minimal userspace stand-ins for the kernel interfaces used by
+ *  4.5/wacom_wac.c, so that the decoders can be built and timed as an
+ *  ordinary program. Only what wacom_wac.c touches is provided; the
+ *  input and MT helpers mirror the semantics of drivers/input closely
+ *  enough that the per-report work done by the driver is unchanged.
+ */
+
+#ifndef WACOM_BENCH_KSHIM_H
+#define WACOM_BENCH_KSHIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/input-event-codes.h>
+
+/* ---- basic types ---- */
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint8_t __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef int8_t __s8;
+typedef int16_t __s16;
+typedef int32_t __s32;
+typedef int64_t __s64;
+typedef uint16_t __le16;
+typedef uint16_t __be16;
+typedef uint32_t __le32;
+typedef uint32_t __be32;
+typedef unsigned long kernel_ulong_t;
+typedef unsigned int gfp_t;
+
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+#ifndef LINUX_VERSION_CODE
+#define LINUX_VERSION_CODE	KERNEL_VERSION(4, 19, 0)
+#endif
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define __maybe_unused		__attribute__((unused))
+#define __percpu
+#define __rcu
+
+/* the bench is single threaded, so one CPU's worth of counters */
+#define this_cpu_inc(pcp)	((pcp)++)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)		min((t)(a), (t)(b))
+#define max_t(t, a, b)		max((t)(a), (t)(b))
+#define clamp_val(v, lo, hi)	min(max((v), (lo)), (hi))
+#define DIV_ROUND_CLOSEST(x, d)	(((x) + ((d) / 2)) / (d))
+#define U8_MAX			((u8)~0U)
+
+static inline u32 hash_32(u32 val, unsigned int bits)
+{
+	return (u32)(val * 0x9e370001U) >> (32 - bits);
+}
+
+#define BITS_PER_LONG		(8 * sizeof(long))
+#define BIT(nr)			(1UL << (nr))
+#define BIT_MASK(nr)		(1UL << ((nr) % BITS_PER_LONG))
+#define BIT_WORD(nr)		((nr) / BITS_PER_LONG)
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static inline void __set_bit(unsigned int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+
+static inline void __clear_bit(unsigned int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+
+#define set_bit(nr, addr)	__set_bit(nr, addr)
+#define clear_bit(nr, addr)	__clear_bit(nr, addr)
+
+static inline int test_bit(unsigned int nr, const unsigned long *addr)
+{
+	return (addr[BIT_WORD(nr)] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+static inline unsigned long int_sqrt(unsigned long x)
+{
+	unsigned long r = 0, b = 1UL << (BITS_PER_LONG - 2);
+
+	while (b > x)
+		b >>= 2;
+	while (b) {
+		if (x >= r + b) {
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+	return r;
+}
+
+/* ---- byte order (the bench only targets little-endian hosts) ---- */
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	const u8 *b = p;
+	return b[0] | b[1] << 8;
+}
+
+static inline u16 get_unaligned_be16(const void *p)
+{
+	const u8 *b = p;
+	return b[0] << 8 | b[1];
+}
+
+static inline u32 get_unaligned_le32(const void *p)
+{
+	const u8 *b = p;
+	return b[0] | b[1] << 8 | b[2] << 16 | (u32)b[3] << 24;
+}
+
+static inline u32 get_unaligned_be32(const void *p)
+{
+	const u8 *b = p;
+	return (u32)b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+}
+
+static inline u64 get_unaligned_le64(const void *p)
+{
+	const u8 *b = p;
+	return get_unaligned_le32(b) | (u64)get_unaligned_le32(b + 4) << 32;
+}
+
+#define le16_to_cpup(p)		get_unaligned_le16(p)
+#define be16_to_cpup(p)		get_unaligned_be16(p)
+#define le32_to_cpup(p)		get_unaligned_le32(p)
+#define le16_to_cpu(x)		((u16)(x))
+#define le32_to_cpu(x)		((u32)(x))
+#define cpu_to_le16(x)		((u16)(x))
+
+/* ---- module, memory, logging ---- */
+
+#define module_param(name, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_DEVICE_TABLE(type, name)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_VERSION(x)
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+
+#define GFP_KERNEL		0
+#define GFP_ATOMIC		0
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+	(void)flags;
+	return calloc(1, size);
+}
+
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+	(void)flags;
+	return calloc(n, size);
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+/* Managed allocations are never released; bench devices live until exit. */
+#define devm_kzalloc(dev, size, flags)		kzalloc(size, flags)
+#define devm_kcalloc(dev, n, size, flags)	kcalloc(n, size, flags)
+
+struct device {
+	struct device *parent;
+	void *driver_data;
+};
+
+extern int kshim_verbose;
+
+#define kshim_log(fmt, ...) \
+	do { if (kshim_verbose) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+
+#define dev_dbg(dev, fmt, ...)	do { (void)(dev); } while (0)
+#define dev_warn(dev, fmt, ...)	kshim_log(fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...)	kshim_log(fmt, ##__VA_ARGS__)
+#define hid_dbg(hdev, fmt, ...)	do { (void)(hdev); } while (0)
+#define hid_info(hdev, fmt, ...) kshim_log(fmt, ##__VA_ARGS__)
+#define hid_warn(hdev, fmt, ...) kshim_log(fmt, ##__VA_ARGS__)
+#define hid_err(hdev, fmt, ...)	kshim_log(fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...)	do { } while (0)
+#define pr_err(fmt, ...)	kshim_log(fmt, ##__VA_ARGS__)
+
+/* ---- locking and deferred work: the bench is single threaded ---- */
+
+typedef struct { int unused; } spinlock_t;
+struct mutex { int unused; };
+typedef struct { int unused; } wait_queue_head_t;
+struct kref { int refcount; };
+
+#define spin_lock_irqsave(lock, flags)		do { (void)(lock); (flags) = 0; } while (0)
+#define spin_unlock_irqrestore(lock, flags)	do { (void)(lock); (void)(flags); } while (0)
+#define mutex_lock(m)				do { (void)(m); } while (0)
+#define mutex_unlock(m)				do { (void)(m); } while (0)
+
+struct work_struct {
+	unsigned long scheduled;
+};
+
+struct delayed_work {
+	struct work_struct work;
+};
+
+static inline bool schedule_work(struct work_struct *work)
+{
+	work->scheduled++;
+	return true;
+}
+
+typedef s64 ktime_t;
+
+#define NSEC_PER_USEC	1000L
+#define NSEC_PER_MSEC	1000000L
+#define USEC_PER_SEC	1000000L
+#define NSEC_PER_SEC	1000000000L
+
+ktime_t ktime_get(void);
+
+static inline ktime_t ktime_sub_ns(ktime_t kt, u64 nsec)
+{
+	return kt - nsec;
+}
+
+static inline int ktime_compare(ktime_t cmp1, ktime_t cmp2)
+{
+	return cmp1 < cmp2 ? -1 : cmp1 > cmp2;
+}
+
+static inline s64 ktime_to_us(ktime_t kt)
+{
+	return kt / NSEC_PER_USEC;
+}
+
+static inline s64 ktime_us_delta(ktime_t later, ktime_t earlier)
+{
+	return ktime_to_us(later - earlier);
+}
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+struct hrtimer {
+	enum hrtimer_restart (*function)(struct hrtimer *);
+};
+
+/* ---- sysfs, leds, power supply: placeholders only ---- */
+
+struct kobject { int unused; };
+struct attribute { const char *name; };
+struct attribute_group { const char *name; struct attribute **attrs; };
+
+enum led_brightness {
+	LED_OFF		= 0,
+	LED_HALF	= 127,
+	LED_FULL	= 255,
+};
+
+struct led_classdev {
+	const char *name;
+	enum led_brightness brightness;
+	enum led_brightness max_brightness;
+};
+
+struct led_trigger {
+	const char *name;
+	unsigned long events;
+};
+
+void led_trigger_event(struct led_trigger *trigger,
+		       enum led_brightness event);
+
+enum {
+	POWER_SUPPLY_STATUS_UNKNOWN = 0,
+	POWER_SUPPLY_STATUS_CHARGING,
+	POWER_SUPPLY_STATUS_DISCHARGING,
+	POWER_SUPPLY_STATUS_NOT_CHARGING,
+	POWER_SUPPLY_STATUS_FULL,
+};
+
+struct power_supply_desc { const char *name; };
+struct power_supply { unsigned long changed; };
+
+void power_supply_changed(struct power_supply *psy);
+
+/* ---- kfifo: only the byte-record form used for remote/pen queues ---- */
+
+struct kfifo {
+	unsigned int in;
+	unsigned int out;
+	unsigned int mask;
+	unsigned char *data;
+};
+
+struct kfifo_rec_ptr_2 {
+	struct kfifo kfifo;
+};
+
+#define kfifo_in(fifo, buf, n)	kshim_kfifo_in((struct kfifo *)(fifo), buf, n)
+
+unsigned int kshim_kfifo_in(struct kfifo *fifo, const void *buf,
+			    unsigned int n);
+
+/* ---- usb ---- */
+
+struct usb_device { int unused; };
+struct usb_interface { int unused; };
+
+#define BUS_USB			0x03
+#define BUS_BLUETOOTH		0x05
+#define BUS_I2C			0x18
+
+/* ---- input core ---- */
+
+#define EVDEV_BITS(n)	BITS_TO_LONGS((n) + 1)
+
+struct input_id {
+	u16 bustype;
+	u16 vendor;
+	u16 product;
+	u16 version;
+};
+
+struct input_absinfo {
+	s32 value;
+	s32 minimum;
+	s32 maximum;
+	s32 fuzz;
+	s32 flat;
+	s32 resolution;
+};
+
+#define ABS_MT_FIRST		ABS_MT_TOUCH_MAJOR
+#define ABS_MT_LAST		ABS_MT_TOOL_Y
+
+#define MT_TOOL_FINGER		0x00
+#define MT_TOOL_PEN		0x01
+#define MT_TOOL_PALM		0x02
+
+#define INPUT_MT_POINTER	0x0001
+#define INPUT_MT_DIRECT		0x0002
+#define INPUT_MT_DROP_UNUSED	0x0004
+#define INPUT_MT_TRACK		0x0008
+#define INPUT_MT_SEMI_MT	0x0010
+
+struct input_mt_slot {
+	int abs[ABS_MT_LAST - ABS_MT_FIRST + 1];
+	unsigned int frame;
+	unsigned int key;
+};
+
+struct input_mt {
+	int trkid;
+	int num_slots;
+	int slot;
+	unsigned int flags;
+	unsigned int frame;
+	struct input_mt_slot slots[];
+};
+
+/*
+ * Per-device counters kept by the shim; these are what the bench
+ * reports as events/report. 'events' counts everything handed to
+ * input_event() after capability filtering, 'delivered' only what
+ * evdev would actually forward after duplicate suppression.
+ */
+struct input_stats {
+	unsigned long events;
+	unsigned long delivered;
+	unsigned long syncs;
+	unsigned long splits;	/* SYN_REPORTs the core inserted itself */
+	unsigned long mt_frames;
+};
+
+struct input_dev {
+	const char *name;
+	struct input_id id;
+	struct device dev;
+
+	unsigned long propbit[EVDEV_BITS(INPUT_PROP_MAX)];
+	unsigned long evbit[EVDEV_BITS(EV_MAX)];
+	unsigned long keybit[EVDEV_BITS(KEY_MAX)];
+	unsigned long relbit[EVDEV_BITS(REL_MAX)];
+	unsigned long absbit[EVDEV_BITS(ABS_MAX)];
+	unsigned long mscbit[EVDEV_BITS(MSC_MAX)];
+	unsigned long ledbit[EVDEV_BITS(LED_MAX)];
+	unsigned long swbit[EVDEV_BITS(SW_MAX)];
+
+	unsigned long key[EVDEV_BITS(KEY_MAX)];
+	unsigned long sw[EVDEV_BITS(SW_MAX)];
+
+	struct input_mt *mt;
+	struct input_absinfo *absinfo;
+
+	struct input_stats stats;
+	unsigned int num_vals;
+	unsigned int max_vals;
+	void *drvdata;
+};
+
+static inline void *input_get_drvdata(struct input_dev *dev)
+{
+	return dev->drvdata;
+}
+
+static inline void input_set_drvdata(struct input_dev *dev, void *data)
+{
+	dev->drvdata = data;
+}
+
+struct input_dev *input_allocate_device(void);
+void input_free_device(struct input_dev *dev);
+int input_register_device(struct input_dev *dev);
+
+void input_event(struct input_dev *dev, unsigned int type,
+		 unsigned int code, int value);
+void input_set_capability(struct input_dev *dev, unsigned int type,
+			  unsigned int code);
+void input_set_abs_params(struct input_dev *dev, unsigned int axis,
+			  int min, int max, int fuzz, int flat);
+void input_alloc_absinfo(struct input_dev *dev);
+
+static inline void input_report_key(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_KEY, code, !!value);
+}
+
+static inline void input_report_rel(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_REL, code, value);
+}
+
+static inline void input_report_abs(struct input_dev *dev, unsigned int code,
+				    int value)
+{
+	input_event(dev, EV_ABS, code, value);
+}
+
+static inline void input_report_switch(struct input_dev *dev,
+				       unsigned int code, int value)
+{
+	input_event(dev, EV_SW, code, !!value);
+}
+
+static inline void input_sync(struct input_dev *dev)
+{
+	input_event(dev, EV_SYN, SYN_REPORT, 0);
+}
+
+static inline void input_abs_set_res(struct input_dev *dev, unsigned int axis,
+				     int val)
+{
+	input_alloc_absinfo(dev);
+	if (dev->absinfo)
+		dev->absinfo[axis].resolution = val;
+}
+
+static inline int input_abs_get_res(struct input_dev *dev, unsigned int axis)
+{
+	return dev->absinfo ? dev->absinfo[axis].resolution : 0;
+}
+
+static inline int input_abs_get_max(struct input_dev *dev, unsigned int axis)
+{
+	return dev->absinfo ? dev->absinfo[axis].maximum : 0;
+}
+
+/* ---- multitouch ---- */
+
+static inline void input_mt_set_value(struct input_mt_slot *slot,
+				      unsigned code, int value)
+{
+	slot->abs[code - ABS_MT_FIRST] = value;
+}
+
+static inline int input_mt_get_value(const struct input_mt_slot *slot,
+				     unsigned code)
+{
+	return slot->abs[code - ABS_MT_FIRST];
+}
+
+static inline bool input_mt_is_active(const struct input_mt_slot *slot)
+{
+	return input_mt_get_value(slot, ABS_MT_TRACKING_ID) >= 0;
+}
+
+static inline bool input_mt_is_used(const struct input_mt *mt,
+				    const struct input_mt_slot *slot)
+{
+	return slot->frame == mt->frame;
+}
+
+static inline void input_mt_slot(struct input_dev *dev, int slot)
+{
+	input_event(dev, EV_ABS, ABS_MT_SLOT, slot);
+}
+
+int input_mt_init_slots(struct input_dev *dev, unsigned int num_slots,
+			unsigned int flags);
+bool input_mt_report_slot_state(struct input_dev *dev,
+				unsigned int tool_type, bool active);
+void input_mt_report_pointer_emulation(struct input_dev *dev,
+				       bool use_count);
+void input_mt_sync_frame(struct input_dev *dev);
+int input_mt_get_slot_by_key(struct input_dev *dev, int key);
+
+/* ---- hid core ---- */
+
+#define HID_MAX_IDS		256
+#define HID_MAX_FIELDS		256
+#define HID_ANY_ID		(~0)
+
+#define HID_INPUT_REPORT	0
+#define HID_OUTPUT_REPORT	1
+#define HID_FEATURE_REPORT	2
+#define HID_REPORT_TYPES	3
+
+#define HID_REQ_GET_REPORT	0x01
+#define HID_REQ_SET_REPORT	0x09
+
+#define HID_MAIN_ITEM_CONSTANT	0x001
+#define HID_MAIN_ITEM_VARIABLE	0x002
+#define HID_MAIN_ITEM_RELATIVE	0x004
+
+#define HID_COLLECTION_PHYSICAL		0
+#define HID_COLLECTION_APPLICATION	1
+#define HID_COLLECTION_LOGICAL		2
+
+#define HID_USAGE_PAGE		0xffff0000
+#define HID_USAGE		0x0000ffff
+
+#define HID_UP_UNDEFINED	0x00000000
+#define HID_UP_GENDESK		0x00010000
+#define HID_UP_BUTTON		0x00090000
+#define HID_UP_DIGITIZER	0x000d0000
+
+#define HID_GD_X		0x00010030
+#define HID_GD_Y		0x00010031
+#define HID_GD_Z		0x00010032
+
+#define HID_DG_DIGITIZER	0x000d0001
+#define HID_DG_PEN		0x000d0002
+#define HID_DG_TOUCHSCREEN	0x000d0004
+#define HID_DG_TOUCHPAD		0x000d0005
+#define HID_DG_STYLUS		0x000d0020
+#define HID_DG_PUCK		0x000d0021
+#define HID_DG_FINGER		0x000d0022
+#define HID_DG_TIPPRESSURE	0x000d0030
+#define HID_DG_BARRELPRESSURE	0x000d0031
+#define HID_DG_INRANGE		0x000d0032
+#define HID_DG_TOUCH		0x000d0033
+#define HID_DG_UNTOUCH		0x000d0034
+#define HID_DG_TAP		0x000d0035
+#define HID_DG_TABLETFUNCTIONKEY	0x000d0039
+#define HID_DG_PROGRAMCHANGEKEY	0x000d003a
+#define HID_DG_BATTERYSTRENGTH	0x000d003b
+#define HID_DG_INVERT		0x000d003c
+#define HID_DG_TILT_X		0x000d003d
+#define HID_DG_TILT_Y		0x000d003e
+#define HID_DG_TWIST		0x000d0041
+#define HID_DG_TIPSWITCH	0x000d0042
+#define HID_DG_TIPSWITCH2	0x000d0043
+#define HID_DG_BARRELSWITCH	0x000d0044
+#define HID_DG_ERASER		0x000d0045
+#define HID_DG_TABLETPICK	0x000d0046
+#define HID_DG_CONFIDENCE	0x000d0047
+#define HID_DG_WIDTH		0x000d0048
+#define HID_DG_HEIGHT		0x000d0049
+#define HID_DG_CONTACTID	0x000d0051
+#define HID_DG_INPUTMODE	0x000d0052
+#define HID_DG_DEVICEINDEX	0x000d0053
+#define HID_DG_CONTACTCOUNT	0x000d0054
+#define HID_DG_CONTACTMAX	0x000d0055
+#define HID_DG_SCANTIME		0x000d0056
+#define HID_DG_BUTTONTYPE	0x000d0059
+#define HID_DG_BARRELSWITCH2	0x000d005a
+#define HID_DG_TOOLSERIALNUMBER	0x000d005b
+
+#define HID_GROUP_GENERIC	0x0001
+#define HID_GROUP_WACOM		0x0101
+
+enum hid_type {
+	HID_TYPE_OTHER = 0,
+	HID_TYPE_USBMOUSE,
+	HID_TYPE_USBNONE,
+};
+
+struct hid_device_id {
+	u16 bus;
+	u16 group;
+	u32 vendor;
+	u32 product;
+	kernel_ulong_t driver_data;
+};
+
+#define HID_DEVICE(b, g, ven, prod) \
+	.bus = (b), .group = (g), .vendor = (ven), .product = (prod)
+#define HID_USB_DEVICE(ven, prod) \
+	.bus = BUS_USB, .vendor = (ven), .product = (prod)
+
+struct hid_usage {
+	unsigned hid;
+	unsigned collection_index;
+	unsigned usage_index;
+	__u16 code;
+	__u8 type;
+};
+
+struct hid_report;
+
+struct hid_field {
+	unsigned physical;
+	unsigned logical;
+	unsigned application;
+	struct hid_usage *usage;
+	unsigned maxusage;
+	unsigned flags;
+	unsigned report_offset;
+	unsigned report_size;
+	unsigned report_count;
+	unsigned report_type;
+	__s32 *value;
+	__s32 logical_minimum;
+	__s32 logical_maximum;
+	__s32 physical_minimum;
+	__s32 physical_maximum;
+	__s32 unit_exponent;
+	unsigned unit;
+	struct hid_report *report;
+	unsigned index;
+};
+
+struct hid_report {
+	unsigned id;
+	unsigned type;
+	struct hid_field *field[HID_MAX_FIELDS];
+	unsigned maxfield;
+	unsigned size;
+	struct hid_device *device;
+};
+
+struct hid_report_enum {
+	unsigned numbered;
+	struct hid_report *report_id_hash[HID_MAX_IDS];
+};
+
+struct hid_device {
+	u16 bus;
+	u16 group;
+	u32 vendor;
+	u32 product;
+	struct device dev;
+	struct hid_report_enum report_enum[HID_REPORT_TYPES];
+	void *driver_data;
+	unsigned long requests;
+	unsigned long input_reports;
+};
+
+static inline int hid_report_len(struct hid_report *report)
+{
+	return ((report->size - 1) >> 3) + 1 + (report->id > 0);
+}
+
+static inline void *hid_get_drvdata(struct hid_device *hdev)
+{
+	return hdev->driver_data;
+}
+
+static inline void hid_set_drvdata(struct hid_device *hdev, void *data)
+{
+	hdev->driver_data = data;
+}
+
+__s32 hidinput_calc_abs_res(const struct hid_field *field, __u16 code);
+__u32 hid_field_extract(const struct hid_device *hid, __u8 *report,
+			unsigned offset, unsigned n);
+void hid_hw_request(struct hid_device *hdev, struct hid_report *report,
+		    int reqtype);
+int hid_input_report(struct hid_device *hid, int type, u8 *data, u32 size,
+		     int interrupt);
+
+#endif /* WACOM_BENCH_KSHIM_H */
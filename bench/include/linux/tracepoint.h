@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Tracepoints compile away in the bench: every trace_*() call becomes an
+ * empty inline, as it would be with the tracepoint disabled.
+ */
+#ifndef KSHIM_TRACEPOINT_H
+#define KSHIM_TRACEPOINT_H
+
+#include "../kshim.h"
+
+#define PARAMS(args...)		args
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(template, name, proto, args)			\
+	static inline void trace_##name(proto) {}
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print)		\
+	static inline void trace_##name(proto) {}
+
+#endif
@@ -0,0 +1,2 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* nothing to instantiate, see linux/tracepoint.h */
@@ -0,0 +1,668 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * bench/kshim.c
+ *
+ *  Userspace implementations of the input, MT and HID core helpers that
+ *  4.5/wacom_wac.c calls into. The event filtering mirrors
+ *  drivers/input/input.c (capability checks, key state, abs defuzzing,
+ *  MT slot tracking, empty-frame suppression and the max_vals limit on
+ *  frame size) so that the number of events a decoder produces, and the
+ *  work it takes to produce them, is representative of a real kernel.
+ */
+
+#include "wacom_wac.h"
+#include "wacom.h"
+#include <linux/input/mt.h>
+#include <time.h>
+
+#define TRKID_MAX	0xffff
+#define TRKID_SGN	((TRKID_MAX + 1) >> 1)
+
+int kshim_verbose;
+
+/* ---- input core ---- */
+
+struct input_dev *input_allocate_device(void)
+{
+	struct input_dev *dev = kzalloc(sizeof(struct input_dev), GFP_KERNEL);
+
+	/* input_register_device() does this for every device */
+	if (dev)
+		__set_bit(EV_SYN, dev->evbit);
+	return dev;
+}
+
+void input_free_device(struct input_dev *dev)
+{
+	if (!dev)
+		return;
+	kfree(dev->absinfo);
+	kfree(dev->mt);
+	kfree(dev);
+}
+
+/* input_estimate_events_per_packet() */
+static unsigned int input_estimate_events_per_packet(struct input_dev *dev)
+{
+	unsigned int events;
+	int mt_slots;
+	int i;
+
+	if (dev->mt) {
+		mt_slots = dev->mt->num_slots;
+	} else if (test_bit(ABS_MT_TRACKING_ID, dev->absbit)) {
+		mt_slots = dev->absinfo[ABS_MT_TRACKING_ID].maximum -
+			   dev->absinfo[ABS_MT_TRACKING_ID].minimum + 1;
+		mt_slots = clamp_val(mt_slots, 2, 32);
+	} else if (test_bit(ABS_MT_POSITION_X, dev->absbit)) {
+		mt_slots = 2;
+	} else {
+		mt_slots = 0;
+	}
+
+	events = mt_slots + 1; /* count SYN_MT_REPORT and SYN_REPORT */
+
+	if (test_bit(EV_ABS, dev->evbit))
+		for (i = 0; i < ABS_CNT; i++)
+			if (test_bit(i, dev->absbit))
+				events += i == ABS_MT_SLOT ||
+					  (i >= ABS_MT_FIRST && i <= ABS_MT_LAST) ?
+					  mt_slots : 1;
+
+	if (test_bit(EV_REL, dev->evbit))
+		for (i = 0; i < REL_CNT; i++)
+			events += test_bit(i, dev->relbit);
+
+	/* Make room for KEY and MSC events */
+	events += 7;
+
+	return events;
+}
+
+/*
+ * Sizes the value buffer like the real input_register_device(): a frame
+ * that outgrows it is cut by a SYN_REPORT the core inserts itself.
+ */
+int input_register_device(struct input_dev *dev)
+{
+	dev->max_vals = input_estimate_events_per_packet(dev) + 2;
+	return 0;
+}
+
+void input_alloc_absinfo(struct input_dev *dev)
+{
+	if (!dev->absinfo)
+		dev->absinfo = kcalloc(ABS_CNT, sizeof(*dev->absinfo),
+				       GFP_KERNEL);
+}
+
+void input_set_abs_params(struct input_dev *dev, unsigned int axis,
+			  int min, int max, int fuzz, int flat)
+{
+	struct input_absinfo *absinfo;
+
+	input_alloc_absinfo(dev);
+	if (!dev->absinfo)
+		return;
+
+	absinfo = &dev->absinfo[axis];
+	absinfo->minimum = min;
+	absinfo->maximum = max;
+	absinfo->fuzz = fuzz;
+	absinfo->flat = flat;
+
+	__set_bit(EV_ABS, dev->evbit);
+	__set_bit(axis, dev->absbit);
+}
+
+void input_set_capability(struct input_dev *dev, unsigned int type,
+			  unsigned int code)
+{
+	switch (type) {
+	case EV_KEY:
+		__set_bit(code, dev->keybit);
+		break;
+	case EV_REL:
+		__set_bit(code, dev->relbit);
+		break;
+	case EV_ABS:
+		input_alloc_absinfo(dev);
+		__set_bit(code, dev->absbit);
+		break;
+	case EV_MSC:
+		__set_bit(code, dev->mscbit);
+		break;
+	case EV_SW:
+		__set_bit(code, dev->swbit);
+		break;
+	case EV_LED:
+		__set_bit(code, dev->ledbit);
+		break;
+	default:
+		return;
+	}
+
+	__set_bit(type, dev->evbit);
+}
+
+static int input_defuzz_abs_event(int value, int old_val, int fuzz)
+{
+	if (fuzz) {
+		if (value > old_val - fuzz / 2 && value < old_val + fuzz / 2)
+			return old_val;
+
+		if (value > old_val - fuzz && value < old_val + fuzz)
+			return (old_val * 3 + value) / 4;
+
+		if (value > old_val - fuzz * 2 && value < old_val + fuzz * 2)
+			return (old_val + value) / 2;
+	}
+
+	return value;
+}
+
+/*
+ * Returns the number of values that would be queued for handlers: 0 if
+ * the event is filtered, 2 if a pending ABS_MT_SLOT has to be flushed
+ * ahead of it.
+ */
+static int input_handle_abs_event(struct input_dev *dev, unsigned int code,
+				  int *pval)
+{
+	struct input_mt *mt = dev->mt;
+	bool is_mt_event;
+	int *pold;
+
+	if (code == ABS_MT_SLOT) {
+		if (mt && *pval >= 0 && *pval < mt->num_slots)
+			mt->slot = *pval;
+		return 0;
+	}
+
+	is_mt_event = code >= ABS_MT_FIRST && code <= ABS_MT_LAST;
+
+	if (!is_mt_event)
+		pold = &dev->absinfo[code].value;
+	else if (mt)
+		pold = &mt->slots[mt->slot].abs[code - ABS_MT_FIRST];
+	else
+		pold = NULL;
+
+	if (pold) {
+		*pval = input_defuzz_abs_event(*pval, *pold,
+					       dev->absinfo[code].fuzz);
+		if (*pold == *pval)
+			return 0;
+
+		*pold = *pval;
+	}
+
+	if (is_mt_event && mt && mt->slot != dev->absinfo[ABS_MT_SLOT].value) {
+		dev->absinfo[ABS_MT_SLOT].value = mt->slot;
+		return 2;
+	}
+
+	return 1;
+}
+
+void input_event(struct input_dev *dev, unsigned int type,
+		 unsigned int code, int value)
+{
+	int queued = 0;
+
+	if (!dev || type > EV_MAX || !test_bit(type, dev->evbit))
+		return;
+
+	dev->stats.events++;
+
+	switch (type) {
+	case EV_SYN:
+		if (code != SYN_REPORT)
+			return;
+		/* an empty frame is never passed on to handlers */
+		if (dev->num_vals) {
+			dev->stats.delivered += dev->num_vals + 1;
+			dev->stats.syncs++;
+		}
+		dev->num_vals = 0;
+		return;
+
+	case EV_KEY:
+		if (code <= KEY_MAX && test_bit(code, dev->keybit) &&
+		    !!test_bit(code, dev->key) != !!value) {
+			if (value)
+				__set_bit(code, dev->key);
+			else
+				__clear_bit(code, dev->key);
+			queued = 1;
+		}
+		break;
+
+	case EV_SW:
+		if (code <= SW_MAX && test_bit(code, dev->swbit) &&
+		    !!test_bit(code, dev->sw) != !!value) {
+			if (value)
+				__set_bit(code, dev->sw);
+			else
+				__clear_bit(code, dev->sw);
+			queued = 1;
+		}
+		break;
+
+	case EV_ABS:
+		if (code <= ABS_MAX && test_bit(code, dev->absbit))
+			queued = input_handle_abs_event(dev, code, &value);
+		break;
+
+	case EV_REL:
+		if (code <= REL_MAX && test_bit(code, dev->relbit) && value)
+			queued = 1;
+		break;
+
+	case EV_MSC:
+		if (code <= MSC_MAX && test_bit(code, dev->mscbit))
+			queued = 1;
+		break;
+	}
+
+	dev->num_vals += queued;
+
+	/* input_handle_event(): a full buffer goes out with its own sync */
+	if (dev->max_vals && dev->num_vals >= dev->max_vals - 2) {
+		dev->stats.delivered += dev->num_vals + 1;
+		dev->stats.syncs++;
+		dev->stats.splits++;
+		dev->num_vals = 0;
+	}
+}
+
+/* ---- multitouch ---- */
+
+static void input_copy_abs(struct input_dev *dst, unsigned int dst_axis,
+			   unsigned int src_axis)
+{
+	if (!test_bit(src_axis, dst->absbit))
+		return;
+
+	input_set_abs_params(dst, dst_axis,
+			     dst->absinfo[src_axis].minimum,
+			     dst->absinfo[src_axis].maximum,
+			     dst->absinfo[src_axis].fuzz,
+			     dst->absinfo[src_axis].flat);
+	dst->absinfo[dst_axis].resolution = dst->absinfo[src_axis].resolution;
+}
+
+int input_mt_init_slots(struct input_dev *dev, unsigned int num_slots,
+			unsigned int flags)
+{
+	struct input_mt *mt = dev->mt;
+	unsigned int i;
+
+	if (!num_slots)
+		return 0;
+	if (mt)
+		return mt->num_slots != num_slots ? -EINVAL : 0;
+
+	mt = calloc(1, sizeof(*mt) + num_slots * sizeof(*mt->slots));
+	if (!mt)
+		return -ENOMEM;
+
+	mt->num_slots = num_slots;
+	mt->flags = flags;
+	input_set_abs_params(dev, ABS_MT_SLOT, 0, num_slots - 1, 0, 0);
+	input_set_abs_params(dev, ABS_MT_TRACKING_ID, 0, TRKID_MAX, 0, 0);
+
+	if (flags & (INPUT_MT_POINTER | INPUT_MT_DIRECT)) {
+		__set_bit(EV_KEY, dev->evbit);
+		__set_bit(BTN_TOUCH, dev->keybit);
+
+		input_copy_abs(dev, ABS_X, ABS_MT_POSITION_X);
+		input_copy_abs(dev, ABS_Y, ABS_MT_POSITION_Y);
+		input_copy_abs(dev, ABS_PRESSURE, ABS_MT_PRESSURE);
+	}
+	if (flags & INPUT_MT_POINTER) {
+		__set_bit(BTN_TOOL_FINGER, dev->keybit);
+		__set_bit(BTN_TOOL_DOUBLETAP, dev->keybit);
+		if (num_slots >= 3)
+			__set_bit(BTN_TOOL_TRIPLETAP, dev->keybit);
+		if (num_slots >= 4)
+			__set_bit(BTN_TOOL_QUADTAP, dev->keybit);
+		if (num_slots >= 5)
+			__set_bit(BTN_TOOL_QUINTTAP, dev->keybit);
+		__set_bit(INPUT_PROP_POINTER, dev->propbit);
+	}
+	if (flags & INPUT_MT_DIRECT)
+		__set_bit(INPUT_PROP_DIRECT, dev->propbit);
+
+	/* Mark slots as 'inactive' */
+	for (i = 0; i < num_slots; i++)
+		input_mt_set_value(&mt->slots[i], ABS_MT_TRACKING_ID, -1);
+
+	/* Mark slots as 'unused' */
+	mt->frame = 1;
+
+	dev->mt = mt;
+	return 0;
+}
+
+bool input_mt_report_slot_state(struct input_dev *dev,
+				unsigned int tool_type, bool active)
+{
+	struct input_mt *mt = dev->mt;
+	struct input_mt_slot *slot;
+	int id;
+
+	if (!mt)
+		return false;
+
+	slot = &mt->slots[mt->slot];
+	slot->frame = mt->frame;
+
+	if (!active) {
+		input_event(dev, EV_ABS, ABS_MT_TRACKING_ID, -1);
+		return false;
+	}
+
+	id = input_mt_get_value(slot, ABS_MT_TRACKING_ID);
+	if (id < 0)
+		id = mt->trkid++ & TRKID_MAX;
+
+	input_event(dev, EV_ABS, ABS_MT_TRACKING_ID, id);
+	input_event(dev, EV_ABS, ABS_MT_TOOL_TYPE, tool_type);
+
+	return true;
+}
+
+static void input_mt_report_finger_count(struct input_dev *dev, int count)
+{
+	input_event(dev, EV_KEY, BTN_TOOL_FINGER, count == 1);
+	input_event(dev, EV_KEY, BTN_TOOL_DOUBLETAP, count == 2);
+	input_event(dev, EV_KEY, BTN_TOOL_TRIPLETAP, count == 3);
+	input_event(dev, EV_KEY, BTN_TOOL_QUADTAP, count == 4);
+	input_event(dev, EV_KEY, BTN_TOOL_QUINTTAP, count == 5);
+}
+
+void input_mt_report_pointer_emulation(struct input_dev *dev, bool use_count)
+{
+	struct input_mt *mt = dev->mt;
+	struct input_mt_slot *oldest;
+	int oldid, count, i;
+
+	if (!mt)
+		return;
+
+	oldest = NULL;
+	oldid = mt->trkid;
+	count = 0;
+
+	for (i = 0; i < mt->num_slots; ++i) {
+		struct input_mt_slot *ps = &mt->slots[i];
+		int id = input_mt_get_value(ps, ABS_MT_TRACKING_ID);
+
+		if (id < 0)
+			continue;
+		if ((id - oldid) & TRKID_SGN) {
+			oldest = ps;
+			oldid = id;
+		}
+		count++;
+	}
+
+	input_event(dev, EV_KEY, BTN_TOUCH, count > 0);
+
+	if (use_count)
+		input_mt_report_finger_count(dev, count);
+
+	if (oldest) {
+		int x = input_mt_get_value(oldest, ABS_MT_POSITION_X);
+		int y = input_mt_get_value(oldest, ABS_MT_POSITION_Y);
+
+		input_event(dev, EV_ABS, ABS_X, x);
+		input_event(dev, EV_ABS, ABS_Y, y);
+
+		if (test_bit(ABS_MT_PRESSURE, dev->absbit)) {
+			int p = input_mt_get_value(oldest, ABS_MT_PRESSURE);
+
+			input_event(dev, EV_ABS, ABS_PRESSURE, p);
+		}
+	} else {
+		if (test_bit(ABS_MT_PRESSURE, dev->absbit))
+			input_event(dev, EV_ABS, ABS_PRESSURE, 0);
+	}
+}
+
+static void input_mt_drop_unused(struct input_dev *dev)
+{
+	struct input_mt *mt = dev->mt;
+	int i;
+
+	for (i = 0; i < mt->num_slots; i++) {
+		if (!input_mt_is_used(mt, &mt->slots[i])) {
+			input_mt_slot(dev, i);
+			input_event(dev, EV_ABS, ABS_MT_TRACKING_ID, -1);
+		}
+	}
+}
+
+void input_mt_sync_frame(struct input_dev *dev)
+{
+	struct input_mt *mt = dev->mt;
+	bool use_count = false;
+
+	if (!mt)
+		return;
+
+	if (mt->flags & INPUT_MT_DROP_UNUSED)
+		input_mt_drop_unused(dev);
+
+	if ((mt->flags & INPUT_MT_POINTER) && !(mt->flags & INPUT_MT_SEMI_MT))
+		use_count = true;
+
+	input_mt_report_pointer_emulation(dev, use_count);
+
+	mt->frame++;
+	dev->stats.mt_frames++;
+}
+
+int input_mt_get_slot_by_key(struct input_dev *dev, int key)
+{
+	struct input_mt *mt = dev->mt;
+	struct input_mt_slot *s;
+
+	if (!mt)
+		return -1;
+
+	for (s = mt->slots; s != mt->slots + mt->num_slots; s++)
+		if (input_mt_is_active(s) && s->key == key)
+			return s - mt->slots;
+
+	for (s = mt->slots; s != mt->slots + mt->num_slots; s++)
+		if (!input_mt_is_active(s) && !input_mt_is_used(mt, s)) {
+			s->key = key;
+			return s - mt->slots;
+		}
+
+	return -1;
+}
+
+/* ---- hid core ---- */
+
+__s32 hidinput_calc_abs_res(const struct hid_field *field, __u16 code)
+{
+	__s32 unit_exponent = field->unit_exponent;
+	__s32 logical_extents = field->logical_maximum -
+					field->logical_minimum;
+	__s32 physical_extents = field->physical_maximum -
+					field->physical_minimum;
+	__s32 prev;
+
+	/* Check if the extents are sane */
+	if (logical_extents <= 0 || physical_extents <= 0)
+		return 0;
+
+	switch (code) {
+	case ABS_X:
+	case ABS_Y:
+	case ABS_Z:
+	case ABS_MT_POSITION_X:
+	case ABS_MT_POSITION_Y:
+	case ABS_MT_TOOL_X:
+	case ABS_MT_TOOL_Y:
+	case ABS_MT_TOUCH_MAJOR:
+	case ABS_MT_TOUCH_MINOR:
+		if (field->unit == 0x11) {		/* If centimeters */
+			/* Convert to millimeters */
+			unit_exponent += 1;
+		} else if (field->unit == 0x13) {	/* If inches */
+			/* Convert to millimeters */
+			prev = physical_extents;
+			physical_extents *= 254;
+			if (physical_extents < prev)
+				return 0;
+			unit_exponent -= 1;
+		} else {
+			return 0;
+		}
+		break;
+
+	case ABS_RX:
+	case ABS_RY:
+	case ABS_RZ:
+	case ABS_WHEEL:
+	case ABS_TILT_X:
+	case ABS_TILT_Y:
+		if (field->unit == 0x14) {		/* If degrees */
+			/* Convert to radians */
+			prev = logical_extents;
+			logical_extents *= 573;
+			if (logical_extents < prev)
+				return 0;
+			unit_exponent += 1;
+		} else if (field->unit != 0x12) {	/* If not radians */
+			return 0;
+		}
+		break;
+
+	default:
+		return 0;
+	}
+
+	/* Apply negative unit exponent */
+	for (; unit_exponent < 0; unit_exponent++) {
+		prev = logical_extents;
+		logical_extents *= 10;
+		if (logical_extents < prev)
+			return 0;
+	}
+	/* Apply positive unit exponent */
+	for (; unit_exponent > 0; unit_exponent--) {
+		prev = physical_extents;
+		physical_extents *= 10;
+		if (physical_extents < prev)
+			return 0;
+	}
+
+	/* Calculate resolution */
+	return DIV_ROUND_CLOSEST(logical_extents, physical_extents);
+}
+
+__u32 hid_field_extract(const struct hid_device *hid, __u8 *report,
+			unsigned offset, unsigned n)
+{
+	unsigned int idx = offset / 8;
+	unsigned int bit_nr = 0;
+	unsigned int bit_shift = offset % 8;
+	int bits_to_copy = 8 - bit_shift;
+	int left = n;
+	u32 value = 0;
+	u32 mask = n < 32 ? (1U << n) - 1 : ~0U;
+
+	(void)hid;
+
+	while (left > 0) {
+		value |= ((u32)report[idx] >> bit_shift) << bit_nr;
+		left -= bits_to_copy;
+		bit_nr += bits_to_copy;
+		bits_to_copy = 8;
+		bit_shift = 0;
+		idx++;
+	}
+
+	return value & mask;
+}
+
+void hid_hw_request(struct hid_device *hdev, struct hid_report *report,
+		    int reqtype)
+{
+	(void)report;
+	(void)reqtype;
+	hdev->requests++;
+}
+
+int hid_input_report(struct hid_device *hid, int type, u8 *data, u32 size,
+		     int interrupt)
+{
+	(void)type;
+	(void)data;
+	(void)size;
+	(void)interrupt;
+	if (hid)
+		hid->input_reports++;
+	return 0;
+}
+
+/* ---- everything else ---- */
+
+ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ktime_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+unsigned int kshim_kfifo_in(struct kfifo *fifo, const void *buf,
+			    unsigned int n)
+{
+	(void)buf;
+	fifo->in += n;
+	return n;
+}
+
+void power_supply_changed(struct power_supply *psy)
+{
+	psy->changed++;
+}
+
+void led_trigger_event(struct led_trigger *trigger,
+		       enum led_brightness event)
+{
+	(void)event;
+	trigger->events++;
+}
+
+/*
+ * The LED bookkeeping lives in wacom_sys.c, which the bench does not
+ * build; report no LEDs so wacom_update_led() takes its early exits.
+ */
+struct wacom_led *wacom_led_find(struct wacom *wacom, unsigned int group_id,
+				 unsigned int id)
+{
+	(void)wacom;
+	(void)group_id;
+	(void)id;
+	return NULL;
+}
+
+struct wacom_led *wacom_led_next(struct wacom *wacom, struct wacom_led *cur)
+{
+	(void)wacom;
+	(void)cur;
+	return NULL;
+}
+
+enum led_brightness wacom_leds_brightness_get(struct wacom_led *led)
+{
+	(void)led;
+	return LED_OFF;
+}
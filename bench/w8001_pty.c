@@ -0,0 +1,693 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * bench/w8001_pty.c
+ *
+ *  Compares the two ways inputattach can drive a W8001 serial digitizer:
+ *  the serport line discipline feeding wacom_w8001.ko ("kernel") and the
+ *  userspace decoder feeding /dev/uinput ("uinput").
+ *
+ *  The digitizer is emulated on the master side of a pty pair: the bench
+ *  answers the driver's queries like a penabled 2FG Tablet PC, starts
+ *  inputattach on the slave side and reads back the evdev nodes that show
+ *  up for it. As in wacom_uhid, a paced pass gives the latency from the
+ *  write() of a packet to its SYN_REPORT timestamp and an unpaced pass the
+ *  sustained packet rate. CPU time is taken from /proc for both the
+ *  inputattach process and the whole system, since the kernel path does
+ *  its work in kworkers rather than in inputattach.
+ *
+ *  The kernel path needs serport and wacom_w8001 loaded, the uinput path
+ *  /dev/uinput. Both need access to /dev/input/event*.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#define PTY_MAX_NODES		4
+#define PTY_PROBE_TIMEOUT_MS	8000
+#define PTY_SETTLE_MS		500
+#define PTY_DRAIN_MS		200
+
+#define W8001_PKTLEN_TPCPEN	9
+#define W8001_PKTLEN_TPCCTL	11
+#define W8001_PKTLEN_TOUCH2FG	13
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define min(a, b)		((a) < (b) ? (a) : (b))
+
+typedef uint8_t u8;
+typedef uint64_t u64;
+
+/* replies of a penabled 2FG Tablet PC: pen 24515x15107, touch 4096x4096 */
+static const u8 pen_query[W8001_PKTLEN_TPCCTL] = {
+	0xc0, 0x2f, 0x70, 0x1d, 0x40, 0x07, 0x7f, 0x00, 0x00, 0x00, 0x00,
+};
+static const u8 touch_query[W8001_PKTLEN_TPCCTL] = {
+	0xc0, 0x0a, 0x05, 0x08, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+struct pty_packet {
+	int len;
+	u8 data[W8001_PKTLEN_TOUCH2FG];
+};
+
+struct pty_scenario {
+	const char *name;
+	const char *desc;
+	int (*generate)(int i, u8 *data);
+};
+
+/* a point moving back and forth so that every packet changes something */
+static unsigned stroke(int i, unsigned lo, unsigned hi)
+{
+	unsigned span = hi - lo, pos = (i * 37) % (2 * span);
+
+	return lo + (pos < span ? pos : 2 * span - pos);
+}
+
+static int generate_pen(int i, u8 *data)
+{
+	unsigned x = stroke(i, 1000, 20000);
+	unsigned y = stroke(i * 3, 1000, 14000);
+	unsigned p = stroke(i * 7, 100, 900);
+
+	data[0] = 0x80 | 0x20 | 0x01;	/* lead, in range, tip */
+	data[1] = (x >> 9) & 0x7f;
+	data[2] = (x >> 2) & 0x7f;
+	data[3] = (y >> 9) & 0x7f;
+	data[4] = (y >> 2) & 0x7f;
+	data[5] = p & 0x7f;
+	data[6] = (x & 3) << 5 | (y & 3) << 3 | ((p >> 7) & 7);
+	data[7] = 0;
+	data[8] = 0;
+	return W8001_PKTLEN_TPCPEN;
+}
+
+static int generate_touch(int i, u8 *data)
+{
+	unsigned x = stroke(i, 100, 4000);
+	unsigned y = stroke(i * 3, 100, 4000);
+
+	memset(data, 0, W8001_PKTLEN_TOUCH2FG);
+	data[0] = 0x90 | 0x01;		/* touch lead, first finger down */
+	data[1] = (x >> 7) & 0x7f;
+	data[2] = x & 0x7f;
+	data[3] = (y >> 7) & 0x7f;
+	data[4] = y & 0x7f;
+	return W8001_PKTLEN_TOUCH2FG;
+}
+
+static const struct pty_scenario scenarios[] = {
+	{ "pen",	"9-byte pen packets, tip down",		generate_pen },
+	{ "touch",	"13-byte 2FG packets, one finger",	generate_touch },
+};
+
+static const char * const paths[] = { "kernel", "uinput" };
+
+struct pty_bench {
+	const struct pty_scenario *sc;
+	bool uinput;
+	const char *inputattach;
+
+	int master;
+	int epoll_fd;
+	char slave[64];
+	char phys[64];
+	pid_t pid;
+	int node_fd[PTY_MAX_NODES];
+	int nodes;
+
+	pthread_t reader;
+	volatile bool stop;
+
+	/* filled by the reader thread */
+	pthread_mutex_t lock;
+	u64 *frames;		/* SYN_REPORT times, ns */
+	long nframes;
+	long max_frames;
+	long dropped;		/* SYN_DROPPED seen */
+	u64 last_event;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Play the digitizer: answer the pen and touch queries */
+static void pty_answer(struct pty_bench *b)
+{
+	u8 cmd[64];
+	ssize_t n;
+	int i;
+
+	while ((n = read(b->master, cmd, sizeof(cmd))) > 0) {
+		for (i = 0; i < n; i++) {
+			if (cmd[i] == '*' &&
+			    write(b->master, pen_query, sizeof(pen_query)) < 0)
+				perror("pty");
+			if (cmd[i] == '%' &&
+			    write(b->master, touch_query, sizeof(touch_query)) < 0)
+				perror("pty");
+			/* '0' stop and '1' start need no answer */
+		}
+	}
+}
+
+static void evdev_drain(struct pty_bench *b, int fd)
+{
+	struct input_event ev[64];
+	ssize_t n;
+	int i;
+
+	while ((n = read(fd, ev, sizeof(ev))) > 0) {
+		pthread_mutex_lock(&b->lock);
+		for (i = 0; i < n / (ssize_t)sizeof(ev[0]); i++) {
+			u64 t;
+
+			if (ev[i].type != EV_SYN)
+				continue;
+#ifdef input_event_sec
+			t = (u64)ev[i].input_event_sec * 1000000000ULL +
+			    (u64)ev[i].input_event_usec * 1000ULL;
+#else
+			t = (u64)ev[i].time.tv_sec * 1000000000ULL +
+			    (u64)ev[i].time.tv_usec * 1000ULL;
+#endif
+			if (ev[i].code == SYN_DROPPED)
+				b->dropped++;
+			else if (ev[i].code == SYN_REPORT &&
+				 b->nframes < b->max_frames)
+				b->frames[b->nframes++] = t;
+		}
+		b->last_event = now_ns();
+		pthread_mutex_unlock(&b->lock);
+	}
+}
+
+static void *pty_reader(void *data)
+{
+	struct pty_bench *b = data;
+	struct epoll_event ev[PTY_MAX_NODES + 1];
+	int n, i;
+
+	while (!b->stop) {
+		n = epoll_wait(b->epoll_fd, ev, ARRAY_SIZE(ev), 50);
+		for (i = 0; i < n; i++) {
+			if (ev[i].data.fd == b->master)
+				pty_answer(b);
+			else
+				evdev_drain(b, ev[i].data.fd);
+		}
+	}
+	return NULL;
+}
+
+static int pty_open(struct pty_bench *b)
+{
+	struct epoll_event ee = { .events = EPOLLIN };
+	struct termios t;
+	unsigned int n;
+
+	b->master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (b->master < 0 || grantpt(b->master) || unlockpt(b->master) ||
+	    ioctl(b->master, TIOCGPTN, &n) < 0)
+		return -errno;
+
+	/* nothing may be translated on the way to the slave */
+	tcgetattr(b->master, &t);
+	cfmakeraw(&t);
+	tcsetattr(b->master, TCSANOW, &t);
+	fcntl(b->master, F_SETFL, O_NONBLOCK);
+
+	snprintf(b->slave, sizeof(b->slave), "/dev/pts/%u", n);
+	/* what serport and the uinput bridge put in the evdev phys */
+	snprintf(b->phys, sizeof(b->phys), "pts%u/serio0/input0", n);
+
+	ee.data.fd = b->master;
+	if (epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->master, &ee))
+		return -errno;
+
+	return 0;
+}
+
+static int inputattach_start(struct pty_bench *b)
+{
+	char *argv[5];
+	int argc = 0;
+
+	argv[argc++] = (char *)b->inputattach;
+	if (b->uinput)
+		argv[argc++] = "--uinput";
+	argv[argc++] = "--wacom";
+	argv[argc++] = b->slave;
+	argv[argc] = NULL;
+
+	b->pid = fork();
+	if (b->pid < 0)
+		return -errno;
+
+	if (!b->pid) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	return 0;
+}
+
+/* Is this node one that was registered for our pty? */
+static bool evdev_ours(struct pty_bench *b, const char *path)
+{
+	char phys[64] = "";
+	bool ours;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		return false;
+
+	ours = ioctl(fd, EVIOCGPHYS(sizeof(phys) - 1), phys) >= 0 &&
+	       !strcmp(phys, b->phys);
+	close(fd);
+	return ours;
+}
+
+/* Wait for the pen and touch nodes, as evdev_attach() in wacom_uhid */
+static int evdev_attach(struct pty_bench *b)
+{
+	char seen[PTY_MAX_NODES][sizeof(((struct dirent *)0)->d_name)];
+	u64 start = now_ns(), stable = 0;
+	int i;
+
+	while (now_ns() - start < PTY_PROBE_TIMEOUT_MS * 1000000ULL) {
+		struct dirent *de;
+		DIR *dir = opendir("/dev/input");
+		int before = b->nodes;
+
+		if (!dir)
+			return -errno;
+
+		while ((de = readdir(dir)) && b->nodes < PTY_MAX_NODES) {
+			char path[300];
+			bool dup = false;
+			int clock = CLOCK_MONOTONIC;
+			struct epoll_event ee = { .events = EPOLLIN };
+			int fd;
+
+			if (strncmp(de->d_name, "event", 5))
+				continue;
+			for (i = 0; i < b->nodes; i++)
+				dup |= !strcmp(seen[i], de->d_name);
+			if (dup)
+				continue;
+
+			snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+			if (!evdev_ours(b, path))
+				continue;
+
+			fd = open(path, O_RDONLY | O_NONBLOCK);
+			if (fd < 0)
+				continue;
+			if (ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+				close(fd);
+				continue;
+			}
+
+			ee.data.fd = fd;
+			epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, fd, &ee);
+			snprintf(seen[b->nodes], sizeof(seen[0]), "%s", de->d_name);
+			b->node_fd[b->nodes++] = fd;
+		}
+		closedir(dir);
+
+		if (b->nodes != before)
+			stable = now_ns();
+		else if (b->nodes && now_ns() - stable > PTY_SETTLE_MS * 1000000ULL)
+			return 0;
+
+		usleep(20000);
+	}
+
+	return b->nodes ? 0 : -ENODEV;
+}
+
+static void pty_destroy(struct pty_bench *b)
+{
+	int i;
+
+	if (b->pid > 0) {
+		kill(b->pid, SIGTERM);
+		waitpid(b->pid, NULL, 0);
+	}
+
+	b->stop = true;
+	pthread_join(b->reader, NULL);
+
+	for (i = 0; i < b->nodes; i++)
+		close(b->node_fd[i]);
+	close(b->master);
+	close(b->epoll_fd);
+}
+
+/* ---- measurement ---- */
+
+struct cpu_times {
+	u64 process;		/* inputattach utime + stime, ticks */
+	u64 system;		/* all CPUs, busy ticks */
+};
+
+static void cpu_sample(pid_t pid, struct cpu_times *t)
+{
+	unsigned long long v[8] = { 0 };
+	unsigned long ut = 0, st = 0;
+	char path[64], buf[1024], *p;
+	FILE *f;
+	int i;
+
+	memset(t, 0, sizeof(*t));
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	f = fopen(path, "r");
+	if (f) {
+		if (fgets(buf, sizeof(buf), f) && (p = strrchr(buf, ')')) &&
+		    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			   &ut, &st) == 2)
+			t->process = ut + st;
+		fclose(f);
+	}
+
+	f = fopen("/proc/stat", "r");
+	if (f) {
+		/* user nice system idle iowait irq softirq steal */
+		if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+			   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+			   &v[7]) >= 4)
+			for (i = 0; i < 8; i++)
+				if (i != 3 && i != 4)
+					t->system += v[i];
+		fclose(f);
+	}
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void wait_drained(struct pty_bench *b)
+{
+	for (;;) {
+		u64 last;
+
+		usleep(PTY_DRAIN_MS * 1000 / 4);
+		pthread_mutex_lock(&b->lock);
+		last = b->last_event;
+		pthread_mutex_unlock(&b->lock);
+		if (now_ns() - last > PTY_DRAIN_MS * 1000000ULL)
+			return;
+	}
+}
+
+static int pty_write(int fd, const u8 *data, int len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, data, len);
+		if (n < 0 && errno == EAGAIN) {
+			/* the slave has not caught up yet */
+			usleep(50);
+			continue;
+		}
+		if (n < 0)
+			return -errno;
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Write 'count' packets every 'interval_us' (0: back to back) and record
+ * when each write was issued.
+ */
+static int inject(struct pty_bench *b, const struct pty_packet *packets,
+		  long count, long interval_us, u64 *written)
+{
+	struct timespec next;
+	long i;
+	int ret;
+
+	pthread_mutex_lock(&b->lock);
+	b->nframes = 0;
+	b->dropped = 0;
+	pthread_mutex_unlock(&b->lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < count; i++) {
+		if (interval_us) {
+			next.tv_nsec += interval_us * 1000;
+			while (next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+
+		written[i] = now_ns();
+		ret = pty_write(b->master, packets[i].data, packets[i].len);
+		if (ret)
+			return ret;
+	}
+
+	wait_drained(b);
+	return 0;
+}
+
+/* Pair each frame with the last packet written before it */
+static long match_frames(struct pty_bench *b, const u64 *written, long count,
+			 u64 *latency)
+{
+	long f, n = 0, w = 0;
+
+	for (f = 0; f < b->nframes; f++) {
+		u64 t = b->frames[f];
+
+		while (w + 1 < count && written[w + 1] <= t)
+			w++;
+		if (written[w] > t)
+			continue;
+		latency[n++] = t - written[w];
+	}
+
+	return n;
+}
+
+static int pty_run(const struct pty_scenario *sc, bool uinput,
+		   const char *inputattach, long count, long interval_us)
+{
+	struct pty_bench b;
+	struct pty_packet *packets;
+	struct cpu_times t0, t1;
+	u64 *written, *latency;
+	long i, n, frames, dropped;
+	double rate, ticks = sysconf(_SC_CLK_TCK);
+	const char *path = paths[uinput];
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	b.sc = sc;
+	b.uinput = uinput;
+	b.inputattach = inputattach;
+	pthread_mutex_init(&b.lock, NULL);
+
+	packets = calloc(count, sizeof(*packets));
+	written = calloc(count, sizeof(*written));
+	b.max_frames = count * 2;
+	b.frames = calloc(b.max_frames, sizeof(*b.frames));
+	latency = calloc(b.max_frames, sizeof(*latency));
+	if (!packets || !written || !b.frames || !latency) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < count; i++)
+		packets[i].len = sc->generate(i, packets[i].data);
+
+	b.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	ret = pty_open(&b);
+	if (!ret)
+		ret = pthread_create(&b.reader, NULL, pty_reader, &b);
+	if (!ret)
+		ret = inputattach_start(&b);
+	if (ret) {
+		fprintf(stderr, "%s/%s: cannot set up the pty: %s\n",
+			sc->name, path, strerror(ret < 0 ? -ret : ret));
+		exit(1);
+	}
+
+	ret = evdev_attach(&b);
+	if (ret) {
+		fprintf(stderr, "%s/%s: no evdev node showed up for %s; %s\n",
+			sc->name, path, b.slave, uinput ?
+			"is /dev/uinput writable?" :
+			"are serport and wacom_w8001 loaded?");
+		ret = 1;
+		goto out;
+	}
+
+	/* paced pass: latency */
+	ret = inject(&b, packets, count, interval_us, written);
+	if (ret)
+		goto out_err;
+
+	pthread_mutex_lock(&b.lock);
+	n = match_frames(&b, written, count, latency);
+	frames = b.nframes;
+	dropped = b.dropped;
+	pthread_mutex_unlock(&b.lock);
+	qsort(latency, n, sizeof(*latency), cmp_u64);
+
+	/* unpaced pass: sustained rate and CPU cost */
+	cpu_sample(b.pid, &t0);
+	ret = inject(&b, packets, count, 0, written);
+	cpu_sample(b.pid, &t1);
+	if (ret)
+		goto out_err;
+
+	pthread_mutex_lock(&b.lock);
+	rate = b.nframes ?
+	       count * 1e9 / (double)(b.frames[b.nframes - 1] - written[0]) : 0;
+	dropped += b.dropped;
+	pthread_mutex_unlock(&b.lock);
+
+	if (!n) {
+		printf("%-6s %-7s %8ld %8ld  no frames matched\n",
+		       sc->name, path, count, frames);
+	} else {
+		printf("%-6s %-7s %8ld %8ld %8.1f %8.1f %8.1f %8.1f %10.0f %6ld %9.2f %9.2f\n",
+		       sc->name, path, count, frames,
+		       latency[n / 2] / 1e3,
+		       latency[min(n - 1, n * 99 / 100)] / 1e3,
+		       latency[min(n - 1, n * 999 / 1000)] / 1e3,
+		       latency[n - 1] / 1e3, rate, dropped,
+		       (t1.process - t0.process) * 1e6 / ticks / count,
+		       (t1.system - t0.system) * 1e6 / ticks / count);
+	}
+	ret = 0;
+	goto out;
+
+out_err:
+	fprintf(stderr, "%s/%s: pty write failed: %s\n", sc->name, path,
+		strerror(-ret));
+	ret = 1;
+out:
+	pty_destroy(&b);
+	free(b.frames);
+	pthread_mutex_destroy(&b.lock);
+	free(packets);
+	free(written);
+	free(latency);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-a inputattach] [-m kernel|uinput] [-n count] [-i interval_us] [-s scenario] [-l]\n"
+		"  -a  inputattach to run (default ../inputattach/inputattach)\n"
+		"  -m  only measure this path (default both)\n"
+		"  -n  packets per pass (default 5000)\n"
+		"  -i  interval between packets in the paced pass (default 1000)\n"
+		"  -s  only run this scenario\n"
+		"  -l  list scenarios\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *inputattach = "../inputattach/inputattach";
+	const char *only = NULL;
+	long count = 5000, interval_us = 1000;
+	int mode = -1;
+	int opt, ret = 0;
+	unsigned i, m;
+
+	while ((opt = getopt(argc, argv, "a:m:n:i:s:lh")) != -1) {
+		switch (opt) {
+		case 'a':
+			inputattach = optarg;
+			break;
+		case 'm':
+			for (m = 0; m < ARRAY_SIZE(paths); m++)
+				if (!strcmp(optarg, paths[m]))
+					mode = m;
+			if (mode < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			count = atol(optarg);
+			if (count < 1)
+				count = 1;
+			break;
+		case 'i':
+			interval_us = atol(optarg);
+			if (interval_us < 1)
+				interval_us = 1;
+			break;
+		case 's':
+			only = optarg;
+			break;
+		case 'l':
+			for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+				printf("%-8s %s\n", scenarios[i].name,
+				       scenarios[i].desc);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%-6s %-7s %8s %8s %8s %8s %8s %8s %10s %6s %9s %9s\n",
+	       "packet", "path", "packets", "frames", "p50 us", "p99 us",
+	       "p999 us", "max us", "packets/s", "drops", "proc us/p", "sys us/p");
+
+	for (i = 0; i < ARRAY_SIZE(scenarios); i++) {
+		if (only && strcmp(only, scenarios[i].name))
+			continue;
+		for (m = 0; m < ARRAY_SIZE(paths); m++) {
+			if (mode >= 0 && mode != (int)m)
+				continue;
+			ret |= pty_run(&scenarios[i], m, inputattach, count,
+				       interval_us);
+		}
+	}
+
+	return ret;
+}
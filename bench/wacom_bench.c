@@ -0,0 +1,1207 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * bench/wacom_bench.c
+ *
+ *  Userspace benchmark for the report decoders in 4.5/wacom_wac.c.
+ *
+ *  Each scenario instantiates a device the way wacom_parse_and_register()
+ *  would (features from wacom_ids, quirks, input capabilities and, for
+ *  HID_GENERIC, usage mapping over a synthetic report descriptor), feeds
+ *  it a stream of protocol-correct raw reports and times the driver's
+ *  share of the work: wacom_raw_event() (memcpy + wacom_wac_irq()) and,
+ *  for HID_GENERIC, wacom_wac_report() once hid-core has extracted the
+ *  field values. Streams can also be replayed from a recording.
+ */
+
+#include <ctype.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "wacom_wac.h"
+#include "wacom.h"
+#include <linux/input/mt.h>
+
+#define BENCH_STREAM_LEN	1024
+#define BENCH_MAX_SAMPLES	(1 << 22)
+
+struct bench_report {
+	int len;
+	u8 data[WACOM_PKGLEN_MAX];
+};
+
+struct bench_stream {
+	struct bench_report *reports;
+	int count;
+	int size;
+};
+
+struct bench_dev {
+	struct wacom *wacom;
+	struct hid_device hdev;
+	struct wacom_shared shared;
+};
+
+struct bench_scenario {
+	const char *name;
+	const char *desc;
+	u16 bus;
+	u32 product;
+	int device_type;	/* interface type, normally taken from the descriptor */
+	int pktlen;
+	int touch_max;		/* override, normally from HID_DG_CONTACTMAX */
+	void (*describe)(struct bench_dev *dev);
+	void (*generate)(struct bench_dev *dev, struct bench_stream *stream);
+};
+
+static int iterations = 200;
+
+/* the values of the pen_frames sysfs attribute */
+static const char * const pen_frames_names[WACOM_PEN_FRAMES_MAX] = {
+	[WACOM_PEN_FRAMES_EACH]		= "each",
+	[WACOM_PEN_FRAMES_COALESCE]	= "coalesce",
+	[WACOM_PEN_FRAMES_SUMMARY]	= "summary",
+};
+static int pen_frames = WACOM_PEN_FRAMES_EACH;
+
+static struct bench_report *stream_add(struct bench_stream *stream, int len)
+{
+	struct bench_report *r;
+
+	if (stream->count == stream->size) {
+		stream->size = stream->size ? stream->size * 2 : 256;
+		stream->reports = realloc(stream->reports,
+					  stream->size * sizeof(*stream->reports));
+		if (!stream->reports) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	r = &stream->reports[stream->count++];
+	memset(r, 0, sizeof(*r));
+	r->len = len;
+	return r;
+}
+
+static void put_le16(u8 *p, unsigned v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_be16(u8 *p, unsigned v)
+{
+	p[0] = (v >> 8) & 0xff;
+	p[1] = v & 0xff;
+}
+
+static void put_le64(u8 *p, u64 v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+/* A smooth, deterministic stroke position for step 'i' of 'n'. */
+static unsigned stroke(int i, int n, unsigned lo, unsigned hi)
+{
+	unsigned span = hi - lo;
+	int half = n / 2;
+	int k = i % n;
+
+	if (k > half)
+		k = n - k;
+	return lo + (unsigned)((u64)span * k / half);
+}
+
+/* ---- synthetic HID descriptors for HID_GENERIC ---- */
+
+struct bench_field_def {
+	unsigned collection;
+	unsigned physical;
+	unsigned logical;
+	unsigned report_size;
+	unsigned report_count;
+	s32 logical_minimum;
+	s32 logical_maximum;
+	s32 physical_minimum;
+	s32 physical_maximum;
+	unsigned unit;
+	s32 unit_exponent;
+	unsigned usages[4];
+};
+
+static struct hid_report *bench_add_report(struct bench_dev *dev, unsigned id)
+{
+	struct hid_report_enum *re = &dev->hdev.report_enum[HID_INPUT_REPORT];
+	struct hid_report *report = kzalloc(sizeof(*report), GFP_KERNEL);
+
+	report->id = id;
+	report->type = HID_INPUT_REPORT;
+	report->device = &dev->hdev;
+	re->numbered = 1;
+	re->report_id_hash[id] = report;
+	return report;
+}
+
+static void bench_add_field(struct hid_report *report, unsigned application,
+			    const struct bench_field_def *def)
+{
+	struct hid_field *field = kzalloc(sizeof(*field), GFP_KERNEL);
+	unsigned i;
+
+	field->application = application;
+	field->physical = def->physical;
+	field->logical = def->logical;
+	field->flags = HID_MAIN_ITEM_VARIABLE;
+	field->report_offset = report->size;
+	field->report_size = def->report_size;
+	field->report_count = def->report_count;
+	field->report_type = HID_INPUT_REPORT;
+	field->logical_minimum = def->logical_minimum;
+	field->logical_maximum = def->logical_maximum;
+	field->physical_minimum = def->physical_minimum;
+	field->physical_maximum = def->physical_maximum;
+	field->unit = def->unit;
+	field->unit_exponent = def->unit_exponent;
+	field->report = report;
+	field->index = report->maxfield;
+
+	field->maxusage = def->report_count;
+	field->usage = kcalloc(field->maxusage, sizeof(*field->usage),
+			       GFP_KERNEL);
+	field->value = kcalloc(field->report_count, sizeof(*field->value),
+			       GFP_KERNEL);
+	for (i = 0; i < field->maxusage; i++) {
+		field->usage[i].hid = def->usages[i];
+		field->usage[i].collection_index = def->collection;
+		field->usage[i].usage_index = i;
+	}
+
+	report->size += def->report_size * def->report_count;
+	report->field[report->maxfield++] = field;
+}
+
+static void bench_add_padding(struct hid_report *report, unsigned bits)
+{
+	report->size += bits;
+}
+
+/* What wacom_usage_mapping() does for each usage once hid-core has parsed. */
+static void bench_map_report(struct bench_dev *dev, struct hid_report *report)
+{
+	struct wacom_features *features = &dev->wacom->wacom_wac.features;
+	unsigned i, j;
+
+	for (i = 0; i < report->maxfield; i++) {
+		struct hid_field *field = report->field[i];
+
+		for (j = 0; j < field->maxusage; j++) {
+			struct hid_usage *usage = &field->usage[j];
+			unsigned equivalent_usage = wacom_equivalent_usage(usage->hid);
+			bool finger = WACOM_FINGER_FIELD(field);
+			bool pen = WACOM_PEN_FIELD(field);
+
+			if (pen)
+				features->device_type |= WACOM_DEVICETYPE_PEN;
+			else if (finger)
+				features->device_type |= WACOM_DEVICETYPE_TOUCH;
+			else
+				continue;
+
+			if (equivalent_usage == HID_GD_X)
+				features->x_max = field->logical_maximum;
+			else if (equivalent_usage == HID_GD_Y)
+				features->y_max = field->logical_maximum;
+			else if (equivalent_usage == HID_DG_TIPPRESSURE && pen)
+				features->pressure_max = field->logical_maximum;
+
+			wacom_wac_usage_mapping(&dev->hdev, field, usage);
+		}
+	}
+}
+
+/* Bytes after the report ID, as laid out by bench_add_field(). */
+static void bench_put_bits(u8 *buf, unsigned offset, unsigned n, u32 value)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++, offset++) {
+		if (value & (1U << i))
+			buf[offset / 8] |= 1 << (offset % 8);
+	}
+}
+
+static void bench_put_field(struct hid_report *report, u8 *data,
+			    unsigned usage, unsigned index, s32 value)
+{
+	unsigned i, j;
+
+	for (i = 0; i < report->maxfield; i++) {
+		struct hid_field *field = report->field[i];
+
+		for (j = 0; j < field->maxusage; j++) {
+			if (field->usage[j].hid != usage ||
+			    field->usage[j].collection_index != index)
+				continue;
+			bench_put_bits(data + 1, field->report_offset +
+				       j * field->report_size,
+				       field->report_size, value);
+			return;
+		}
+	}
+}
+
+#define WD(x)	(WACOM_HID_UP_WACOMDIGITIZER | (x))
+
+/*
+ * An EMR pen on the Wacom vendor page, as found on MobileStudio Pro and
+ * later Cintiq Pro: every usage goes through wacom_equivalent_usage().
+ */
+static void describe_generic_pen(struct bench_dev *dev)
+{
+	struct hid_report *report = bench_add_report(dev, 0x10);
+	const struct bench_field_def fields[] = {
+		{ 1, WACOM_HID_WD_PEN, 0, 1, 4, 0, 1, 0, 0, 0, 0,
+		  { WD(0x42), WD(0x44), WD(0x3c), WD(0x5a) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 1, 1, 0, 1, 0, 0, 0, 0,
+		  { WD(0x32) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 16, 1, 0, 44800, 0, 4480, 0x11, -2,
+		  { WD(0x130) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 16, 1, 0, 29600, 0, 2960, 0x11, -2,
+		  { WD(0x131) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 16, 1, 0, 8191, 0, 0, 0, 0,
+		  { WD(0x30) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 8, 2, -64, 63, -64, 63, 0x14, 0,
+		  { WD(0x3d), WD(0x3e) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 8, 1, 0, 63, 0, 0, 0, 0,
+		  { WACOM_HID_WD_DISTANCE } },
+		{ 1, WACOM_HID_WD_PEN, 0, 32, 1, 0, 0x7fffffff, 0, 0, 0, 0,
+		  { WD(0x5b) } },
+		{ 1, WACOM_HID_WD_PEN, 0, 32, 1, 0, 0x7fffffff, 0, 0, 0, 0,
+		  { WACOM_HID_WD_SERIALHI } },
+		{ 1, WACOM_HID_WD_PEN, 0, 16, 1, 0, 0xffff, 0, 0, 0, 0,
+		  { WACOM_HID_WD_TOOLTYPE } },
+	};
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(fields); i++) {
+		bench_add_field(report, WACOM_HID_WD_PEN, &fields[i]);
+		if (i == 1)
+			bench_add_padding(report, 3);
+	}
+
+	bench_map_report(dev, report);
+}
+
+static void generate_generic_pen(struct bench_dev *dev, struct bench_stream *stream)
+{
+	struct hid_report *report =
+		dev->hdev.report_enum[HID_INPUT_REPORT].report_id_hash[0x10];
+	int len = 1 + report->size / 8;
+	int i;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, len);
+		int k = i % 256;
+		bool range = k != 255;
+		bool tip = k >= 16 && k < 240;
+
+		r->data[0] = 0x10;
+		if (!range)
+			continue;
+
+		bench_put_field(report, r->data, WD(0x32), 1, 1);
+		bench_put_field(report, r->data, WD(0x42), 1, tip);
+		bench_put_field(report, r->data, WD(0x44), 1, k >= 128 && k < 160);
+		bench_put_field(report, r->data, WD(0x130), 1, stroke(k, 256, 1000, 40000));
+		bench_put_field(report, r->data, WD(0x131), 1, stroke(k + 64, 256, 1000, 28000));
+		bench_put_field(report, r->data, WD(0x30), 1, tip ? stroke(k, 256, 200, 8000) : 0);
+		bench_put_field(report, r->data, WD(0x3d), 1, (k % 64) - 32);
+		bench_put_field(report, r->data, WD(0x3e), 1, 20 - (k % 40));
+		bench_put_field(report, r->data, WACOM_HID_WD_DISTANCE, 1, tip ? 0 : 40 - k % 16);
+		bench_put_field(report, r->data, WD(0x5b), 1, 0x0a1b2c3d);
+		bench_put_field(report, r->data, WACOM_HID_WD_SERIALHI, 1, (1 << 20) | 0x00802);
+		bench_put_field(report, r->data, WACOM_HID_WD_TOOLTYPE, 1, 0x0802);
+	}
+}
+
+#define GENERIC_FINGERS	10
+
+/* A 10-finger touchscreen using one logical collection per contact. */
+static void describe_generic_touch(struct bench_dev *dev)
+{
+	struct hid_report *report = bench_add_report(dev, 0x0c);
+	unsigned i;
+
+	for (i = 0; i < GENERIC_FINGERS; i++) {
+		const struct bench_field_def fields[] = {
+			{ i + 1, 0, HID_DG_FINGER, 1, 1, 0, 1, 0, 0, 0, 0,
+			  { HID_DG_TIPSWITCH } },
+			{ i + 1, 0, HID_DG_FINGER, 8, 1, 0, 255, 0, 0, 0, 0,
+			  { HID_DG_CONTACTID } },
+			{ i + 1, 0, HID_DG_FINGER, 16, 2, 0, 11960, 0, 2990, 0x11, -2,
+			  { HID_GD_X } },
+			{ i + 1, 0, HID_DG_FINGER, 16, 2, 0, 6730, 0, 1682, 0x11, -2,
+			  { HID_DG_WIDTH, HID_DG_HEIGHT } },
+		};
+
+		bench_add_field(report, HID_DG_TOUCHSCREEN, &fields[0]);
+		bench_add_padding(report, 7);
+		bench_add_field(report, HID_DG_TOUCHSCREEN, &fields[1]);
+		bench_add_field(report, HID_DG_TOUCHSCREEN, &fields[2]);
+		/* X and Y share one field */
+		report->field[report->maxfield - 1]->usage[1].hid = HID_GD_Y;
+		bench_add_field(report, HID_DG_TOUCHSCREEN, &fields[3]);
+	}
+
+	{
+		const struct bench_field_def cc = {
+			0, 0, 0, 8, 1, 0, 127, 0, 0, 0, 0,
+			{ HID_DG_CONTACTCOUNT }
+		};
+
+		bench_add_field(report, HID_DG_TOUCHSCREEN, &cc);
+	}
+
+	bench_map_report(dev, report);
+}
+
+static void generate_generic_touch(struct bench_dev *dev, struct bench_stream *stream)
+{
+	struct hid_report *report =
+		dev->hdev.report_enum[HID_INPUT_REPORT].report_id_hash[0x0c];
+	int len = 1 + report->size / 8;
+	int i, f;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, len);
+		int k = i % 128;
+		bool down = k != 127;
+
+		r->data[0] = 0x0c;
+		for (f = 0; f < GENERIC_FINGERS; f++) {
+			bench_put_field(report, r->data, HID_DG_TIPSWITCH, f + 1, down);
+			bench_put_field(report, r->data, HID_DG_CONTACTID, f + 1, f);
+			bench_put_field(report, r->data, HID_GD_X, f + 1,
+					stroke(k + 8 * f, 128, 500, 11000));
+			bench_put_field(report, r->data, HID_GD_Y, f + 1,
+					1000 + 500 * f + k);
+			bench_put_field(report, r->data, HID_DG_WIDTH, f + 1, 40 + f);
+			bench_put_field(report, r->data, HID_DG_HEIGHT, f + 1, 48);
+		}
+		bench_put_field(report, r->data, HID_DG_CONTACTCOUNT, 0,
+				GENERIC_FINGERS);
+	}
+}
+
+/* ---- protocol-specific streams ---- */
+
+/* Intuos/Intuos3/Intuos4 USB pen: enter, general packets, exit. */
+static void generate_intuos_pen(struct bench_dev *dev, struct bench_stream *stream)
+{
+	struct wacom_features *features = &dev->wacom->wacom_wac.features;
+	int shift = features->type < INTUOS3S ? 0 : 1;
+	int i;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, 10);
+		u8 *data = r->data;
+		int k = i % 256;
+		unsigned x, y, p;
+
+		data[0] = WACOM_REPORT_PENABLED;
+		if (k == 0) {
+			/* enter: general pen 0x802, serial 0x123456 */
+			data[1] = 0xc2;
+			data[2] = 0x80;
+			data[3] = 0x20;
+			data[4] = 0x01;
+			data[5] = 0x23;
+			data[6] = 0x45;
+			data[7] = 0x60;
+			continue;
+		}
+		if (k == 255) {
+			data[1] = 0x80;
+			continue;
+		}
+
+		x = stroke(k, 256, 1000, features->x_max - 1000) << (1 - shift);
+		y = stroke(k + 64, 256, 1000, features->y_max - 1000) << (1 - shift);
+		p = k >= 16 && k < 240 ? stroke(k, 256, 100, 2000) : 0;
+
+		data[1] = 0xe0 | ((k >= 128 && k < 160) ? 0x02 : 0) | (p & 1);
+		put_be16(&data[2], x >> 1);
+		put_be16(&data[4], y >> 1);
+		data[6] = p >> 3;
+		data[7] = ((p >> 1) & 0x3) << 6 | ((k % 64) >> 1);
+		data[8] = (k % 2) << 7 | (64 + (k % 32));
+		data[9] = ((p ? 10 : 30) << 2) | (x & 1) << 1 | (y & 1);
+	}
+}
+
+/* Intuos4 WL over Bluetooth: three 10-byte Intuos packets per report. */
+static void generate_intuos4wl_bt(struct bench_dev *dev, struct bench_stream *stream)
+{
+	struct bench_stream usb = { 0 };
+	int i, j;
+
+	generate_intuos_pen(dev, &usb);
+
+	for (i = 0; i + 3 <= usb.count; i += 3) {
+		struct bench_report *r = stream_add(stream, 32);
+
+		r->data[0] = 0x04;
+		for (j = 0; j < 3; j++)
+			memcpy(&r->data[1 + 10 * j], usb.reports[i + j].data, 10);
+		r->data[31] = 0x0b;	/* charging, 4/7 capacity */
+	}
+
+	free(usb.reports);
+}
+
+/* Intuos Pro 2 Bluetooth: 7 pen frames per 361-byte report. */
+static void generate_intuosp2_bt_pen(struct bench_dev *dev, struct bench_stream *stream)
+{
+	int i, j;
+
+	for (i = 0; i < BENCH_STREAM_LEN / 7; i++) {
+		struct bench_report *r = stream_add(stream, WACOM_PKGLEN_MAX);
+		u8 *data = r->data;
+		int k = i % 64;
+
+		data[0] = 0x80;
+		put_le64(&data[99], (1ULL << 52) | 0x0802123456ULL);
+		put_le16(&data[107], 0x0802);
+
+		for (j = 0; j < 7; j++) {
+			u8 *frame = &data[j * 14 + 1];
+			int step = k * 7 + j;
+			bool tip = k >= 4 && k < 60;
+
+			if (k == 63) {
+				/* leave proximity on the last report */
+				frame[0] = j == 0 ? 0x80 : 0;
+				continue;
+			}
+
+			frame[0] = 0x80 | 0x40 | 0x20 | (tip ? 0x01 : 0);
+			put_le16(&frame[1], stroke(step, 448, 1000, 43000));
+			put_le16(&frame[3], stroke(step + 100, 448, 1000, 28000));
+			put_le16(&frame[5], tip ? stroke(step, 448, 100, 8000) : 0);
+			frame[7] = (step % 60) - 30;
+			frame[8] = 20 - (step % 40);
+			put_le16(&frame[9], step % 1800);
+			put_le16(&frame[11], 0);
+			frame[13] = tip ? 0 : 30;
+		}
+
+		data[284] = 0x80 | 80;	/* charging, 80% */
+	}
+}
+
+/* Intuos Pro 2 Bluetooth: 5 fingers in the first touch frame. */
+static void generate_intuosp2_bt_touch(struct bench_dev *dev, struct bench_stream *stream)
+{
+	int i, j;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, WACOM_PKGLEN_MAX);
+		u8 *data = r->data;
+		u8 *frame = &data[109];
+		int k = i % 128;
+
+		data[0] = 0x80;
+		frame[0] = 0x80 | 5;
+		for (j = 0; j < 5; j++) {
+			u8 *touch = &frame[j * 8 + 1];
+
+			touch[0] = j + 2;
+			touch[1] = k != 127;
+			put_le16(&touch[2], stroke(k + 10 * j, 128, 200, 8000));
+			put_le16(&touch[4], 800 + 900 * j + k);
+			touch[6] = 10 + j;
+			touch[7] = 12;
+		}
+
+		data[281] = 0x80;	/* touch switch on */
+		data[284] = 0x80 | 80;
+	}
+}
+
+/* Cintiq 24HD touch: 10 contacts spread over three 4-contact packets. */
+static void generate_24hdt(struct bench_dev *dev, struct bench_stream *stream)
+{
+	const int fingers = 10;
+	int i, j;
+
+	for (i = 0; i < BENCH_STREAM_LEN / 3; i++) {
+		int k = i % 128;
+		int sent = 0;
+
+		while (sent < fingers) {
+			struct bench_report *r = stream_add(stream, 64);
+			u8 *data = r->data;
+			int n = min(4, fingers - sent);
+
+			data[0] = WACOM_REPORT_TPCMT;
+			data[61] = sent ? 0 : fingers;
+			for (j = 0; j < n; j++) {
+				u8 *c = &data[1 + WACOM_BYTES_PER_24HDT_PACKET * j];
+				int f = sent + j;
+				unsigned x = stroke(k + 8 * f, 128, 500, 30000);
+				unsigned y = 1000 + 1500 * f + k;
+
+				c[0] = k != 127;
+				c[1] = f;
+				put_le16(&c[2], x);
+				put_le16(&c[4], x + 20);
+				put_le16(&c[6], y);
+				put_le16(&c[8], y + 20);
+				put_le16(&c[10], 200 + f);
+				put_le16(&c[12], 260);
+			}
+			sent += n;
+		}
+	}
+}
+
+/* Bamboo/Intuos5 3rd-gen touch: 8-byte messages in a 64-byte report. */
+static void generate_bpt3_touch(struct bench_dev *dev, struct bench_stream *stream)
+{
+	const int fingers = 3;
+	int i, j;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, WACOM_PKGLEN_BBTOUCH3);
+		u8 *data = r->data;
+		int k = i % 128;
+
+		data[0] = 0x02;
+		data[1] = fingers + 1;
+		for (j = 0; j < fingers; j++) {
+			u8 *msg = &data[2 + 8 * j];
+			unsigned x = stroke(k + 16 * j, 128, 100, 4000);
+			unsigned y = 300 + 1000 * j + k;
+
+			msg[0] = 2 + j;
+			msg[1] = k != 127 ? 0x80 : 0;
+			msg[2] = x >> 4;
+			msg[3] = y >> 4;
+			msg[4] = (x & 0xf) << 4 | (y & 0xf);
+			msg[5] = 20 + j;
+		}
+		/* a button message rides along with every report */
+		data[2 + 8 * fingers] = 128;
+		data[2 + 8 * fingers + 1] = (k >= 32 && k < 40) ? 0x01 : 0;
+	}
+}
+
+/* Bamboo pen: 9-byte reports, hover, touch, leave. */
+static void generate_bpt_pen(struct bench_dev *dev, struct bench_stream *stream)
+{
+	int i;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, WACOM_PKGLEN_BBFUN);
+		u8 *data = r->data;
+		int k = i % 256;
+		bool tip = k >= 16 && k < 240;
+
+		data[0] = WACOM_REPORT_PENABLED;
+		if (k == 255)
+			continue;
+
+		data[1] = 0x80 | 0x40 | 0x20 | (tip ? 0x01 : 0);
+		put_le16(&data[2], stroke(k, 256, 200, 14000));
+		put_le16(&data[4], stroke(k + 64, 256, 200, 9000));
+		put_le16(&data[6], tip ? stroke(k, 256, 20, 1000) : 0);
+		data[8] = tip ? 31 : 10;
+	}
+}
+
+/* ISDv4 multitouch: 10 contacts over two 5-contact packets. */
+static void generate_mttpc_touch(struct bench_dev *dev, struct bench_stream *stream)
+{
+	const int fingers = 10;
+	const int stride = WACOM_BYTES_PER_MT_PACKET - 4;
+	int i, j;
+
+	for (i = 0; i < BENCH_STREAM_LEN / 2; i++) {
+		int k = i % 128;
+		int sent = 0;
+
+		while (sent < fingers) {
+			struct bench_report *r = stream_add(stream, 3 + 5 * stride);
+			u8 *data = r->data;
+			int n = min(5, fingers - sent);
+
+			data[0] = WACOM_REPORT_TPCMT;
+			data[2] = sent ? 0 : fingers;
+			for (j = 0; j < n; j++) {
+				u8 *c = &data[3 + stride * j];
+				int f = sent + j;
+
+				c[0] = k != 127;
+				put_le16(&c[1], f);
+				put_le16(&c[3], stroke(k + 8 * f, 128, 300, 26000));
+				put_le16(&c[5], 500 + 1500 * f + k);
+			}
+			sent += n;
+		}
+	}
+}
+
+/* ISDv4 pen: 8-byte reports. */
+static void generate_tpc_pen(struct bench_dev *dev, struct bench_stream *stream)
+{
+	int i;
+
+	for (i = 0; i < BENCH_STREAM_LEN; i++) {
+		struct bench_report *r = stream_add(stream, WACOM_PKGLEN_PENABLED);
+		u8 *data = r->data;
+		int k = i % 256;
+		bool tip = k >= 16 && k < 240;
+		unsigned p = tip ? stroke(k, 256, 10, 250) : 0;
+
+		data[0] = WACOM_REPORT_PENABLED;
+		if (k == 255)
+			continue;
+
+		data[1] = 0x20 | (tip ? 0x01 : 0);
+		put_le16(&data[2], stroke(k, 256, 200, 26000));
+		put_le16(&data[4], stroke(k + 64, 256, 200, 16000));
+		data[6] = p & 0xff;
+		data[7] = (p >> 8) & 0x07;
+	}
+}
+
+static const struct bench_scenario scenarios[] = {
+	{ "intuos-pen", "Intuos 6x8 USB pen", BUS_USB, 0x21,
+	  WACOM_DEVICETYPE_PEN, 10, 0, NULL, generate_intuos_pen },
+	{ "intuos4-pen", "Intuos4 6x9 USB pen", BUS_USB, 0xB9,
+	  WACOM_DEVICETYPE_PEN, 10, 0, NULL, generate_intuos_pen },
+	{ "intuos4wl-bt", "Intuos4 WL Bluetooth, 3 pen packets/report",
+	  BUS_BLUETOOTH, 0xBD, WACOM_DEVICETYPE_PEN, 32, 0, NULL,
+	  generate_intuos4wl_bt },
+	{ "intuosp2-bt-pen", "Intuos Pro 2 M Bluetooth, 7 pen frames/report",
+	  BUS_BLUETOOTH, 0x360, 0, WACOM_PKGLEN_MAX, 0, NULL,
+	  generate_intuosp2_bt_pen },
+	{ "intuosp2-bt-touch", "Intuos Pro 2 M Bluetooth, 5 fingers",
+	  BUS_BLUETOOTH, 0x360, 0, WACOM_PKGLEN_MAX, 0, NULL,
+	  generate_intuosp2_bt_touch },
+	{ "24hdt-touch", "Cintiq 24HD touch, 10 fingers in 3 packets",
+	  BUS_USB, 0xF6, WACOM_DEVICETYPE_TOUCH, 64, 0, NULL,
+	  generate_24hdt },
+	{ "bamboo-pt-touch", "Bamboo 16FG touch, 3 fingers + buttons",
+	  BUS_USB, 0xDE, WACOM_DEVICETYPE_TOUCH, WACOM_PKGLEN_BBTOUCH3, 0,
+	  NULL, generate_bpt3_touch },
+	{ "bamboo-pt-pen", "Bamboo 16FG pen",
+	  BUS_USB, 0xDE, WACOM_DEVICETYPE_PEN, WACOM_PKGLEN_BBFUN, 0,
+	  NULL, generate_bpt_pen },
+	{ "mttpc-touch", "ISDv4 100 touch, 10 fingers in 2 packets",
+	  BUS_USB, 0x100, WACOM_DEVICETYPE_TOUCH, 38, 10, NULL,
+	  generate_mttpc_touch },
+	{ "tabletpc-pen", "ISDv4 100 pen",
+	  BUS_USB, 0x100, WACOM_DEVICETYPE_PEN, WACOM_PKGLEN_PENABLED, 0,
+	  NULL, generate_tpc_pen },
+	{ "generic-pen", "HID_GENERIC vendor-page pen",
+	  BUS_USB, HID_ANY_ID, 0, 0, 0, describe_generic_pen,
+	  generate_generic_pen },
+	{ "generic-touch", "HID_GENERIC touchscreen, 10 fingers",
+	  BUS_USB, HID_ANY_ID, 0, 0, GENERIC_FINGERS, describe_generic_touch,
+	  generate_generic_touch },
+};
+
+/* ---- device instantiation, after wacom_parse_and_register() ---- */
+
+static const struct wacom_features *bench_find_features(u16 bus, u32 product)
+{
+	const struct hid_device_id *id;
+
+	for (id = wacom_ids; id->driver_data; id++)
+		if (id->bus == bus && id->product == product)
+			return (const struct wacom_features *)id->driver_data;
+
+	return NULL;
+}
+
+static void bench_calculate_res(struct wacom_features *features)
+{
+	struct hid_field field = { 0 };
+
+	if (features->x_resolution && !features->x_phy) {
+		features->x_phy = (features->x_max * 100) / features->x_resolution;
+		features->y_phy = (features->y_max * 100) / features->y_resolution;
+	}
+
+	if (!features->unit) {
+		features->unit = 0x11;
+		features->unitExpo = -3;
+	}
+
+	field.unit = features->unit;
+	field.unit_exponent = features->unitExpo;
+	field.logical_maximum = features->x_max;
+	field.physical_maximum = features->x_phy;
+	features->x_resolution = hidinput_calc_abs_res(&field, ABS_X);
+	field.logical_maximum = features->y_max;
+	field.physical_maximum = features->y_phy;
+	features->y_resolution = hidinput_calc_abs_res(&field, ABS_Y);
+
+	/* touch interfaces normally get their size from the descriptor */
+	if (!features->x_resolution || !features->y_resolution) {
+		features->x_resolution = 10;
+		features->y_resolution = 10;
+	}
+}
+
+static struct bench_dev *bench_create(const struct bench_scenario *sc)
+{
+	const struct wacom_features *template;
+	struct wacom_features *features;
+	struct wacom_wac *wacom_wac;
+	struct bench_dev *dev;
+	struct input_dev **inputs[3];
+	int i;
+
+	template = bench_find_features(sc->bus, sc->product);
+	if (!template) {
+		fprintf(stderr, "%s: no wacom_ids entry for %04x\n",
+			sc->name, sc->product);
+		return NULL;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	dev->wacom = calloc(1, sizeof(*dev->wacom));
+	dev->wacom->stats = calloc(1, sizeof(*dev->wacom->stats));
+	dev->hdev.bus = sc->bus;
+	dev->hdev.vendor = USB_VENDOR_ID_WACOM;
+	dev->hdev.product = sc->product;
+	hid_set_drvdata(&dev->hdev, dev->wacom);
+
+	dev->wacom->hdev = &dev->hdev;
+	wacom_wac = &dev->wacom->wacom_wac;
+	wacom_wac->features = *template;
+	wacom_wac->hid_data.inputmode = -1;
+	wacom_wac->mode_report = -1;
+	wacom_wac->pen_frames = pen_frames;
+	features = &wacom_wac->features;
+	features->pktlen = sc->pktlen;
+	features->device_type |= sc->device_type;
+	if (sc->touch_max)
+		features->touch_max = sc->touch_max;
+
+	inputs[0] = &wacom_wac->pen_input;
+	inputs[1] = &wacom_wac->touch_input;
+	inputs[2] = &wacom_wac->pad_input;
+	for (i = 0; i < 3; i++) {
+		*inputs[i] = input_allocate_device();
+		(*inputs[i])->name = features->name;
+		(*inputs[i])->dev.parent = &dev->hdev.dev;
+		input_set_capability(*inputs[i], EV_MSC, MSC_TIMESTAMP);
+		input_set_drvdata(*inputs[i], dev->wacom);
+	}
+
+	wacom_wac->shared = &dev->shared;
+
+	if (sc->describe) {
+		sc->describe(dev);
+		if (features->touch_max > 1)
+			input_mt_init_slots(wacom_wac->touch_input,
+					    features->touch_max,
+					    features->device_type & WACOM_DEVICETYPE_DIRECT ?
+					    INPUT_MT_DIRECT : INPUT_MT_POINTER);
+	}
+
+	wacom_setup_device_quirks(dev->wacom);
+	wacom_setup_irq_ops(wacom_wac);
+	bench_calculate_res(features);
+
+	if (features->device_type & WACOM_DEVICETYPE_TOUCH)
+		dev->shared.touch = &dev->hdev;
+	else if (features->device_type & WACOM_DEVICETYPE_PEN)
+		dev->shared.pen = &dev->hdev;
+
+	if (wacom_setup_pen_input_capabilities(wacom_wac->pen_input, wacom_wac)) {
+		input_free_device(wacom_wac->pen_input);
+		wacom_wac->pen_input = NULL;
+	}
+	if (wacom_setup_touch_input_capabilities(wacom_wac->touch_input, wacom_wac)) {
+		input_free_device(wacom_wac->touch_input);
+		wacom_wac->touch_input = NULL;
+	}
+	if (wacom_setup_pad_input_capabilities(wacom_wac->pad_input, wacom_wac)) {
+		input_free_device(wacom_wac->pad_input);
+		wacom_wac->pad_input = NULL;
+	}
+
+	for (i = 0; i < 3; i++)
+		if (*inputs[i])
+			input_register_device(*inputs[i]);
+
+	if (wacom_wac_setup_report_plans(&dev->hdev)) {
+		fprintf(stderr, "%s: out of memory\n", sc->name);
+		exit(1);
+	}
+
+	if (features->device_type & WACOM_DEVICETYPE_TOUCH) {
+		dev->shared.type = features->type;
+		dev->shared.touch_input = wacom_wac->touch_input;
+	}
+	/* the pen interface would report the touch switch as on */
+	dev->shared.is_touch_on = true;
+
+	return dev;
+}
+
+static void bench_destroy(struct bench_dev *dev)
+{
+	struct hid_report_enum *re = &dev->hdev.report_enum[HID_INPUT_REPORT];
+	struct wacom_wac *wacom_wac = &dev->wacom->wacom_wac;
+	unsigned i, j;
+
+	for (i = 0; i < HID_MAX_IDS; i++) {
+		struct hid_report *report = re->report_id_hash[i];
+
+		if (!report)
+			continue;
+		for (j = 0; j < report->maxfield; j++) {
+			kfree(report->field[j]->usage);
+			kfree(report->field[j]->value);
+			kfree(report->field[j]);
+		}
+		kfree(report);
+	}
+
+	input_free_device(wacom_wac->pen_input);
+	input_free_device(wacom_wac->touch_input);
+	input_free_device(wacom_wac->pad_input);
+	free(dev->wacom->stats);
+	free(dev->wacom);
+	free(dev);
+}
+
+/* ---- the measured path ---- */
+
+/* hid-core's share of hid_input_report(): unpack every variable field. */
+static struct hid_report *bench_extract(struct bench_dev *dev, u8 *data)
+{
+	struct hid_report_enum *re = &dev->hdev.report_enum[HID_INPUT_REPORT];
+	struct hid_report *report = re->report_id_hash[data[0]];
+	unsigned i, n;
+
+	if (!report)
+		return NULL;
+
+	for (i = 0; i < report->maxfield; i++) {
+		struct hid_field *field = report->field[i];
+
+		for (n = 0; n < field->report_count; n++) {
+			u32 v = hid_field_extract(&dev->hdev, data + 1,
+						  field->report_offset +
+						  n * field->report_size,
+						  field->report_size);
+
+			if (field->logical_minimum < 0 && field->report_size < 32 &&
+			    (v & (1U << (field->report_size - 1))))
+				v |= ~0U << field->report_size;
+			field->value[n] = v;
+		}
+	}
+
+	return report;
+}
+
+static inline u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u64 timer_overhead(void)
+{
+	u64 best = ~0ULL;
+	int i;
+
+	for (i = 0; i < 10000; i++) {
+		u64 t0 = now_ns();
+		u64 t1 = now_ns();
+
+		if (t1 - t0 < best)
+			best = t1 - t0;
+	}
+
+	return best;
+}
+
+static void bench_process(struct bench_dev *dev, struct bench_report *r,
+			  bool generic)
+{
+	struct wacom_wac *wacom_wac = &dev->wacom->wacom_wac;
+	struct hid_report *report;
+
+	if (r->len > WACOM_PKGLEN_MAX)
+		return;
+
+	report = generic ? bench_extract(dev, r->data) : NULL;
+
+	wacom_wac_set_rx_time(wacom_wac, ktime_get());
+	memcpy(wacom_wac->data, r->data, r->len);
+	wacom_wac_irq(wacom_wac, r->len);
+
+	if (report)
+		wacom_wac_report(&dev->hdev, report);
+}
+
+static void stats_sum(struct bench_dev *dev, struct input_stats *sum)
+{
+	struct wacom_wac *wacom_wac = &dev->wacom->wacom_wac;
+	struct input_dev *inputs[] = {
+		wacom_wac->pen_input, wacom_wac->touch_input,
+		wacom_wac->pad_input,
+	};
+	unsigned i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		if (!inputs[i])
+			continue;
+		sum->events += inputs[i]->stats.events;
+		sum->delivered += inputs[i]->stats.delivered;
+		sum->syncs += inputs[i]->stats.syncs;
+		sum->splits += inputs[i]->stats.splits;
+		sum->mt_frames += inputs[i]->stats.mt_frames;
+	}
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int bench_run(const struct bench_scenario *sc, const char *replay,
+		     struct bench_stream *replayed)
+{
+	struct bench_stream generated = { 0 };
+	struct bench_stream *stream;
+	struct input_stats before, after;
+	struct bench_dev *dev;
+	bool generic;
+	u64 overhead, total = 0;
+	u32 *samples;
+	long nsamples = 0, nreports;
+	int pass, i;
+
+	dev = bench_create(sc);
+	if (!dev)
+		return -1;
+
+	generic = dev->wacom->wacom_wac.features.type == HID_GENERIC;
+	if (replayed) {
+		stream = replayed;
+	} else {
+		sc->generate(dev, &generated);
+		stream = &generated;
+	}
+	if (!stream->count) {
+		fprintf(stderr, "%s: empty stream\n", sc->name);
+		bench_destroy(dev);
+		return -1;
+	}
+
+	/* warm up caches, branch predictors and the MT slot state */
+	for (i = 0; i < stream->count; i++)
+		bench_process(dev, &stream->reports[i], generic);
+
+	nreports = (long)stream->count * iterations;
+	samples = malloc(sizeof(*samples) * min(nreports, (long)BENCH_MAX_SAMPLES));
+	overhead = timer_overhead();
+
+	stats_sum(dev, &before);
+	for (pass = 0; pass < iterations; pass++) {
+		for (i = 0; i < stream->count; i++) {
+			struct bench_report *r = &stream->reports[i];
+			struct hid_report *report = NULL;
+			struct wacom_wac *wacom_wac = &dev->wacom->wacom_wac;
+			u64 t0, t1, dt;
+
+			if (generic)
+				report = bench_extract(dev, r->data);
+
+			t0 = now_ns();
+			wacom_wac_set_rx_time(wacom_wac, ktime_get());
+			memcpy(wacom_wac->data, r->data, r->len);
+			wacom_wac_irq(wacom_wac, r->len);
+			if (report)
+				wacom_wac_report(&dev->hdev, report);
+			t1 = now_ns();
+
+			dt = t1 - t0 > overhead ? t1 - t0 - overhead : 0;
+			total += dt;
+			if (nsamples < BENCH_MAX_SAMPLES)
+				samples[nsamples++] = dt;
+		}
+	}
+	stats_sum(dev, &after);
+
+	qsort(samples, nsamples, sizeof(*samples), cmp_u32);
+
+	printf("%-18s %-44s %8ld %9.1f %7u %7u %8.2f %9.2f %7.2f %7.2f\n",
+	       sc->name, replay ? replay : sc->desc, nreports,
+	       (double)total / nreports,
+	       samples[nsamples / 2], samples[nsamples * 99 / 100],
+	       (double)(after.events - before.events) / nreports,
+	       (double)(after.delivered - before.delivered) / nreports,
+	       (double)(after.syncs - before.syncs) / nreports,
+	       (double)(after.splits - before.splits) / nreports);
+
+	free(samples);
+	free(generated.reports);
+	bench_destroy(dev);
+	return 0;
+}
+
+/* ---- replay ---- */
+
+/*
+ * Accepts hid-recorder output ("E: <sec>.<usec> <len> <bytes>") or one
+ * report per line as plain hex bytes. Anything else is skipped.
+ */
+static int load_replay(const char *path, struct bench_stream *stream)
+{
+	char line[4096];
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		struct bench_report *r;
+		char *p = line, *end;
+		unsigned long v;
+		int len = 0;
+
+		if (!strncmp(p, "E:", 2)) {
+			strtod(p + 2, &end);		/* timestamp */
+			strtoul(end, &end, 10);		/* length */
+			p = end;
+		} else if (!isxdigit((unsigned char)*p)) {
+			continue;
+		}
+
+		r = stream_add(stream, 0);
+		for (;;) {
+			v = strtoul(p, &end, 16);
+			if (end == p || len == WACOM_PKGLEN_MAX)
+				break;
+			r->data[len++] = v;
+			p = end;
+		}
+		r->len = len;
+		if (!len)
+			stream->count--;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	unsigned i;
+
+	fprintf(stderr,
+		"usage: %s [-n passes] [-s scenario]... [-r recording -s scenario] [-p mode] [-v] [-l]\n"
+		"  -n  passes over each report stream (default %d)\n"
+		"  -s  run only the named scenario (may be repeated)\n"
+		"  -r  replay raw reports from a recording on the device of -s\n"
+		"  -p  pen_frames mode of the device (default each)\n"
+		"  -v  print driver warnings\n"
+		"  -l  list scenarios\n\nscenarios:\n", prog, iterations);
+	for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+		fprintf(stderr, "  %-18s %s\n", scenarios[i].name, scenarios[i].desc);
+}
+
+int main(int argc, char **argv)
+{
+	bool selected[ARRAY_SIZE(scenarios)] = { false };
+	bool any = false;
+	const char *replay = NULL;
+	struct bench_stream replayed = { 0 };
+	unsigned i;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:r:p:vlh")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			if (iterations <= 0)
+				iterations = 1;
+			break;
+		case 's':
+			for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+				if (!strcmp(optarg, scenarios[i].name))
+					break;
+			if (i == ARRAY_SIZE(scenarios)) {
+				fprintf(stderr, "unknown scenario '%s'\n", optarg);
+				usage(argv[0]);
+				return 1;
+			}
+			selected[i] = any = true;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 'p':
+			for (i = 0; i < WACOM_PEN_FRAMES_MAX; i++)
+				if (!strcmp(optarg, pen_frames_names[i]))
+					break;
+			if (i == WACOM_PEN_FRAMES_MAX) {
+				fprintf(stderr, "unknown pen_frames mode '%s'\n", optarg);
+				return 1;
+			}
+			pen_frames = i;
+			break;
+		case 'v':
+			kshim_verbose = 1;
+			break;
+		case 'l':
+		case 'h':
+		default:
+			usage(argv[0]);
+			return opt == 'l' ? 0 : 1;
+		}
+	}
+
+	if (replay) {
+		if (!any) {
+			fprintf(stderr, "-r needs -s to pick the device\n");
+			return 1;
+		}
+		if (load_replay(replay, &replayed))
+			return 1;
+	}
+
+	printf("%-18s %-44s %8s %9s %7s %7s %8s %9s %7s %7s\n",
+	       "scenario", "description", "reports", "ns/report", "p50",
+	       "p99", "events", "delivered", "syncs", "splits");
+
+	for (i = 0; i < ARRAY_SIZE(scenarios); i++) {
+		if (any && !selected[i])
+			continue;
+		if (bench_run(&scenarios[i], replay, replay ? &replayed : NULL))
+			ret = 1;
+	}
+
+	free(replayed.reports);
+	return ret;
+}
@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * bench/wacom_replay.c
+ *
+ *  Replays a capture taken from the wacom debugfs "capture" file:
+ *
+ *	cat /sys/kernel/debug/hid/<dev>/wacom/capture > field.wcap
+ *	wacom_replay field.wcap
+ *
+ *  A uhid device is created with the bus, IDs and report descriptor
+ *  stored in the capture, so the loaded module binds to it like it did
+ *  to the original tablet, and the reports are injected again either at
+ *  their recorded cadence or back to back.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/uhid.h>
+
+/* must match wacom_sys.c */
+#define WACOM_CAPTURE_MAGIC	0x50414357	/* "WCAP" */
+#define WACOM_CAPTURE_VERSION	1
+#define WACOM_CAPTURE_HDR_SIZE	20
+#define WACOM_CAPTURE_REC_SIZE	10
+
+#define REPLAY_PROBE_MS		1000
+
+typedef uint8_t u8;
+typedef uint64_t u64;
+
+struct capture {
+	uint16_t bus;
+	uint32_t vendor;
+	uint32_t product;
+	uint32_t rdesc_size;
+	u8 rdesc[HID_MAX_DESCRIPTOR_SIZE];
+
+	/* records, in file order */
+	u64 *time_ns;
+	uint16_t *size;
+	u8 **data;
+	long count;
+};
+
+static uint16_t get_le16(const u8 *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t get_le32(const u8 *p)
+{
+	return get_le16(p) | (uint32_t)get_le16(p + 2) << 16;
+}
+
+static u64 get_le64(const u8 *p)
+{
+	return get_le32(p) | (u64)get_le32(p + 4) << 32;
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(u64 t)
+{
+	struct timespec ts = {
+		.tv_sec = t / 1000000000ULL,
+		.tv_nsec = t % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static int load_capture(const char *path, struct capture *cap)
+{
+	u8 hdr[WACOM_CAPTURE_HDR_SIZE], rec[WACOM_CAPTURE_REC_SIZE];
+	long alloc = 0;
+	FILE *f = fopen(path, "rb");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+	    get_le32(hdr) != WACOM_CAPTURE_MAGIC) {
+		fprintf(stderr, "%s: not a wacom capture\n", path);
+		goto err;
+	}
+	if (get_le16(hdr + 4) != WACOM_CAPTURE_VERSION) {
+		fprintf(stderr, "%s: capture version %d not supported\n",
+			path, get_le16(hdr + 4));
+		goto err;
+	}
+
+	cap->bus = get_le16(hdr + 6);
+	cap->vendor = get_le32(hdr + 8);
+	cap->product = get_le32(hdr + 12);
+	cap->rdesc_size = get_le32(hdr + 16);
+	if (cap->rdesc_size > sizeof(cap->rdesc) ||
+	    fread(cap->rdesc, 1, cap->rdesc_size, f) != cap->rdesc_size) {
+		fprintf(stderr, "%s: bad report descriptor\n", path);
+		goto err;
+	}
+
+	while (fread(rec, sizeof(rec), 1, f) == 1) {
+		uint16_t size = get_le16(rec + 8);
+
+		if (size > UHID_DATA_MAX) {
+			fprintf(stderr, "%s: record %ld: bad size %d\n",
+				path, cap->count, size);
+			goto err;
+		}
+
+		if (cap->count == alloc) {
+			alloc = alloc ? alloc * 2 : 1024;
+			cap->time_ns = realloc(cap->time_ns, alloc * sizeof(*cap->time_ns));
+			cap->size = realloc(cap->size, alloc * sizeof(*cap->size));
+			cap->data = realloc(cap->data, alloc * sizeof(*cap->data));
+			if (!cap->time_ns || !cap->size || !cap->data) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+
+		cap->time_ns[cap->count] = get_le64(rec);
+		cap->size[cap->count] = size;
+		cap->data[cap->count] = malloc(size ? size : 1);
+		if (!cap->data[cap->count]) {
+			perror("malloc");
+			exit(1);
+		}
+		if (fread(cap->data[cap->count], 1, size, f) != size) {
+			/* the reader was interrupted mid-record */
+			free(cap->data[cap->count]);
+			break;
+		}
+		cap->count++;
+	}
+
+	fclose(f);
+	return 0;
+
+err:
+	fclose(f);
+	return -1;
+}
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+	ssize_t ret = write(fd, ev, sizeof(*ev));
+
+	if (ret < 0)
+		return -errno;
+	return ret == sizeof(*ev) ? 0 : -EFAULT;
+}
+
+/*
+ * Answer the driver's requests until it has been quiet for timeout_ms.
+ * The capture has no feature reports, so GET_REPORT fails and the driver
+ * falls back to its defaults, as it does for a tablet that does not answer.
+ */
+static void uhid_service(int fd, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct uhid_event ev, reply;
+
+	while (poll(&pfd, 1, timeout_ms) > 0) {
+		if (read(fd, &ev, sizeof(ev)) <= 0)
+			return;
+
+		memset(&reply, 0, sizeof(reply));
+		switch (ev.type) {
+		case UHID_GET_REPORT:
+			reply.type = UHID_GET_REPORT_REPLY;
+			reply.u.get_report_reply.id = ev.u.get_report.id;
+			reply.u.get_report_reply.err = EIO;
+			uhid_write(fd, &reply);
+			break;
+		case UHID_SET_REPORT:
+			reply.type = UHID_SET_REPORT_REPLY;
+			reply.u.set_report_reply.id = ev.u.set_report.id;
+			uhid_write(fd, &reply);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-f] [-s speed] [-n loops] [-i] capture\n"
+		"  -f  inject back to back instead of at the recorded cadence\n"
+		"  -s  scale the recorded cadence (2 = twice as fast)\n"
+		"  -n  replay the capture this many times (default 1)\n"
+		"  -i  describe the capture, do not replay\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct capture cap = { 0 };
+	struct uhid_event ev;
+	bool fast = false, info = false;
+	double speed = 1.0;
+	long loops = 1, loop, i, sent = 0;
+	u64 start, late_max = 0, span;
+	int fd, opt, ret;
+
+	while ((opt = getopt(argc, argv, "fs:n:ih")) != -1) {
+		switch (opt) {
+		case 'f':
+			fast = true;
+			break;
+		case 's':
+			speed = atof(optarg);
+			if (speed <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			loops = atol(optarg);
+			if (loops < 1)
+				loops = 1;
+			break;
+		case 'i':
+			info = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (load_capture(argv[optind], &cap))
+		return 1;
+
+	span = cap.count ? cap.time_ns[cap.count - 1] - cap.time_ns[0] : 0;
+	printf("device %04x:%04x:%04x, %u byte descriptor, %ld reports over %.3f s\n",
+	       cap.bus, cap.vendor, cap.product, cap.rdesc_size,
+	       cap.count, span / 1e9);
+	if (info || !cap.count)
+		return 0;
+
+	fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror("/dev/uhid");
+		return 1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name),
+		 "wacom-replay %04x:%04x", cap.vendor, cap.product);
+	snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys),
+		 "wacom-replay/%d", getpid());
+	ev.u.create2.rd_size = cap.rdesc_size;
+	ev.u.create2.bus = cap.bus;
+	ev.u.create2.vendor = cap.vendor;
+	ev.u.create2.product = cap.product;
+	memcpy(ev.u.create2.rd_data, cap.rdesc, cap.rdesc_size);
+
+	ret = uhid_write(fd, &ev);
+	if (ret) {
+		fprintf(stderr, "cannot create uhid device: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	/* let the driver probe and register its input devices */
+	uhid_service(fd, REPLAY_PROBE_MS);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_INPUT2;
+	start = now_ns();
+
+	for (loop = 0; loop < loops; loop++) {
+		u64 base = now_ns();
+
+		for (i = 0; i < cap.count; i++) {
+			if (!fast) {
+				u64 due = base + (cap.time_ns[i] - cap.time_ns[0]) / speed;
+				u64 t = now_ns();
+
+				if (t < due)
+					sleep_until(due);
+				else if (t - due > late_max)
+					late_max = t - due;
+			}
+
+			ev.u.input2.size = cap.size[i];
+			memcpy(ev.u.input2.data, cap.data[i], cap.size[i]);
+			ret = uhid_write(fd, &ev);
+			if (ret) {
+				fprintf(stderr, "report %ld: %s\n", i, strerror(-ret));
+				goto out;
+			}
+			sent++;
+			uhid_service(fd, 0);
+		}
+	}
+
+out:
+	span = now_ns() - start;
+	printf("replayed %ld reports in %.3f s, %.0f reports/s",
+	       sent, span / 1e9, span ? sent * 1e9 / span : 0);
+	if (!fast)
+		printf(", max %.1f us behind schedule", late_max / 1e3);
+	printf("\n");
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	uhid_write(fd, &ev);
+	close(fd);
+
+	for (i = 0; i < cap.count; i++)
+		free(cap.data[i]);
+	free(cap.data);
+	free(cap.size);
+	free(cap.time_ns);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,984 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * bench/wacom_uhid.c
+ *
+ *  End-to-end latency benchmark for the wacom module.
+ *
+ *  Each scenario creates a virtual device through /dev/uhid with the
+ *  bus/VID/PID of a wacom_ids entry, so the loaded module binds to it
+ *  exactly as it would to the hardware. Reports are then injected and
+ *  the evdev nodes the driver registers are read back: the latency of a
+ *  frame is its evdev timestamp minus the time the report that produced
+ *  it was written. A second, unpaced pass measures the sustained report
+ *  rate.
+ *
+ *  Needs read/write access to /dev/uhid and /dev/input/event*.
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#define USB_VENDOR_ID_WACOM	0x056a
+
+#define UHID_PKGLEN_MAX		361	/* WACOM_PKGLEN_MAX */
+#define UHID_MAX_NODES		8
+#define UHID_PROBE_TIMEOUT_MS	5000
+#define UHID_SETTLE_MS		500
+#define UHID_DRAIN_MS		200
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define min(a, b)		((a) < (b) ? (a) : (b))
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint64_t u64;
+
+struct uhid_report {
+	int len;
+	u8 data[UHID_PKGLEN_MAX];
+};
+
+struct uhid_feature {
+	u8 id;
+	u8 len;
+	u8 data[8];
+};
+
+struct uhid_scenario {
+	const char *name;
+	const char *desc;
+	u16 bus;
+	u16 product;
+	const u8 *rdesc;
+	size_t rdesc_size;
+	const struct uhid_feature *features;	/* GET_REPORT replies */
+	int (*generate)(int i, u8 *data);
+};
+
+static void put_le16(u8 *p, unsigned v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le64(u8 *p, u64 v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+/* A smooth, deterministic stroke position for step 'i' of 'n'. */
+static unsigned stroke(int i, int n, unsigned lo, unsigned hi)
+{
+	unsigned span = hi - lo;
+	int half = n / 2;
+	int k = i % n;
+
+	if (k > half)
+		k = n - k;
+	return lo + (unsigned)((u64)span * k / half);
+}
+
+/* ---- report descriptors ---- */
+
+/*
+ * Devices with a protocol of their own only need hid-core to know the
+ * report IDs and sizes; what the driver learns from the descriptor
+ * (pen/touch interface, x/y maxima) is kept in line with wacom_features.
+ */
+
+/* wacom_features_0x360: one 360 byte vendor report, ID 0x80 */
+static const u8 rdesc_intuosp2_bt[] = {
+	0x06, 0x00, 0xff,		/* Usage Page (Vendor 0xff00) */
+	0x09, 0x01,			/* Usage (1) */
+	0xa1, 0x01,			/* Collection (Application) */
+	0x85, 0x80,			/*  Report ID (0x80) */
+	0x09, 0x02,			/*  Usage (2) */
+	0x15, 0x00,			/*  Logical Minimum (0) */
+	0x26, 0xff, 0x00,		/*  Logical Maximum (255) */
+	0x75, 0x08,			/*  Report Size (8) */
+	0x96, 0x68, 0x01,		/*  Report Count (360) */
+	0x81, 0x02,			/*  Input (Data,Var,Abs) */
+	0xc0,				/* End Collection */
+};
+
+/* wacom_features_0x32C: 64 byte touch report, ID 13, 10 contacts */
+static const u8 rdesc_27qhdt[] = {
+	0x05, 0x0d,			/* Usage Page (Digitizer) */
+	0x09, 0x04,			/* Usage (Touch Screen) */
+	0xa1, 0x01,			/* Collection (Application) */
+	0x85, 0x0d,			/*  Report ID (13) */
+	0x09, 0x22,			/*  Usage (Finger) */
+	0xa1, 0x02,			/*  Collection (Logical) */
+	0x05, 0x01,			/*   Usage Page (Generic Desktop) */
+	0x09, 0x30,			/*   Usage (X) */
+	0x15, 0x00,			/*   Logical Minimum (0) */
+	0x26, 0xff, 0x3f,		/*   Logical Maximum (16383) */
+	0x75, 0x10,			/*   Report Size (16) */
+	0x95, 0x01,			/*   Report Count (1) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0x09, 0x31,			/*   Usage (Y) */
+	0x26, 0xff, 0x23,		/*   Logical Maximum (9215) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0xc0,				/*  End Collection */
+	0x06, 0x00, 0xff,		/*  Usage Page (Vendor 0xff00) */
+	0x09, 0x01,			/*  Usage (1) */
+	0x26, 0xff, 0x00,		/*  Logical Maximum (255) */
+	0x75, 0x08,			/*  Report Size (8) */
+	0x95, 0x3b,			/*  Report Count (59) */
+	0x81, 0x02,			/*  Input (Data,Var,Abs) */
+	0xc0,				/* End Collection */
+};
+
+/* wacom_features_0xDE touch interface: 64 byte report, ID 2 */
+static const u8 rdesc_bpt_touch[] = {
+	0x05, 0x0d,			/* Usage Page (Digitizer) */
+	0x09, 0x05,			/* Usage (Touch Pad) */
+	0xa1, 0x01,			/* Collection (Application) */
+	0x85, 0x02,			/*  Report ID (2) */
+	0x09, 0x22,			/*  Usage (Finger) */
+	0xa1, 0x02,			/*  Collection (Logical) */
+	0x05, 0x01,			/*   Usage Page (Generic Desktop) */
+	0x09, 0x30,			/*   Usage (X) */
+	0x15, 0x00,			/*   Logical Minimum (0) */
+	0x26, 0xff, 0x0f,		/*   Logical Maximum (4095) */
+	0x75, 0x10,			/*   Report Size (16) */
+	0x95, 0x01,			/*   Report Count (1) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0x09, 0x31,			/*   Usage (Y) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0xc0,				/*  End Collection */
+	0x06, 0x00, 0xff,		/*  Usage Page (Vendor 0xff00) */
+	0x09, 0x01,			/*  Usage (1) */
+	0x26, 0xff, 0x00,		/*  Logical Maximum (255) */
+	0x75, 0x08,			/*  Report Size (8) */
+	0x95, 0x3b,			/*  Report Count (59) */
+	0x81, 0x02,			/*  Input (Data,Var,Abs) */
+	0xc0,				/* End Collection */
+};
+
+#define GENERIC_FINGERS		10
+#define GENERIC_X_MAX		30000
+#define GENERIC_Y_MAX		17000
+
+#define GENERIC_FINGER						\
+	0x09, 0x22,			/*  Usage (Finger) */	\
+	0xa1, 0x02,			/*  Collection (Logical) */	\
+	0x09, 0x42,			/*   Usage (Tip Switch) */	\
+	0x15, 0x00,			/*   Logical Minimum (0) */	\
+	0x25, 0x01,			/*   Logical Maximum (1) */	\
+	0x75, 0x01,			/*   Report Size (1) */	\
+	0x95, 0x01,			/*   Report Count (1) */	\
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */	\
+	0x75, 0x07,			/*   Report Size (7) */	\
+	0x81, 0x03,			/*   Input (Cnst,Var,Abs) */	\
+	0x09, 0x51,			/*   Usage (Contact Identifier) */ \
+	0x26, 0xff, 0x00,		/*   Logical Maximum (255) */	\
+	0x75, 0x08,			/*   Report Size (8) */	\
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */	\
+	0x05, 0x01,			/*   Usage Page (Generic Desktop) */ \
+	0x09, 0x30,			/*   Usage (X) */		\
+	0x26, 0x30, 0x75,		/*   Logical Maximum (30000) */ \
+	0x75, 0x10,			/*   Report Size (16) */	\
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */	\
+	0x09, 0x31,			/*   Usage (Y) */		\
+	0x26, 0x68, 0x42,		/*   Logical Maximum (17000) */ \
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */	\
+	0x05, 0x0d,			/*   Usage Page (Digitizer) */	\
+	0xc0				/*  End Collection */
+
+/* HID_GENERIC display: pen report 2, touch report 3, CONTACTMAX feature 4 */
+static const u8 rdesc_generic[] = {
+	0x05, 0x0d,			/* Usage Page (Digitizer) */
+	0x09, 0x02,			/* Usage (Pen) */
+	0xa1, 0x01,			/* Collection (Application) */
+	0x85, 0x02,			/*  Report ID (2) */
+	0x09, 0x20,			/*  Usage (Stylus) */
+	0xa1, 0x00,			/*  Collection (Physical) */
+	0x09, 0x42,			/*   Usage (Tip Switch) */
+	0x09, 0x44,			/*   Usage (Barrel Switch) */
+	0x09, 0x45,			/*   Usage (Eraser) */
+	0x09, 0x3c,			/*   Usage (Invert) */
+	0x09, 0x32,			/*   Usage (In Range) */
+	0x15, 0x00,			/*   Logical Minimum (0) */
+	0x25, 0x01,			/*   Logical Maximum (1) */
+	0x75, 0x01,			/*   Report Size (1) */
+	0x95, 0x05,			/*   Report Count (5) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0x75, 0x03,			/*   Report Size (3) */
+	0x95, 0x01,			/*   Report Count (1) */
+	0x81, 0x03,			/*   Input (Cnst,Var,Abs) */
+	0x05, 0x01,			/*   Usage Page (Generic Desktop) */
+	0x09, 0x30,			/*   Usage (X) */
+	0x26, 0x30, 0x75,		/*   Logical Maximum (30000) */
+	0x75, 0x10,			/*   Report Size (16) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0x09, 0x31,			/*   Usage (Y) */
+	0x26, 0x68, 0x42,		/*   Logical Maximum (17000) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0x05, 0x0d,			/*   Usage Page (Digitizer) */
+	0x09, 0x30,			/*   Usage (Tip Pressure) */
+	0x26, 0xff, 0x0f,		/*   Logical Maximum (4095) */
+	0x81, 0x02,			/*   Input (Data,Var,Abs) */
+	0xc0,				/*  End Collection */
+	0xc0,				/* End Collection */
+
+	0x09, 0x04,			/* Usage (Touch Screen) */
+	0xa1, 0x01,			/* Collection (Application) */
+	0x85, 0x03,			/*  Report ID (3) */
+	GENERIC_FINGER, GENERIC_FINGER, GENERIC_FINGER, GENERIC_FINGER,
+	GENERIC_FINGER, GENERIC_FINGER, GENERIC_FINGER, GENERIC_FINGER,
+	GENERIC_FINGER, GENERIC_FINGER,
+	0x09, 0x54,			/*  Usage (Contact Count) */
+	0x25, 0x7f,			/*  Logical Maximum (127) */
+	0x75, 0x08,			/*  Report Size (8) */
+	0x95, 0x01,			/*  Report Count (1) */
+	0x81, 0x02,			/*  Input (Data,Var,Abs) */
+	0x85, 0x04,			/*  Report ID (4) */
+	0x09, 0x55,			/*  Usage (Contact Count Maximum) */
+	0xb1, 0x02,			/*  Feature (Data,Var,Abs) */
+	0xc0,				/* End Collection */
+};
+
+static const struct uhid_feature generic_features[] = {
+	{ 0x04, 2, { 0x04, GENERIC_FINGERS } },
+	{ 0 }
+};
+
+/* ---- report streams ---- */
+
+/* Intuos Pro 2 Bluetooth: 7 pen frames per report, leave every 64th. */
+static int generate_intuosp2_bt(int i, u8 *data)
+{
+	int k = i % 64;
+	int j;
+
+	data[0] = 0x80;
+	put_le64(&data[99], (1ULL << 52) | 0x0802123456ULL);
+	put_le16(&data[107], 0x0802);
+
+	for (j = 0; j < 7; j++) {
+		u8 *frame = &data[j * 14 + 1];
+		int step = k * 7 + j;
+		bool tip = k >= 4 && k < 60;
+
+		if (k == 63) {
+			frame[0] = j == 0 ? 0x80 : 0;
+			continue;
+		}
+
+		frame[0] = 0x80 | 0x40 | 0x20 | (tip ? 0x01 : 0);
+		put_le16(&frame[1], stroke(step, 448, 1000, 43000));
+		put_le16(&frame[3], stroke(step + 100, 448, 1000, 28000));
+		put_le16(&frame[5], tip ? stroke(step, 448, 100, 8000) : 0);
+		frame[7] = (step % 60) - 30;
+		frame[8] = 20 - (step % 40);
+		put_le16(&frame[9], step % 1800);
+		frame[13] = tip ? 0 : 30;
+	}
+
+	data[281] = 0x80;	/* touch switch on */
+	data[284] = 0x80 | 80;	/* charging, 80% */
+	return UHID_PKGLEN_MAX;
+}
+
+/* Cintiq 27QHD touch: 10 contacts in one report, lift every 128th. */
+static int generate_27qhdt(int i, u8 *data)
+{
+	int k = i % 128;
+	int f;
+
+	data[0] = 13;	/* WACOM_REPORT_TPCMT */
+	for (f = 0; f < 10; f++) {
+		u8 *c = &data[1 + 6 * f];
+
+		c[0] = k != 127;
+		c[1] = f;
+		put_le16(&c[2], stroke(k + 8 * f, 128, 500, 16000));
+		put_le16(&c[4], 500 + 800 * f + k);
+	}
+	data[63] = 10;
+	return 64;
+}
+
+/* Bamboo 16FG touch: 3 fingers plus a button message. */
+static int generate_bpt_touch(int i, u8 *data)
+{
+	const int fingers = 3;
+	int k = i % 128;
+	int j;
+
+	data[0] = 0x02;
+	data[1] = fingers + 1;
+	for (j = 0; j < fingers; j++) {
+		u8 *msg = &data[2 + 8 * j];
+		unsigned x = stroke(k + 16 * j, 128, 100, 4000);
+		unsigned y = 300 + 1000 * j + k;
+
+		msg[0] = 2 + j;
+		msg[1] = k != 127 ? 0x80 : 0;
+		msg[2] = x >> 4;
+		msg[3] = y >> 4;
+		msg[4] = (x & 0xf) << 4 | (y & 0xf);
+		msg[5] = 20 + j;
+	}
+	data[2 + 8 * fingers] = 128;
+	data[2 + 8 * fingers + 1] = (k >= 32 && k < 40) ? 0x01 : 0;
+	return 64;
+}
+
+/* HID_GENERIC display: a pen stroke, then ten fingers, alternating. */
+static int generate_generic(int i, u8 *data)
+{
+	int k = i % 512;
+	int f;
+
+	if (k < 256) {
+		bool range = k < 255;
+		bool tip = k >= 8 && k < 248;
+
+		data[0] = 0x02;
+		data[1] = (tip ? 0x01 : 0) | (range ? 0x10 : 0);
+		put_le16(&data[2], stroke(k, 256, 500, GENERIC_X_MAX - 500));
+		put_le16(&data[4], stroke(k + 64, 256, 500, GENERIC_Y_MAX - 500));
+		put_le16(&data[6], tip ? stroke(k, 256, 100, 4000) : 0);
+		return 8;
+	}
+
+	k -= 256;
+	data[0] = 0x03;
+	for (f = 0; f < GENERIC_FINGERS; f++) {
+		u8 *c = &data[1 + 6 * f];
+
+		c[0] = k != 255;
+		c[1] = f;
+		put_le16(&c[2], stroke(k + 16 * f, 256, 500, GENERIC_X_MAX - 500));
+		put_le16(&c[4], 1000 + 1500 * f + k);
+	}
+	data[1 + 6 * GENERIC_FINGERS] = GENERIC_FINGERS;
+	return 2 + 6 * GENERIC_FINGERS;
+}
+
+static const struct uhid_scenario scenarios[] = {
+	{ "intuos-pro", "Intuos Pro 2 M Bluetooth, pen/touch/pad",
+	  BUS_BLUETOOTH, 0x360, rdesc_intuosp2_bt, sizeof(rdesc_intuosp2_bt),
+	  NULL, generate_intuosp2_bt },
+	{ "27qhdt-touch", "Cintiq 27QHD touch, 10 fingers",
+	  BUS_USB, 0x32C, rdesc_27qhdt, sizeof(rdesc_27qhdt),
+	  NULL, generate_27qhdt },
+	{ "bamboo-pt-touch", "Bamboo 16FG touch, 3 fingers + buttons",
+	  BUS_USB, 0xDE, rdesc_bpt_touch, sizeof(rdesc_bpt_touch),
+	  NULL, generate_bpt_touch },
+	{ "generic-display", "HID_GENERIC pen + 10 finger touch display",
+	  BUS_USB, 0x5fff, rdesc_generic, sizeof(rdesc_generic),
+	  generic_features, generate_generic },
+};
+
+/* ---- uhid device ---- */
+
+struct uhid_bench {
+	const struct uhid_scenario *sc;
+	int uhid_fd;
+	int epoll_fd;
+	char phys[64];
+	int node_fd[UHID_MAX_NODES];
+	int nodes;
+
+	pthread_t reader;
+	volatile bool stop;
+
+	/* filled by the reader thread */
+	pthread_mutex_t lock;
+	u64 *frames;		/* SYN_REPORT times, ns */
+	long nframes;
+	long max_frames;
+	long dropped;		/* SYN_DROPPED seen */
+	u64 last_event;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+	ssize_t ret = write(fd, ev, sizeof(*ev));
+
+	if (ret < 0)
+		return -errno;
+	return ret == sizeof(*ev) ? 0 : -EFAULT;
+}
+
+static void uhid_answer(struct uhid_bench *b, const struct uhid_event *ev)
+{
+	struct uhid_event reply;
+	const struct uhid_feature *f;
+
+	memset(&reply, 0, sizeof(reply));
+
+	switch (ev->type) {
+	case UHID_GET_REPORT:
+		reply.type = UHID_GET_REPORT_REPLY;
+		reply.u.get_report_reply.id = ev->u.get_report.id;
+		reply.u.get_report_reply.err = EIO;
+		for (f = b->sc->features; f && f->len; f++) {
+			if (f->id != ev->u.get_report.rnum)
+				continue;
+			reply.u.get_report_reply.err = 0;
+			reply.u.get_report_reply.size = f->len;
+			memcpy(reply.u.get_report_reply.data, f->data, f->len);
+		}
+		uhid_write(b->uhid_fd, &reply);
+		break;
+	case UHID_SET_REPORT:
+		reply.type = UHID_SET_REPORT_REPLY;
+		reply.u.set_report_reply.id = ev->u.set_report.id;
+		uhid_write(b->uhid_fd, &reply);
+		break;
+	default:
+		/* START, STOP, OPEN, CLOSE and OUTPUT need no answer */
+		break;
+	}
+}
+
+static void evdev_drain(struct uhid_bench *b, int fd)
+{
+	struct input_event ev[64];
+	ssize_t n;
+	int i;
+
+	while ((n = read(fd, ev, sizeof(ev))) > 0) {
+		pthread_mutex_lock(&b->lock);
+		for (i = 0; i < n / (ssize_t)sizeof(ev[0]); i++) {
+			u64 t;
+
+			if (ev[i].type != EV_SYN)
+				continue;
+#ifdef input_event_sec
+			t = (u64)ev[i].input_event_sec * 1000000000ULL +
+			    (u64)ev[i].input_event_usec * 1000ULL;
+#else
+			t = (u64)ev[i].time.tv_sec * 1000000000ULL +
+			    (u64)ev[i].time.tv_usec * 1000ULL;
+#endif
+			if (ev[i].code == SYN_DROPPED)
+				b->dropped++;
+			else if (ev[i].code == SYN_REPORT &&
+				 b->nframes < b->max_frames)
+				b->frames[b->nframes++] = t;
+		}
+		b->last_event = now_ns();
+		pthread_mutex_unlock(&b->lock);
+	}
+}
+
+static void *uhid_reader(void *data)
+{
+	struct uhid_bench *b = data;
+	struct epoll_event ev[UHID_MAX_NODES + 1];
+	int n, i;
+
+	while (!b->stop) {
+		n = epoll_wait(b->epoll_fd, ev, ARRAY_SIZE(ev), 50);
+		for (i = 0; i < n; i++) {
+			int fd = ev[i].data.fd;
+
+			if (fd == b->uhid_fd) {
+				struct uhid_event uev;
+
+				if (read(fd, &uev, sizeof(uev)) > 0)
+					uhid_answer(b, &uev);
+			} else {
+				evdev_drain(b, fd);
+			}
+		}
+	}
+	return NULL;
+}
+
+static int uhid_create(struct uhid_bench *b)
+{
+	struct uhid_event ev;
+	struct epoll_event ee = { .events = EPOLLIN };
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name),
+		 "wacom-uhid %s", b->sc->name);
+	snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys),
+		 "%s", b->phys);
+	ev.u.create2.rd_size = b->sc->rdesc_size;
+	ev.u.create2.bus = b->sc->bus;
+	ev.u.create2.vendor = USB_VENDOR_ID_WACOM;
+	ev.u.create2.product = b->sc->product;
+	memcpy(ev.u.create2.rd_data, b->sc->rdesc, b->sc->rdesc_size);
+
+	ee.data.fd = b->uhid_fd;
+	if (epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->uhid_fd, &ee))
+		return -errno;
+
+	return uhid_write(b->uhid_fd, &ev);
+}
+
+/* Is this node one the driver registered for our uhid device? */
+static bool evdev_ours(struct uhid_bench *b, const char *path)
+{
+	char phys[64] = "";
+	bool ours;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		return false;
+
+	ours = ioctl(fd, EVIOCGPHYS(sizeof(phys) - 1), phys) >= 0 &&
+	       !strcmp(phys, b->phys);
+	close(fd);
+	return ours;
+}
+
+/*
+ * Wait for the driver to register its nodes, then for the count to stay
+ * put for a while: pen, touch and pad show up one after another.
+ */
+static int evdev_attach(struct uhid_bench *b)
+{
+	char seen[UHID_MAX_NODES][sizeof(((struct dirent *)0)->d_name)];
+	u64 start = now_ns(), stable = 0;
+	int i;
+
+	while (now_ns() - start < UHID_PROBE_TIMEOUT_MS * 1000000ULL) {
+		struct dirent *de;
+		DIR *dir = opendir("/dev/input");
+		int before = b->nodes;
+
+		if (!dir)
+			return -errno;
+
+		while ((de = readdir(dir)) && b->nodes < UHID_MAX_NODES) {
+			char path[300];
+			bool dup = false;
+			int clock = CLOCK_MONOTONIC;
+			struct epoll_event ee = { .events = EPOLLIN };
+			int fd;
+
+			if (strncmp(de->d_name, "event", 5))
+				continue;
+			for (i = 0; i < b->nodes; i++)
+				dup |= !strcmp(seen[i], de->d_name);
+			if (dup)
+				continue;
+
+			snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+			if (!evdev_ours(b, path))
+				continue;
+
+			fd = open(path, O_RDONLY | O_NONBLOCK);
+			if (fd < 0)
+				continue;
+			if (ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+				close(fd);
+				continue;
+			}
+
+			ee.data.fd = fd;
+			epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, fd, &ee);
+			snprintf(seen[b->nodes], sizeof(seen[0]), "%s", de->d_name);
+			b->node_fd[b->nodes++] = fd;
+		}
+		closedir(dir);
+
+		if (b->nodes != before)
+			stable = now_ns();
+		else if (b->nodes && now_ns() - stable > UHID_SETTLE_MS * 1000000ULL)
+			return 0;
+
+		usleep(20000);
+	}
+
+	return b->nodes ? 0 : -ENODEV;
+}
+
+static void uhid_destroy(struct uhid_bench *b)
+{
+	struct uhid_event ev = { .type = UHID_DESTROY };
+	int i;
+
+	b->stop = true;
+	pthread_join(b->reader, NULL);
+
+	for (i = 0; i < b->nodes; i++)
+		close(b->node_fd[i]);
+	uhid_write(b->uhid_fd, &ev);
+	close(b->uhid_fd);
+	close(b->epoll_fd);
+	free(b->frames);
+	pthread_mutex_destroy(&b->lock);
+}
+
+/* ---- measurement ---- */
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void wait_drained(struct uhid_bench *b)
+{
+	for (;;) {
+		u64 last;
+
+		usleep(UHID_DRAIN_MS * 1000 / 4);
+		pthread_mutex_lock(&b->lock);
+		last = b->last_event;
+		pthread_mutex_unlock(&b->lock);
+		if (now_ns() - last > UHID_DRAIN_MS * 1000000ULL)
+			return;
+	}
+}
+
+/*
+ * Inject 'count' reports every 'interval_us' (0: back to back) and
+ * record when each write was issued.
+ */
+static int inject(struct uhid_bench *b, const struct uhid_report *reports,
+		  long count, long interval_us, u64 *written)
+{
+	struct uhid_event ev;
+	struct timespec next;
+	long i;
+	int ret;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_INPUT2;
+
+	pthread_mutex_lock(&b->lock);
+	b->nframes = 0;
+	b->dropped = 0;
+	pthread_mutex_unlock(&b->lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < count; i++) {
+		const struct uhid_report *r = &reports[i];
+
+		if (interval_us) {
+			next.tv_nsec += interval_us * 1000;
+			while (next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+
+		ev.u.input2.size = r->len;
+		memcpy(ev.u.input2.data, r->data, r->len);
+
+		written[i] = now_ns();
+		ret = uhid_write(b->uhid_fd, &ev);
+		if (ret)
+			return ret;
+	}
+
+	wait_drained(b);
+	return 0;
+}
+
+/*
+ * Pair each frame with the last report written before it; reports that
+ * only fed a later frame (multi-packet touch, filtered events) do not
+ * produce a latency sample of their own.
+ */
+static long match_frames(struct uhid_bench *b, const u64 *written, long count,
+			 u64 *latency)
+{
+	long f, n = 0, w = 0;
+
+	for (f = 0; f < b->nframes; f++) {
+		u64 t = b->frames[f];
+
+		while (w + 1 < count && written[w + 1] <= t)
+			w++;
+		if (written[w] > t)
+			continue;
+		latency[n++] = t - written[w];
+	}
+
+	return n;
+}
+
+static int uhid_run(const struct uhid_scenario *sc, long count,
+		    long interval_us, const struct uhid_report *replay,
+		    long nreplay)
+{
+	struct uhid_bench b;
+	struct uhid_report *reports;
+	u64 *written, *latency;
+	long i, n, frames, dropped;
+	double rate;
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	b.sc = sc;
+	snprintf(b.phys, sizeof(b.phys), "wacom-uhid/%d/%s", getpid(), sc->name);
+	pthread_mutex_init(&b.lock, NULL);
+
+	reports = calloc(count, sizeof(*reports));
+	written = calloc(count, sizeof(*written));
+	b.max_frames = count * 8;
+	b.frames = calloc(b.max_frames, sizeof(*b.frames));
+	latency = calloc(b.max_frames, sizeof(*latency));
+	if (!reports || !written || !b.frames || !latency) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (replay) {
+			reports[i] = replay[i % nreplay];
+		} else {
+			reports[i].len = sc->generate(i, reports[i].data);
+		}
+	}
+
+	b.uhid_fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if (b.uhid_fd < 0) {
+		perror("/dev/uhid");
+		ret = 1;
+		goto out_free;
+	}
+	b.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	ret = uhid_create(&b);
+	if (!ret)
+		ret = pthread_create(&b.reader, NULL, uhid_reader, &b);
+	if (ret) {
+		fprintf(stderr, "%s: cannot create uhid device: %s\n",
+			sc->name, strerror(-ret));
+		close(b.uhid_fd);
+		close(b.epoll_fd);
+		ret = 1;
+		goto out_free;
+	}
+
+	ret = evdev_attach(&b);
+	if (ret) {
+		fprintf(stderr, "%s: no evdev node from the wacom driver; is the module loaded?\n",
+			sc->name);
+		ret = 1;
+		goto out_destroy;
+	}
+
+	/* paced pass: latency */
+	ret = inject(&b, reports, count, interval_us, written);
+	if (ret)
+		goto out_err;
+
+	pthread_mutex_lock(&b.lock);
+	n = match_frames(&b, written, count, latency);
+	frames = b.nframes;
+	dropped = b.dropped;
+	pthread_mutex_unlock(&b.lock);
+	qsort(latency, n, sizeof(*latency), cmp_u64);
+
+	/* unpaced pass: sustained rate */
+	ret = inject(&b, reports, count, 0, written);
+	if (ret)
+		goto out_err;
+
+	pthread_mutex_lock(&b.lock);
+	rate = b.nframes ?
+	       count * 1e9 / (double)(b.frames[b.nframes - 1] - written[0]) : 0;
+	dropped += b.dropped;
+	pthread_mutex_unlock(&b.lock);
+
+	if (!n) {
+		printf("%-16s %8ld %8ld  no frames matched\n",
+		       sc->name, count, frames);
+	} else {
+		printf("%-16s %8ld %8ld %8.1f %8.1f %8.1f %8.1f %10.0f %6ld\n",
+		       sc->name, count, frames,
+		       latency[n / 2] / 1e3,
+		       latency[min(n - 1, n * 99 / 100)] / 1e3,
+		       latency[min(n - 1, n * 999 / 1000)] / 1e3,
+		       latency[n - 1] / 1e3, rate, dropped);
+	}
+	ret = 0;
+	goto out_destroy;
+
+out_err:
+	fprintf(stderr, "%s: uhid write failed: %s\n", sc->name, strerror(-ret));
+	ret = 1;
+out_destroy:
+	uhid_destroy(&b);
+	goto out_free_arrays;
+out_free:
+	free(b.frames);
+	pthread_mutex_destroy(&b.lock);
+out_free_arrays:
+	free(reports);
+	free(written);
+	free(latency);
+	return ret;
+}
+
+static long load_replay(const char *path, struct uhid_report **out)
+{
+	char line[4096];
+	struct uhid_report *reports = NULL;
+	long count = 0, size = 0;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p = line, *end;
+		unsigned long v;
+		int len = 0;
+
+		if (!strncmp(p, "E:", 2)) {
+			strtod(p + 2, &end);		/* timestamp */
+			strtoul(end, &end, 10);		/* length */
+			p = end;
+		} else if (!isxdigit((unsigned char)*p)) {
+			continue;
+		}
+
+		if (count == size) {
+			size = size ? size * 2 : 256;
+			reports = realloc(reports, size * sizeof(*reports));
+			if (!reports) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+
+		for (;;) {
+			v = strtoul(p, &end, 16);
+			if (end == p || len == UHID_PKGLEN_MAX)
+				break;
+			reports[count].data[len++] = v;
+			p = end;
+		}
+		reports[count].len = len;
+		if (len)
+			count++;
+	}
+
+	fclose(f);
+	*out = reports;
+	return count;
+}
+
+static void usage(const char *prog)
+{
+	unsigned i;
+
+	fprintf(stderr,
+		"usage: %s [-n reports] [-i interval_us] [-s scenario]... [-r recording -s scenario] [-l]\n"
+		"  -n  reports injected per pass (default 10000)\n"
+		"  -i  spacing of the latency pass in us (default 1000)\n"
+		"  -s  run only the named scenario (may be repeated)\n"
+		"  -r  replay raw reports from a recording on the device of -s\n"
+		"  -l  list scenarios\n\nscenarios:\n", prog);
+	for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+		fprintf(stderr, "  %-16s %04x:%04x  %s\n", scenarios[i].name,
+			scenarios[i].bus, scenarios[i].product, scenarios[i].desc);
+}
+
+int main(int argc, char **argv)
+{
+	bool selected[ARRAY_SIZE(scenarios)] = { false };
+	bool any = false;
+	struct uhid_report *replay = NULL;
+	long nreplay = 0, count = 10000, interval_us = 1000;
+	const char *replay_path = NULL;
+	unsigned i;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:i:s:r:lh")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = atol(optarg);
+			if (count <= 0)
+				count = 1;
+			break;
+		case 'i':
+			interval_us = atol(optarg);
+			if (interval_us < 0)
+				interval_us = 0;
+			break;
+		case 's':
+			for (i = 0; i < ARRAY_SIZE(scenarios); i++)
+				if (!strcmp(optarg, scenarios[i].name))
+					break;
+			if (i == ARRAY_SIZE(scenarios)) {
+				fprintf(stderr, "unknown scenario '%s'\n", optarg);
+				usage(argv[0]);
+				return 1;
+			}
+			selected[i] = any = true;
+			break;
+		case 'r':
+			replay_path = optarg;
+			break;
+		case 'l':
+		case 'h':
+		default:
+			usage(argv[0]);
+			return opt == 'l' ? 0 : 1;
+		}
+	}
+
+	if (replay_path) {
+		if (!any) {
+			fprintf(stderr, "-r needs -s to pick the device\n");
+			return 1;
+		}
+		nreplay = load_replay(replay_path, &replay);
+		if (nreplay <= 0) {
+			fprintf(stderr, "%s: no reports\n", replay_path);
+			return 1;
+		}
+	}
+
+	printf("%-16s %8s %8s %8s %8s %8s %8s %10s %6s\n",
+	       "scenario", "reports", "frames", "p50_us", "p99_us", "p999_us",
+	       "max_us", "reports/s", "drops");
+
+	for (i = 0; i < ARRAY_SIZE(scenarios); i++) {
+		if (any && !selected[i])
+			continue;
+		if (uhid_run(&scenarios[i], count, interval_us, replay, nreplay))
+			ret = 1;
+	}
+
+	free(replay);
+	return ret;
+}
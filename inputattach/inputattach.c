@@ -41,35 +41,93 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <linux/serio.h>
+#include <poll.h>
+#include <pthread.h>
 #include "serio-ids.h"
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <syslog.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#include "w8001-uinput.h"
+
+/*
+ * Device replies are read in chunks rather than one byte per system call.
+ * Each thread has its own buffer, and in multi-port mode every port is
+ * initialized on a thread of its own, so the buffer only ever holds one
+ * port's bytes. It is thrown away when it is used for a different fd and
+ * before the line discipline takes the port over.
+ */
+static __thread struct {
+	int fd;
+	unsigned int head;
+	unsigned int tail;
+	unsigned char data[256];
+} rxbuf = { .fd = -1 };
+
+static void rxbuf_drop(void)
+{
+	rxbuf.fd = -1;
+	rxbuf.head = rxbuf.tail = 0;
+}
 
 static int readchar(int fd, unsigned char *c, int timeout)
 {
-	struct timeval tv;
-	fd_set set;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	ssize_t n;
 
-	tv.tv_sec = 0;
-	tv.tv_usec = timeout * 1000;
+	if (rxbuf.fd != fd) {
+		rxbuf_drop();
+		rxbuf.fd = fd;
+	}
 
-	FD_ZERO(&set);
-	FD_SET(fd, &set);
+	if (rxbuf.head == rxbuf.tail) {
+		if (poll(&pfd, 1, timeout) <= 0)
+			return -1;
 
-	if (!select(fd + 1, &set, NULL, NULL, &tv))
-		return -1;
+		n = read(fd, rxbuf.data, sizeof(rxbuf.data));
+		if (n <= 0)
+			return -1;
 
-	if (read(fd, c, 1) != 1)
-		return -1;
+		rxbuf.head = 0;
+		rxbuf.tail = n;
+	}
 
+	*c = rxbuf.data[rxbuf.head++];
 	return 0;
 }
 
+/* Discard input until the line has been quiet for timeout ms */
+static unsigned long flushline(int fd, int timeout)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	unsigned char buf[256];
+	unsigned long count = 0;
+	ssize_t n;
+
+	rxbuf_drop();
+	tcflush(fd, TCIFLUSH);
+
+	while (poll(&pfd, 1, timeout) > 0) {
+		n = read(fd, buf, sizeof(buf));
+		if (n <= 0)
+			break;
+		count += n;
+	}
+
+	return count;
+}
+
 static void setline(int fd, int flags, int speed)
 {
 	struct termios t;
@@ -508,6 +566,11 @@ static void show_help(void)
 
 	puts("");
 	puts("Usage: inputattach [--daemon] [--baud <baud>] <mode> <device>");
+	puts("       inputattach [--daemon] [--multi] [--baud <baud>] <mode> <device>"
+	     " [[--baud <baud>] <mode> <device>]...");
+	puts("       inputattach [--daemon] --uinput [--baud <baud>] --wacom <device>"
+	     " [[--baud <baud>] --wacom <device>]...");
+	puts("  <baud>  is a number, or 'auto' to detect it for --wacom");
 	puts("");
 	puts("Modes:");
 
@@ -521,35 +584,791 @@ static void show_help(void)
 /* palmed wisdom from http://stackoverflow.com/questions/1674162/ */
 #define RETRY_ERROR(x) (x == EAGAIN || x == EWOULDBLOCK || x == EINTR)
 
+static int baud_to_speed(int baud)
+{
+	switch (baud) {
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	default: return -1;
+	}
+}
+
+static int init_device(int fd, struct input_types *type, int no_init,
+		       int ignore_init_res, unsigned long *devt)
+{
+	unsigned long id = type->id;
+	unsigned long extra = type->extra;
+	int ldisc;
+
+	if (type->init && !no_init) {
+		if (type->init(fd, &id, &extra)) {
+			if (ignore_init_res) {
+				fprintf(stderr, "inputattach: ignored device initialization failure\n");
+			} else {
+				fprintf(stderr, "inputattach: device initialization failed\n");
+				return -1;
+			}
+		}
+	}
+
+	rxbuf_drop();
+
+	ldisc = N_MOUSE;
+	if (ioctl(fd, TIOCSETD, &ldisc) < 0) {
+		fprintf(stderr, "inputattach: can't set line discipline\n");
+		return -1;
+	}
+
+	*devt = type->type | (id << 8) | (extra << 16);
+
+	if (ioctl(fd, SPIOCSTYPE, devt) < 0) {
+		fprintf(stderr, "inputattach: can't set device type\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * W8001 baud rate detection ("--baud auto"). The digitizer is stopped and
+ * queried at each candidate rate, and only the right rate gets back a sane
+ * control packet: a lead byte with the tablet bit set, ten data bytes with
+ * the lead bit clear, and a non-zero sensor size. The rate that answered is
+ * remembered per device path and tried first the next time.
+ */
+#define W8001_PROBE_TIMEOUT	250	/* ms to wait for a query reply */
+
+#define BAUD_CACHE_DIR		"/var/cache/inputattach"
+
+static const int w8001_rates[] = { 19200, 38400 };
+
+struct w8001_probe {
+	int rates[3];
+	int nrates;
+	int cur;
+	int len;
+	unsigned char packet[W8001_PKTLEN_TPCCTL];
+};
+
+static void baud_cache_path(char *path, size_t size, const char *device)
+{
+	int n = snprintf(path, size, "%s/", BAUD_CACHE_DIR);
+	const char *c;
+
+	for (c = device; *c && n < size - 1; c++)
+		path[n++] = *c == '/' ? '_' : *c;
+	path[n] = '\0';
+}
+
+static int baud_cache_read(const char *device)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int baud;
+
+	baud_cache_path(path, sizeof(path), device);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	if (fscanf(f, "%d", &baud) != 1 || baud_to_speed(baud) < 0)
+		baud = -1;
+	fclose(f);
+
+	return baud;
+}
+
+static void baud_cache_write(const char *device, int baud)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 4];
+	FILE *f;
+
+	if (baud_cache_read(device) == baud)
+		return;
+
+	mkdir(BAUD_CACHE_DIR, 0755);
+	baud_cache_path(path, sizeof(path), device);
+	snprintf(tmp, sizeof(tmp), "%s.new", path);
+
+	f = fopen(tmp, "w");
+	if (!f)
+		return;
+
+	if (fprintf(f, "%d\n", baud) < 0 || fclose(f) || rename(tmp, path))
+		unlink(tmp);
+}
+
+static void w8001_probe_init(struct w8001_probe *probe, const char *device)
+{
+	int cached = baud_cache_read(device);
+	int i;
+
+	probe->nrates = 0;
+	probe->cur = 0;
+
+	if (cached > 0)
+		probe->rates[probe->nrates++] = cached;
+
+	for (i = 0; i < sizeof(w8001_rates) / sizeof(w8001_rates[0]); i++)
+		if (w8001_rates[i] != cached)
+			probe->rates[probe->nrates++] = w8001_rates[i];
+}
+
+static int w8001_probe_send(int fd, struct w8001_probe *probe, int flags)
+{
+	static const unsigned char cmd[] = { W8001_CMD_STOP, W8001_CMD_QUERY };
+
+	setline(fd, flags, baud_to_speed(probe->rates[probe->cur]));
+	rxbuf_drop();
+	tcflush(fd, TCIOFLUSH);
+	probe->len = -1;
+
+	return write(fd, cmd, sizeof(cmd)) == sizeof(cmd) ? 0 : -1;
+}
+
+/* returns 1 once a valid control packet has been seen */
+static int w8001_probe_feed(struct w8001_probe *probe,
+			    const unsigned char *data, int count)
+{
+	unsigned char *p = probe->packet;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (data[i] & W8001_LEAD_MASK)
+			probe->len = data[i] & W8001_TAB_MASK ? 0 : -1;
+
+		if (probe->len < 0)
+			continue;
+
+		p[probe->len++] = data[i];
+		if (probe->len < W8001_PKTLEN_TPCCTL)
+			continue;
+
+		/* maximum x and y, laid out like pen coordinates */
+		if ((p[1] | p[2] | (p[6] & 0x60)) && (p[3] | p[4] | (p[6] & 0x18)))
+			return 1;
+		probe->len = -1;
+	}
+
+	return 0;
+}
+
+/* Blocking detection for the single port case; returns the baud rate */
+static int w8001_detect(int fd, struct w8001_probe *probe, int flags)
+{
+	long long deadline, left;
+	unsigned char c;
+
+	for (probe->cur = 0; probe->cur < probe->nrates; probe->cur++) {
+		if (w8001_probe_send(fd, probe, flags))
+			return -1;
+
+		deadline = now_ms() + W8001_PROBE_TIMEOUT;
+		while ((left = deadline - now_ms()) > 0) {
+			if (readchar(fd, &c, left))
+				break;
+			if (w8001_probe_feed(probe, &c, 1))
+				return probe->rates[probe->cur];
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Multi-port mode: one process serves every port given on the command
+ * line. Opening, flushing and hangup handling all run from one epoll loop,
+ * so the flush timeouts of all ports overlap instead of adding up.
+ *
+ * Attaching a port runs the mode's init handshake, which is written as a
+ * blocking exchange, and the serport line discipline only registers the
+ * serio port while somebody sits in read() on the tty, offering nothing to
+ * poll on. So every port being attached gets a thread that does both, and
+ * reports back through a pipe once the port is initialized and again when
+ * the read returns because the line hung up. A device that is slow to
+ * answer its init only holds up its own thread.
+ *
+ * With --uinput, W8001 ports stay on the tty line discipline instead and
+ * their input is decoded by w8001-uinput.c from the same epoll loop.
+ */
+#define FLUSH_QUIET	100	/* ms of silence that ends a flush */
+#define REOPEN_DELAY	1000	/* ms between attempts to reopen a port */
+
+enum port_state {
+	PORT_CLOSED,
+	PORT_PROBE,
+	PORT_FLUSH,
+	PORT_INIT,
+	PORT_ATTACHED,
+	/* --uinput only, from here on */
+	PORT_STOP,
+	PORT_QUERY,
+	PORT_TOUCHQUERY,
+	PORT_BRIDGE,
+};
+
+static const char * const port_states[] = {
+	[PORT_CLOSED] = "closed",
+	[PORT_PROBE] = "probing",
+	[PORT_FLUSH] = "flushing",
+	[PORT_INIT] = "initializing",
+	[PORT_ATTACHED] = "attached",
+	[PORT_STOP] = "stopping",
+	[PORT_QUERY] = "querying pen",
+	[PORT_TOUCHQUERY] = "querying touch",
+	[PORT_BRIDGE] = "bridged",
+};
+
+struct port {
+	const char *device;
+	struct input_types *type;
+	int baud;
+	int speed;
+	int uinput;
+	int no_init;
+	int ignore_init_res;
+
+	int fd;
+	enum port_state state;
+	long long deadline;
+	long long opened;
+	int failing;
+	pthread_t thread;
+	struct w8001_probe probe;
+	struct w8001_uinput *bridge;
+
+	unsigned long attaches;
+	unsigned long hangups;
+	unsigned long errors;
+	unsigned long flushed;
+	long long attach_ms;
+	struct w8001_uinput_stats w8001;
+};
+
+/* What a port thread tells the epoll loop */
+enum port_event {
+	PORT_READY,		/* initialized, line discipline set */
+	PORT_INIT_FAILED,	/* the thread has exited */
+	PORT_HANGUP,		/* the line hung up, the thread has exited */
+};
+
+struct port_msg {
+	struct port *port;
+	enum port_event event;
+};
+
+static int port_pipe[2] = { -1, -1 };
+static int use_syslog;
+
+static void report(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	if (use_syslog) {
+		vsyslog(LOG_INFO, fmt, ap);
+	} else {
+		fputs("inputattach: ", stderr);
+		vfprintf(stderr, fmt, ap);
+		fputc('\n', stderr);
+	}
+	va_end(ap);
+}
+
+static void port_stats(const struct port *port)
+{
+	struct w8001_uinput_stats w8001 = { 0 };
+
+	report("%s (%s): %s, %lu attaches, %lu hangups, %lu errors, "
+	       "%lu bytes flushed, last attach took %lld ms",
+	       port->device, port->type->name + 2, port_states[port->state],
+	       port->attaches, port->hangups, port->errors,
+	       port->flushed, port->attach_ms);
+
+	if (!port->uinput)
+		return;
+
+	if (port->bridge)
+		w8001_uinput_stats(port->bridge, &w8001);
+
+	report("%s: %lu packets, %lu resyncs, %lu bytes dropped",
+	       port->device, port->w8001.packets + w8001.packets,
+	       port->w8001.resyncs + w8001.resyncs,
+	       port->w8001.dropped + w8001.dropped);
+}
+
+static void port_close(struct port *port, int epfd, long long now)
+{
+	struct w8001_uinput_stats w8001;
+
+	if (port->state != PORT_CLOSED && port->state != PORT_INIT &&
+	    port->state != PORT_ATTACHED)
+		epoll_ctl(epfd, EPOLL_CTL_DEL, port->fd, NULL);
+
+	if (port->bridge) {
+		w8001_uinput_stats(port->bridge, &w8001);
+		port->w8001.packets += w8001.packets;
+		port->w8001.resyncs += w8001.resyncs;
+		port->w8001.dropped += w8001.dropped;
+		w8001_uinput_destroy(port->bridge);
+		port->bridge = NULL;
+	}
+
+	close(port->fd);
+	port->fd = -1;
+	port->state = PORT_CLOSED;
+	port->deadline = now + REOPEN_DELAY;
+}
+
+static void port_fail(struct port *port, int epfd, const char *what)
+{
+	port->errors++;
+	if (!port->failing++)
+		report("%s: %s, retrying", port->device, what);
+	port_close(port, epfd, now_ms());
+}
+
+static void port_send(struct port *port, enum port_event event)
+{
+	struct port_msg msg = { .port = port, .event = event };
+
+	/* atomic: far below PIPE_BUF */
+	if (write(port_pipe[1], &msg, sizeof(msg)) != sizeof(msg))
+		abort();
+}
+
+static void *port_thread(void *arg)
+{
+	struct port *port = arg;
+	unsigned long devt;
+	int ret;
+
+	if (init_device(port->fd, port->type, port->no_init,
+			port->ignore_init_res, &devt)) {
+		port_send(port, PORT_INIT_FAILED);
+		return NULL;
+	}
+
+	port_send(port, PORT_READY);
+
+	do {
+		ret = read(port->fd, NULL, 0);
+	} while (ret < 0 && RETRY_ERROR(errno));
+
+	port_send(port, PORT_HANGUP);
+	return NULL;
+}
+
+static void port_attached(struct port *port, enum port_state state)
+{
+	port->state = state;
+	port->failing = 0;
+	port->attaches++;
+	port->attach_ms = now_ms() - port->opened;
+	report("%s: %s as %s in %lld ms", port->device, port_states[state],
+	       port->type->name + 2, port->attach_ms);
+}
+
+/*
+ * Decode the W8001 protocol here and hand the events to uinput. The
+ * digitizer is stopped and queried like w8001_connect() does, but each
+ * step only sends a command and sets a deadline, so a slow or silent
+ * port doesn't hold up the others.
+ */
+static void port_bridge(struct port *port, int epfd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = port };
+
+	port->bridge = w8001_uinput_create(port->fd);
+	if (!port->bridge) {
+		port_fail(port, epfd, strerror(errno));
+		return;
+	}
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, port->fd, &ev) < 0) {
+		port_fail(port, epfd, "can't poll port");
+		return;
+	}
+
+	port->state = PORT_STOP;
+	if (w8001_uinput_command(port->bridge, W8001_CMD_STOP)) {
+		port_fail(port, epfd, "can't stop W8001");
+		return;
+	}
+
+	port->deadline = now_ms() + W8001_DETECT_DELAY;
+}
+
+/* The current step is answered or timed out; move on to the next one */
+static void port_bridge_next(struct port *port, int epfd)
+{
+	unsigned char cmd;
+
+	switch (port->state) {
+	case PORT_STOP:
+		tcflush(port->fd, TCIFLUSH);
+		cmd = W8001_CMD_QUERY;
+		port->state = PORT_QUERY;
+		break;
+
+	case PORT_QUERY:
+		w8001_uinput_setup(port->bridge, W8001_CMD_QUERY);
+		cmd = W8001_CMD_TOUCHQUERY;
+		port->state = PORT_TOUCHQUERY;
+		break;
+
+	default:
+		w8001_uinput_setup(port->bridge, W8001_CMD_TOUCHQUERY);
+		if (w8001_uinput_start(port->bridge)) {
+			port_fail(port, epfd, strerror(errno));
+			return;
+		}
+		port_attached(port, PORT_BRIDGE);
+		return;
+	}
+
+	if (w8001_uinput_command(port->bridge, cmd)) {
+		port_fail(port, epfd, "can't query W8001");
+		return;
+	}
+
+	port->deadline = now_ms() + W8001_QUERY_TIMEOUT;
+}
+
+static void port_attach(struct port *port, int epfd)
+{
+	if (port->state == PORT_PROBE || port->state == PORT_FLUSH) {
+		epoll_ctl(epfd, EPOLL_CTL_DEL, port->fd, NULL);
+		port->state = PORT_CLOSED;
+	}
+
+	if (port->uinput) {
+		port_bridge(port, epfd);
+		return;
+	}
+
+	if (pthread_create(&port->thread, NULL, port_thread, port)) {
+		port_fail(port, epfd, "can't start port thread");
+		return;
+	}
+
+	port->state = PORT_INIT;
+}
+
+/* A port thread has news */
+static void port_event(struct port *port, int epfd, enum port_event event)
+{
+	if (event == PORT_READY) {
+		port_attached(port, PORT_ATTACHED);
+		return;
+	}
+
+	pthread_join(port->thread, NULL);
+
+	if (event == PORT_INIT_FAILED) {
+		port_fail(port, epfd, "attach failed");
+		return;
+	}
+
+	port->hangups++;
+	report("%s: hung up, reattaching", port->device);
+	port_close(port, epfd, now_ms());
+	port->deadline = 0;
+}
+
+/* Ports that wait on a thread or on input, not on a deadline */
+static int port_untimed(const struct port *port)
+{
+	return port->state == PORT_INIT || port->state == PORT_ATTACHED ||
+	       port->state == PORT_BRIDGE;
+}
+
+/* The line runs at the right speed; flush it if the mode wants that */
+static void port_ready(struct port *port, int epfd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = port };
+
+	if (!port->type->flush) {
+		port_attach(port, epfd);
+		return;
+	}
+
+	tcflush(port->fd, TCIFLUSH);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, port->fd, &ev) < 0) {
+		port_fail(port, epfd, "can't poll port");
+		return;
+	}
+
+	port->state = PORT_FLUSH;
+	port->deadline = now_ms() + FLUSH_QUIET;
+}
+
+/* Query the W8001 at the current candidate rate */
+static void port_probe(struct port *port, int epfd)
+{
+	if (port->probe.cur == port->probe.nrates) {
+		port_fail(port, epfd, "no W8001 reply at any baud rate");
+		return;
+	}
+
+	if (w8001_probe_send(port->fd, &port->probe, port->type->flags)) {
+		port_fail(port, epfd, "can't query W8001");
+		return;
+	}
+
+	port->deadline = now_ms() + W8001_PROBE_TIMEOUT;
+}
+
+static void port_detected(struct port *port, int epfd)
+{
+	int baud = port->probe.rates[port->probe.cur];
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, port->fd, NULL);
+	port->state = PORT_CLOSED;
+
+	report("%s: W8001 answered at %d baud", port->device, baud);
+	baud_cache_write(port->device, baud);
+
+	port->speed = baud_to_speed(baud);
+	setline(port->fd, port->type->flags, port->speed);
+	port_ready(port, epfd);
+}
+
+static void port_open(struct port *port, int epfd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = port };
+
+	port->fd = open(port->device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (port->fd < 0) {
+		port->errors++;
+		if (!port->failing++)
+			report("%s: %s, retrying", port->device,
+			       strerror(errno));
+		port->deadline = now_ms() + REOPEN_DELAY;
+		return;
+	}
+
+	port->opened = now_ms();
+	setline(port->fd, port->type->flags, port->speed);
+
+	if (port->baud) {
+		port_ready(port, epfd);
+		return;
+	}
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, port->fd, &ev) < 0) {
+		port_fail(port, epfd, "can't poll port");
+		return;
+	}
+
+	port->state = PORT_PROBE;
+	w8001_probe_init(&port->probe, port->device);
+	port_probe(port, epfd);
+}
+
+/*
+ * While flushing, throw away whatever arrived; the flush ends FLUSH_QUIET
+ * ms later. While probing, look for the reply to the W8001 query. Bridged
+ * ports decode everything that is pending in one go, and move on as soon
+ * as a query they sent is answered.
+ */
+static void port_input(struct port *port, int epfd, unsigned int events)
+{
+	unsigned char buf[1024];
+	ssize_t n;
+
+	while ((n = read(port->fd, buf, sizeof(buf))) > 0) {
+		if (port->state >= PORT_STOP) {
+			if (w8001_uinput_input(port->bridge, buf, n)) {
+				port_fail(port, epfd, "can't write to uinput");
+				return;
+			}
+			if ((port->state == PORT_QUERY ||
+			     port->state == PORT_TOUCHQUERY) &&
+			    w8001_uinput_answered(port->bridge)) {
+				port_bridge_next(port, epfd);
+				if (port->state == PORT_CLOSED)
+					return;
+			}
+		} else if (port->state == PORT_FLUSH) {
+			port->flushed += n;
+		} else if (w8001_probe_feed(&port->probe, buf, n)) {
+			port_detected(port, epfd);
+			return;
+		}
+	}
+
+	if (events & (EPOLLHUP | EPOLLERR) || !n ||
+	    (n < 0 && !RETRY_ERROR(errno))) {
+		port->hangups++;
+		if (port->state == PORT_BRIDGE) {
+			report("%s: hung up, reattaching", port->device);
+			port_close(port, epfd, now_ms());
+			port->deadline = 0;
+		} else {
+			report("%s: hung up while %s", port->device,
+			       port_states[port->state]);
+			port_close(port, epfd, now_ms());
+		}
+		return;
+	}
+
+	if (port->state == PORT_FLUSH)
+		port->deadline = now_ms() + FLUSH_QUIET;
+}
+
+static int multi_port(struct port *ports, int nports, int daemon_mode)
+{
+	struct epoll_event ev, events[16];
+	struct signalfd_siginfo si;
+	struct port_msg msg;
+	struct port *port;
+	sigset_t mask;
+	long long now;
+	int epfd, sigfd;
+	int timeout, wait;
+	int i, n;
+
+	if (daemon_mode) {
+		if (daemon(0, 0) < 0) {
+			perror("inputattach");
+			return EXIT_FAILURE;
+		}
+		openlog("inputattach", LOG_PID, LOG_DAEMON);
+		use_syslog = 1;
+	}
+
+	/* blocked here so the port threads never see them either */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+	if (epfd < 0 || sigfd < 0 || pipe(port_pipe) < 0) {
+		perror("inputattach");
+		return EXIT_FAILURE;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, port_pipe[0], &ev);
+	ev.data.ptr = &sigfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+
+	for (i = 0; i < nports; i++)
+		port_open(&ports[i], epfd);
+
+	for (;;) {
+		now = now_ms();
+		timeout = -1;
+
+		for (i = 0; i < nports; i++) {
+			port = &ports[i];
+			if (port_untimed(port))
+				continue;
+
+			if (port->deadline <= now) {
+				if (port->state == PORT_FLUSH) {
+					port_attach(port, epfd);
+				} else if (port->state >= PORT_STOP) {
+					port_bridge_next(port, epfd);
+				} else if (port->state == PORT_PROBE) {
+					port->probe.cur++;
+					port_probe(port, epfd);
+				} else {
+					port_open(port, epfd);
+				}
+				now = now_ms();
+			}
+
+			if (port_untimed(port))
+				continue;
+
+			wait = port->deadline > now ? port->deadline - now : 0;
+			if (timeout < 0 || wait < timeout)
+				timeout = wait;
+		}
+
+		n = epoll_wait(epfd, events, 16, timeout);
+		if (n < 0 && errno != EINTR) {
+			perror("inputattach");
+			return EXIT_FAILURE;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.ptr == &sigfd) {
+				if (read(sigfd, &si, sizeof(si)) != sizeof(si))
+					continue;
+				for (port = ports; port < ports + nports; port++)
+					port_stats(port);
+				if (si.ssi_signo != SIGUSR1)
+					return EXIT_SUCCESS;
+			} else if (!events[i].data.ptr) {
+				if (read(port_pipe[0], &msg, sizeof(msg)) != sizeof(msg))
+					continue;
+				port_event(msg.port, epfd, msg.event);
+			} else {
+				port_input(events[i].data.ptr, epfd,
+					   events[i].events);
+			}
+		}
+	}
+}
+
 int main(int argc, char **argv)
 {
 	unsigned long devt;
 	int ldisc;
 	struct input_types *type = NULL;
-	const char *device = NULL;
+	struct port *ports;
+	int nports = 0;
+	int multi = 0;
+	int uinput = 0;
 	int daemon_mode = 0;
 	int need_device = 0;
-	unsigned long id, extra;
 	int fd;
 	int i;
-	unsigned char c;
 	int retval;
 	int baud = -1;
 	int ignore_init_res = 0;
 	int no_init = 0;
 
+	ports = calloc(argc, sizeof(*ports));
+	if (!ports) {
+		perror("inputattach");
+		return EXIT_FAILURE;
+	}
+
 	for (i = 1; i < argc; i++) {
 		if (!strcasecmp(argv[i], "--help")) {
 			show_help();
 			return EXIT_SUCCESS;
 		} else if (!strcasecmp(argv[i], "--daemon")) {
 			daemon_mode = 1;
+		} else if (!strcasecmp(argv[i], "--multi")) {
+			multi = 1;
+		} else if (!strcasecmp(argv[i], "--uinput")) {
+			uinput = 1;
 		} else if (!strcasecmp(argv[i], "--always")) {
 			ignore_init_res = 1;
 		} else if (!strcasecmp(argv[i], "--noinit")) {
 			no_init = 1;
 		} else if (need_device) {
-			device = argv[i];
+			ports[nports++].device = argv[i];
 			need_device = 0;
 		} else if (!strcasecmp(argv[i], "--baud")) {
 			if (argc <= i + 1) {
@@ -559,14 +1378,17 @@ int main(int argc, char **argv)
 				return EXIT_FAILURE;
 			}
 
-			baud = atoi(argv[++i]);
-		} else {
-			if (type && type->name) {
-				fprintf(stderr,
-					"inputattach: '%s' - "
-					"only one mode allowed\n", argv[i]);
+			i++;
+			if (!strcasecmp(argv[i], "auto"))
+				baud = 0;
+			else
+				baud = atoi(argv[i]);
+			if (baud && baud_to_speed(baud) < 0) {
+				fprintf(stderr, "inputattach: invalid baud rate '%d'\n",
+						baud);
 				return EXIT_FAILURE;
 			}
+		} else {
 			for (type = input_types; type->name; type++) {
 				if (!strcasecmp(argv[i], type->name) ||
 				    !strcasecmp(argv[i], type->name2)) {
@@ -579,11 +1401,13 @@ int main(int argc, char **argv)
 					argv[i]);
 				return EXIT_FAILURE;
 			}
+			ports[nports].type = type;
+			ports[nports].baud = baud;
 			need_device = 1;
 		}
 	}
 
-	if (!type || !type->name) {
+	if (!nports && !need_device) {
 		fprintf(stderr, "inputattach: must specify mode\n");
 		return EXIT_FAILURE;
         }
@@ -593,58 +1417,63 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
-	if (fd < 0) {
-		fprintf(stderr, "inputattach: '%s' - %s\n",
-			device, strerror(errno));
-		return 1;
-	}
+	/* a lone port keeps honouring --baud given after it */
+	if (nports == 1)
+		ports[0].baud = baud;
 
-	switch(baud) {
-	case -1: break;
-	case 2400: type->speed = B2400; break;
-	case 4800: type->speed = B4800; break;
-	case 9600: type->speed = B9600; break;
-	case 19200: type->speed = B19200; break;
-	case 38400: type->speed = B38400; break;
-	default:
-		fprintf(stderr, "inputattach: invalid baud rate '%d'\n",
-				baud);
-		return EXIT_FAILURE;
+	for (i = 0; i < nports; i++) {
+		if (!ports[i].baud && ports[i].type->type != SERIO_W8001) {
+			fprintf(stderr, "inputattach: '%s' - baud rate "
+				"detection needs --wacom\n", ports[i].device);
+			return EXIT_FAILURE;
+		}
+
+		if (uinput && ports[i].type->type != SERIO_W8001) {
+			fprintf(stderr, "inputattach: '%s' - --uinput "
+				"needs --wacom\n", ports[i].device);
+			return EXIT_FAILURE;
+		}
+
+		ports[i].uinput = uinput;
+		ports[i].no_init = no_init;
+		ports[i].ignore_init_res = ignore_init_res;
+		ports[i].fd = -1;
+		ports[i].speed = ports[i].baud <= 0 ? ports[i].type->speed :
+			baud_to_speed(ports[i].baud);
 	}
 
-	setline(fd, type->flags, type->speed);
+	if (multi || uinput || nports > 1)
+		return multi_port(ports, nports, daemon_mode);
 
-	if (type->flush)
-		while (!readchar(fd, &c, 100))
-			/* empty */;
+	type = ports[0].type;
 
-	id = type->id;
-	extra = type->extra;
+	fd = open(ports[0].device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, "inputattach: '%s' - %s\n",
+			ports[0].device, strerror(errno));
+		return 1;
+	}
 
-	if (type->init && !no_init) {
-		if (type->init(fd, &id, &extra)) {
-			if (ignore_init_res) {
-				fprintf(stderr, "inputattach: ignored device initialization failure\n");
-			} else {
-				fprintf(stderr, "inputattach: device initialization failed\n");
-				return EXIT_FAILURE;
-			}
+	setline(fd, type->flags, ports[0].speed);
+
+	if (!ports[0].baud) {
+		w8001_probe_init(&ports[0].probe, ports[0].device);
+		baud = w8001_detect(fd, &ports[0].probe, type->flags);
+		if (baud < 0) {
+			fprintf(stderr, "inputattach: '%s' - no W8001 reply "
+				"at any baud rate\n", ports[0].device);
+			return EXIT_FAILURE;
 		}
-	}
 
-	ldisc = N_MOUSE;
-	if (ioctl(fd, TIOCSETD, &ldisc) < 0) {
-		fprintf(stderr, "inputattach: can't set line discipline\n");
-		return EXIT_FAILURE;
+		baud_cache_write(ports[0].device, baud);
+		setline(fd, type->flags, baud_to_speed(baud));
 	}
 
-	devt = type->type | (id << 8) | (extra << 16);
+	if (type->flush)
+		flushline(fd, FLUSH_QUIET);
 
-	if (ioctl(fd, SPIOCSTYPE, &devt) < 0) {
-		fprintf(stderr, "inputattach: can't set device type\n");
+	if (init_device(fd, type, no_init, ignore_init_res, &devt))
 		return EXIT_FAILURE;
-	}
 
 	retval = EXIT_SUCCESS;
 	if (daemon_mode && daemon(0, 0) < 0) {
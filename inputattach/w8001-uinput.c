@@ -0,0 +1,696 @@
+/*
+ * Wacom W8001 serial digitizer to uinput bridge
+ *
+ * For hosts that cannot load wacom_w8001.ko: inputattach reads the serial
+ * line itself and this file turns the bytes into the events the driver
+ * would have sent. Packets are assembled and decoded like w8001_interrupt()
+ * does, and the pen and touch devices get the driver's names, IDs and
+ * capabilities, so userspace cannot tell the two apart.
+ *
+ * Copyright (c) 2008 Jaya Kumar
+ * Copyright (c) 2010 Red Hat, Inc.
+ * Copyright (c) 2010 - 2011 Ping Cheng, Wacom. <pingc@wacom.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "w8001-uinput.h"
+
+/* resolution in points/mm */
+#define W8001_PEN_RESOLUTION    100
+#define W8001_TOUCH_RESOLUTION  10
+
+/* events queued per device before they have to be written out */
+#define W8001_EVENTS_MAX	64
+
+struct w8001_coord {
+	unsigned char rdy;
+	unsigned char tsw;
+	unsigned char f1;
+	unsigned char f2;
+	unsigned int x;
+	unsigned int y;
+	unsigned int pen_pressure;
+	unsigned char tilt_x;
+	unsigned char tilt_y;
+};
+
+/* touch query reply packet */
+struct w8001_touch_query {
+	unsigned int x;
+	unsigned int y;
+	unsigned char panel_res;
+	unsigned char capacity_res;
+	unsigned char sensor_id;
+};
+
+/*
+ * Events are queued and written with one write() per device for every
+ * chunk read from the line, rather than one per event.
+ */
+struct w8001_evdev {
+	int fd;
+	unsigned int count;
+	struct input_event ev[W8001_EVENTS_MAX];
+};
+
+/* what input_mt keeps for the two touch slots */
+struct w8001_slot {
+	int id;			/* tracking id, -1 when not in contact */
+	unsigned int x;
+	unsigned int y;
+};
+
+struct w8001_uinput {
+	int fd;
+	struct w8001_evdev pen;
+	struct w8001_evdev touch;
+	struct w8001_slot slots[2];
+	int trkid;
+	int error;
+	bool running;		/* the devices have been created */
+	bool has_pen;
+	bool has_touch;
+	char basename[64];
+	char phys[64];
+
+	unsigned int idx;
+	unsigned int expected;	/* length of the packet being assembled */
+	bool lost;		/* bytes were dropped since the last packet */
+	bool response_ready;
+	unsigned char response[W8001_MAX_LENGTH];
+	unsigned char data[W8001_MAX_LENGTH];
+	int type;
+	int id;
+	unsigned int pktlen;
+	unsigned int max_touch_x;
+	unsigned int max_touch_y;
+	unsigned int max_pen_x;
+	unsigned int max_pen_y;
+
+	struct w8001_uinput_stats stats;
+};
+
+static void evdev_flush(struct w8001_uinput *w8001, struct w8001_evdev *dev)
+{
+	size_t size = dev->count * sizeof(dev->ev[0]);
+
+	if (dev->count && write(dev->fd, dev->ev, size) != size)
+		w8001->error = -1;
+	dev->count = 0;
+}
+
+static void report(struct w8001_uinput *w8001, struct w8001_evdev *dev,
+		   int type, int code, int value)
+{
+	struct input_event *ev;
+
+	if (dev->count == W8001_EVENTS_MAX)
+		evdev_flush(w8001, dev);
+
+	ev = &dev->ev[dev->count++];
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+#define report_abs(w, dev, code, value)	report(w, dev, EV_ABS, code, value)
+#define report_key(w, dev, code, value)	report(w, dev, EV_KEY, code, !!(value))
+#define report_sync(w, dev)		report(w, dev, EV_SYN, SYN_REPORT, 0)
+
+static void parse_pen_data(unsigned char *data, struct w8001_coord *coord)
+{
+	memset(coord, 0, sizeof(*coord));
+
+	coord->rdy = data[0] & 0x20;
+	coord->tsw = data[0] & 0x01;
+	coord->f1 = data[0] & 0x02;
+	coord->f2 = data[0] & 0x04;
+
+	coord->x = (data[1] & 0x7F) << 9;
+	coord->x |= (data[2] & 0x7F) << 2;
+	coord->x |= (data[6] & 0x60) >> 5;
+
+	coord->y = (data[3] & 0x7F) << 9;
+	coord->y |= (data[4] & 0x7F) << 2;
+	coord->y |= (data[6] & 0x18) >> 3;
+
+	coord->pen_pressure = data[5] & 0x7F;
+	coord->pen_pressure |= (data[6] & 0x07) << 7 ;
+
+	coord->tilt_x = data[7] & 0x7F;
+	coord->tilt_y = data[8] & 0x7F;
+}
+
+static void parse_single_touch(unsigned char *data, struct w8001_coord *coord)
+{
+	coord->x = (data[1] << 7) | data[2];
+	coord->y = (data[3] << 7) | data[4];
+	coord->tsw = data[0] & 0x01;
+}
+
+static void scale_touch_coordinates(struct w8001_uinput *w8001,
+				    unsigned int *x, unsigned int *y)
+{
+	if (w8001->max_pen_x && w8001->max_touch_x)
+		*x = *x * w8001->max_pen_x / w8001->max_touch_x;
+
+	if (w8001->max_pen_y && w8001->max_touch_y)
+		*y = *y * w8001->max_pen_y / w8001->max_touch_y;
+}
+
+/* input_mt_slot() and input_mt_report_slot_state() */
+static void report_slot(struct w8001_uinput *w8001, int i, bool touch)
+{
+	struct w8001_evdev *dev = &w8001->touch;
+	struct w8001_slot *slot = &w8001->slots[i];
+
+	report_abs(w8001, dev, ABS_MT_SLOT, i);
+
+	if (!touch) {
+		slot->id = -1;
+		report_abs(w8001, dev, ABS_MT_TRACKING_ID, -1);
+		return;
+	}
+
+	if (slot->id < 0)
+		slot->id = w8001->trkid++ & 0xffff;
+	report_abs(w8001, dev, ABS_MT_TRACKING_ID, slot->id);
+	report_abs(w8001, dev, ABS_MT_TOOL_TYPE, MT_TOOL_FINGER);
+}
+
+/* input_mt_report_pointer_emulation(dev, true) */
+static void report_pointer_emulation(struct w8001_uinput *w8001)
+{
+	struct w8001_evdev *dev = &w8001->touch;
+	struct w8001_slot *oldest = NULL;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct w8001_slot *slot = &w8001->slots[i];
+
+		if (slot->id < 0)
+			continue;
+
+		if (!oldest ||
+		    ((slot->id - w8001->trkid) & 0xffff) <
+		    ((oldest->id - w8001->trkid) & 0xffff))
+			oldest = slot;
+		count++;
+	}
+
+	report_key(w8001, dev, BTN_TOUCH, count > 0);
+	report_key(w8001, dev, BTN_TOOL_FINGER, count == 1);
+	report_key(w8001, dev, BTN_TOOL_DOUBLETAP, count == 2);
+
+	if (oldest) {
+		report_abs(w8001, dev, ABS_X, oldest->x);
+		report_abs(w8001, dev, ABS_Y, oldest->y);
+	}
+}
+
+static void parse_multi_touch(struct w8001_uinput *w8001)
+{
+	struct w8001_evdev *dev = &w8001->touch;
+	unsigned char *data = w8001->data;
+	unsigned int x, y;
+	int i;
+	int count = 0;
+
+	for (i = 0; i < 2; i++) {
+		bool touch = data[0] & (1 << i);
+
+		report_slot(w8001, i, touch);
+		if (touch) {
+			x = (data[6 * i + 1] << 7) | data[6 * i + 2];
+			y = (data[6 * i + 3] << 7) | data[6 * i + 4];
+			/* data[5,6] and [11,12] is finger capacity */
+
+			/* scale to pen maximum */
+			scale_touch_coordinates(w8001, &x, &y);
+
+			w8001->slots[i].x = x;
+			w8001->slots[i].y = y;
+			report_abs(w8001, dev, ABS_MT_POSITION_X, x);
+			report_abs(w8001, dev, ABS_MT_POSITION_Y, y);
+			count++;
+		}
+	}
+
+	/* emulate single touch events when stylus is out of proximity.
+	 * This is to make single touch backward support consistent
+	 * across all Wacom single touch devices.
+	 */
+	if (w8001->type != BTN_TOOL_PEN &&
+			    w8001->type != BTN_TOOL_RUBBER) {
+		w8001->type = count == 1 ? BTN_TOOL_FINGER : KEY_RESERVED;
+		report_pointer_emulation(w8001);
+	}
+
+	report_sync(w8001, dev);
+}
+
+static void parse_touchquery(unsigned char *data,
+			     struct w8001_touch_query *query)
+{
+	memset(query, 0, sizeof(*query));
+
+	query->panel_res = data[1];
+	query->sensor_id = data[2] & 0x7;
+	query->capacity_res = data[7];
+
+	query->x = data[3] << 9;
+	query->x |= data[4] << 2;
+	query->x |= (data[2] >> 5) & 0x3;
+
+	query->y = data[5] << 9;
+	query->y |= data[6] << 2;
+	query->y |= (data[2] >> 3) & 0x3;
+
+	/* Early days' single-finger touch models need the following defaults */
+	if (!query->x && !query->y) {
+		query->x = 1024;
+		query->y = 1024;
+		if (query->panel_res)
+			query->x = query->y = (1 << query->panel_res);
+		query->panel_res = W8001_TOUCH_RESOLUTION;
+	}
+}
+
+static void report_pen_events(struct w8001_uinput *w8001,
+			      struct w8001_coord *coord)
+{
+	struct w8001_evdev *dev = &w8001->pen;
+
+	/* same tool guessing as the driver, see report_pen_events() there */
+	switch (w8001->type) {
+	case BTN_TOOL_RUBBER:
+		if (!coord->f2) {
+			report_abs(w8001, dev, ABS_PRESSURE, 0);
+			report_key(w8001, dev, BTN_TOUCH, 0);
+			report_key(w8001, dev, BTN_STYLUS, 0);
+			report_key(w8001, dev, BTN_STYLUS2, 0);
+			report_key(w8001, dev, BTN_TOOL_RUBBER, 0);
+			report_sync(w8001, dev);
+			w8001->type = BTN_TOOL_PEN;
+		}
+		break;
+
+	case BTN_TOOL_FINGER:
+	case KEY_RESERVED:
+		w8001->type = coord->f2 ? BTN_TOOL_RUBBER : BTN_TOOL_PEN;
+		break;
+
+	default:
+		report_key(w8001, dev, BTN_STYLUS2, coord->f2);
+		break;
+	}
+
+	report_abs(w8001, dev, ABS_X, coord->x);
+	report_abs(w8001, dev, ABS_Y, coord->y);
+	report_abs(w8001, dev, ABS_PRESSURE, coord->pen_pressure);
+	report_key(w8001, dev, BTN_TOUCH, coord->tsw);
+	report_key(w8001, dev, BTN_STYLUS, coord->f1);
+	report_key(w8001, dev, w8001->type, coord->rdy);
+	report_sync(w8001, dev);
+
+	if (!coord->rdy)
+		w8001->type = KEY_RESERVED;
+}
+
+static void report_single_touch(struct w8001_uinput *w8001,
+				struct w8001_coord *coord)
+{
+	struct w8001_evdev *dev = &w8001->touch;
+	unsigned int x = coord->x;
+	unsigned int y = coord->y;
+
+	/* scale to pen maximum */
+	scale_touch_coordinates(w8001, &x, &y);
+
+	report_abs(w8001, dev, ABS_X, x);
+	report_abs(w8001, dev, ABS_Y, y);
+	report_key(w8001, dev, BTN_TOUCH, coord->tsw);
+
+	report_sync(w8001, dev);
+
+	w8001->type = coord->tsw ? BTN_TOOL_FINGER : KEY_RESERVED;
+}
+
+static unsigned int w8001_packet_length(struct w8001_uinput *w8001,
+					unsigned char lead)
+{
+	if ((lead & W8001_TOUCH_MASK) == W8001_TOUCH_BYTE)
+		return w8001->pktlen;
+
+	if ((lead & W8001_TAB_MASK) == W8001_TAB_BYTE)
+		return W8001_PKTLEN_TPCCTL;
+
+	return W8001_PKTLEN_TPCPEN;
+}
+
+static void w8001_dispatch(struct w8001_uinput *w8001)
+{
+	struct w8001_coord coord;
+	unsigned char lead = w8001->data[0];
+
+	w8001->stats.packets++;
+
+	/* touch data */
+	if ((lead & W8001_TOUCH_MASK) == W8001_TOUCH_BYTE) {
+		if (!w8001->running || w8001->touch.fd < 0)
+			return;
+
+		if (w8001->pktlen == W8001_PKTLEN_TOUCH2FG) {
+			parse_multi_touch(w8001);
+		} else if (w8001->type != BTN_TOOL_PEN &&
+			   w8001->type != BTN_TOOL_RUBBER) {
+			parse_single_touch(w8001->data, &coord);
+			report_single_touch(w8001, &coord);
+		}
+		return;
+	}
+
+	/* control packet */
+	if ((lead & W8001_TAB_MASK) == W8001_TAB_BYTE) {
+		memcpy(w8001->response, w8001->data, W8001_MAX_LENGTH);
+		w8001->response_ready = true;
+		return;
+	}
+
+	/* Pen coordinates packet */
+	if (w8001->running && w8001->pen.fd >= 0) {
+		parse_pen_data(w8001->data, &coord);
+		report_pen_events(w8001, &coord);
+	}
+}
+
+int w8001_uinput_input(struct w8001_uinput *w8001,
+		       const unsigned char *buf, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		unsigned char data = buf[i];
+
+		/* resynchronize on lead bytes, as w8001_interrupt() does */
+		if ((data & W8001_LEAD_MASK) == W8001_LEAD_BYTE) {
+			if (w8001->idx || w8001->lost) {
+				w8001->stats.dropped += w8001->idx;
+				w8001->stats.resyncs++;
+				w8001->lost = false;
+			}
+			w8001->idx = 0;
+			w8001->expected = w8001_packet_length(w8001, data);
+		}
+
+		if (!w8001->expected) {
+			w8001->stats.dropped++;
+			w8001->lost = true;
+			continue;
+		}
+
+		w8001->data[w8001->idx++] = data;
+		if (w8001->idx == w8001->expected) {
+			w8001->idx = 0;
+			w8001->expected = 0;
+			w8001_dispatch(w8001);
+		}
+	}
+
+	if (w8001->running) {
+		if (w8001->pen.fd >= 0)
+			evdev_flush(w8001, &w8001->pen);
+		if (w8001->touch.fd >= 0)
+			evdev_flush(w8001, &w8001->touch);
+	}
+
+	return w8001->error;
+}
+
+static void set_abs(int fd, int code, int max, int res)
+{
+	struct uinput_abs_setup abs = {
+		.code = code,
+		.absinfo = { .maximum = max, .resolution = res },
+	};
+
+	ioctl(fd, UI_SET_EVBIT, EV_ABS);
+	ioctl(fd, UI_SET_ABSBIT, code);
+	ioctl(fd, UI_ABS_SETUP, &abs);
+}
+
+static void set_key(int fd, int code)
+{
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	ioctl(fd, UI_SET_KEYBIT, code);
+}
+
+static void w8001_setup_pen(struct w8001_uinput *w8001)
+{
+	char *basename = w8001->basename;
+	size_t basename_sz = sizeof(w8001->basename);
+	int fd = w8001->pen.fd;
+	struct w8001_coord coord;
+
+	set_key(fd, BTN_TOUCH);
+	set_key(fd, BTN_TOOL_PEN);
+	set_key(fd, BTN_TOOL_RUBBER);
+	set_key(fd, BTN_STYLUS);
+	set_key(fd, BTN_STYLUS2);
+	ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT);
+
+	parse_pen_data(w8001->response, &coord);
+	w8001->max_pen_x = coord.x;
+	w8001->max_pen_y = coord.y;
+
+	set_abs(fd, ABS_X, coord.x, W8001_PEN_RESOLUTION);
+	set_abs(fd, ABS_Y, coord.y, W8001_PEN_RESOLUTION);
+	set_abs(fd, ABS_PRESSURE, coord.pen_pressure, 0);
+	if (coord.tilt_x && coord.tilt_y) {
+		set_abs(fd, ABS_TILT_X, coord.tilt_x, 0);
+		set_abs(fd, ABS_TILT_Y, coord.tilt_y, 0);
+	}
+
+	w8001->id = 0x90;
+	strncat(basename, " Penabled", basename_sz - strlen(basename) - 1);
+	w8001->has_pen = true;
+}
+
+static void w8001_setup_touch(struct w8001_uinput *w8001)
+{
+	char *basename = w8001->basename;
+	size_t basename_sz = sizeof(w8001->basename);
+	int fd = w8001->touch.fd;
+	struct w8001_touch_query touch;
+
+	/*
+	 * Some non-touch devices may reply to the touch query. But their
+	 * second byte is empty, which indicates touch is not supported.
+	 */
+	if (!w8001->response[1])
+		return;
+
+	set_key(fd, BTN_TOUCH);
+	ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT);
+
+	parse_touchquery(w8001->response, &touch);
+	w8001->max_touch_x = touch.x;
+	w8001->max_touch_y = touch.y;
+
+	if (w8001->max_pen_x && w8001->max_pen_y) {
+		/* if pen is supported scale to pen maximum */
+		touch.x = w8001->max_pen_x;
+		touch.y = w8001->max_pen_y;
+		touch.panel_res = W8001_PEN_RESOLUTION;
+	}
+
+	set_abs(fd, ABS_X, touch.x, touch.panel_res);
+	set_abs(fd, ABS_Y, touch.y, touch.panel_res);
+
+	switch (touch.sensor_id) {
+	case 0:
+	case 2:
+		w8001->pktlen = W8001_PKTLEN_TOUCH93;
+		w8001->id = 0x93;
+		strncat(basename, " 1FG", basename_sz - strlen(basename) - 1);
+		break;
+
+	case 1:
+	case 3:
+	case 4:
+		w8001->pktlen = W8001_PKTLEN_TOUCH9A;
+		strncat(basename, " 1FG", basename_sz - strlen(basename) - 1);
+		w8001->id = 0x9a;
+		break;
+
+	case 5:
+		w8001->pktlen = W8001_PKTLEN_TOUCH2FG;
+
+		set_key(fd, BTN_TOOL_DOUBLETAP);
+		set_abs(fd, ABS_MT_SLOT, 1, 0);
+		set_abs(fd, ABS_MT_TRACKING_ID, 0xffff, 0);
+		set_abs(fd, ABS_MT_POSITION_X, touch.x, touch.panel_res);
+		set_abs(fd, ABS_MT_POSITION_Y, touch.y, touch.panel_res);
+		set_abs(fd, ABS_MT_TOOL_TYPE, MT_TOOL_MAX, 0);
+
+		strncat(basename, " 2FG", basename_sz - strlen(basename) - 1);
+		if (w8001->max_pen_x && w8001->max_pen_y)
+			w8001->id = 0xE3;
+		else
+			w8001->id = 0xE2;
+		break;
+	}
+
+	strncat(basename, " Touchscreen", basename_sz - strlen(basename) - 1);
+	w8001->has_touch = true;
+}
+
+static int w8001_register(struct w8001_uinput *w8001, int fd,
+			  const char *tool)
+{
+	struct uinput_setup setup;
+
+	memset(&setup, 0, sizeof(setup));
+	setup.id.bustype = BUS_RS232;
+	setup.id.vendor = 0x056a;
+	setup.id.product = w8001->id;
+	setup.id.version = 0x0100;
+	snprintf(setup.name, sizeof(setup.name), "%s %s", w8001->basename,
+		 tool);
+
+	if (ioctl(fd, UI_SET_PHYS, w8001->phys) < 0 ||
+	    ioctl(fd, UI_DEV_SETUP, &setup) < 0 ||
+	    ioctl(fd, UI_DEV_CREATE) < 0)
+		return -1;
+
+	return 0;
+}
+
+struct w8001_uinput *w8001_uinput_create(int fd)
+{
+	struct w8001_uinput *w8001;
+	char *phys;
+	const char *tty;
+	int i;
+
+	w8001 = calloc(1, sizeof(*w8001));
+	if (!w8001)
+		return NULL;
+
+	w8001->fd = fd;
+	w8001->pen.fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+	w8001->touch.fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+	if (w8001->pen.fd < 0 || w8001->touch.fd < 0) {
+		w8001_uinput_destroy(w8001);
+		return NULL;
+	}
+
+	for (i = 0; i < 2; i++)
+		w8001->slots[i].id = -1;
+
+	/* serport names its port after the tty, "ttyS0" or "pts3" */
+	phys = w8001->phys;
+	tty = ttyname(fd);
+	tty = tty && !strncmp(tty, "/dev/", 5) ? tty + 5 : "tty";
+	for (i = 0; *tty && i < 32; tty++)
+		if (*tty != '/')
+			phys[i++] = *tty;
+	snprintf(phys + i, sizeof(w8001->phys) - i, "/serio0/input0");
+
+	/* For backwards-compatibility we compose the basename based on
+	 * capabilities and then just append the tool type
+	 */
+	strcpy(w8001->basename, "Wacom Serial");
+
+	return w8001;
+}
+
+int w8001_uinput_command(struct w8001_uinput *w8001, unsigned char command)
+{
+	w8001->response_ready = false;
+
+	return write(w8001->fd, &command, 1) == 1 ? 0 : -1;
+}
+
+bool w8001_uinput_answered(const struct w8001_uinput *w8001)
+{
+	return w8001->response_ready;
+}
+
+void w8001_uinput_setup(struct w8001_uinput *w8001, unsigned char query)
+{
+	if (!w8001->response_ready)
+		return;
+
+	if (query == W8001_CMD_QUERY)
+		w8001_setup_pen(w8001);
+	else if (query == W8001_CMD_TOUCHQUERY)
+		w8001_setup_touch(w8001);
+}
+
+int w8001_uinput_start(struct w8001_uinput *w8001)
+{
+	if (!w8001->has_pen && !w8001->has_touch) {
+		errno = ENXIO;
+		return -1;
+	}
+
+	if (w8001->has_pen) {
+		if (w8001_register(w8001, w8001->pen.fd, "Pen"))
+			return -1;
+	} else {
+		close(w8001->pen.fd);
+		w8001->pen.fd = -1;
+	}
+
+	if (w8001->has_touch) {
+		if (w8001_register(w8001, w8001->touch.fd, "Finger"))
+			return -1;
+	} else {
+		close(w8001->touch.fd);
+		w8001->touch.fd = -1;
+	}
+
+	/* the driver starts the digitizer when its devices are opened */
+	if (w8001_uinput_command(w8001, W8001_CMD_START))
+		return -1;
+
+	w8001->running = true;
+
+	return 0;
+}
+
+void w8001_uinput_stats(const struct w8001_uinput *w8001,
+			struct w8001_uinput_stats *stats)
+{
+	*stats = w8001->stats;
+}
+
+void w8001_uinput_destroy(struct w8001_uinput *w8001)
+{
+	int error = errno;
+
+	if (w8001->pen.fd >= 0)
+		close(w8001->pen.fd);
+	if (w8001->touch.fd >= 0)
+		close(w8001->touch.fd);
+	free(w8001);
+
+	errno = error;
+}
@@ -0,0 +1,81 @@
+/*
+ * Wacom W8001 serial protocol, shared by inputattach's baud rate probe and
+ * its uinput bridge. Values are those of wacom_w8001.c.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef W8001_UINPUT_H
+#define W8001_UINPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define W8001_MAX_LENGTH	13
+#define W8001_LEAD_MASK		0x80
+#define W8001_LEAD_BYTE		0x80
+#define W8001_TAB_MASK		0x40
+#define W8001_TAB_BYTE		0x40
+/* set in first byte of touch data packets */
+#define W8001_TOUCH_MASK	(0x10 | W8001_LEAD_MASK)
+#define W8001_TOUCH_BYTE	(0x10 | W8001_LEAD_BYTE)
+
+#define W8001_CMD_STOP		'0'
+#define W8001_CMD_START		'1'
+#define W8001_CMD_QUERY		'*'
+#define W8001_CMD_TOUCHQUERY	'%'
+
+/* length of data packets in bytes, depends on device. */
+#define W8001_PKTLEN_TOUCH93	5
+#define W8001_PKTLEN_TOUCH9A	7
+#define W8001_PKTLEN_TPCPEN	9
+#define W8001_PKTLEN_TPCCTL	11	/* control packet */
+#define W8001_PKTLEN_TOUCH2FG	13
+
+struct w8001_uinput;
+
+struct w8001_uinput_stats {
+	unsigned long packets;
+	unsigned long resyncs;
+	unsigned long dropped;
+};
+
+/*
+ * Bringing the digitizer up follows w8001_detect() and w8001_setup_*() in
+ * the driver, but never blocks: the caller sends W8001_CMD_STOP, waits
+ * W8001_DETECT_DELAY ms, flushes the line and then sends W8001_CMD_QUERY
+ * and W8001_CMD_TOUCHQUERY in turn, feeding what it reads to
+ * w8001_uinput_input() until w8001_uinput_answered() or
+ * W8001_QUERY_TIMEOUT ms pass, and calling w8001_uinput_setup() after
+ * each. w8001_uinput_start() then creates the devices.
+ */
+#define W8001_DETECT_DELAY	250	/* ms between stop and query */
+#define W8001_QUERY_TIMEOUT	1000	/* ms to wait for a query reply */
+
+/* Opens uinput for the serial line fd; returns NULL with errno set */
+struct w8001_uinput *w8001_uinput_create(int fd);
+
+/* Sends a command and forgets any earlier reply */
+int w8001_uinput_command(struct w8001_uinput *w8001, unsigned char command);
+
+bool w8001_uinput_answered(const struct w8001_uinput *w8001);
+
+/* Applies the reply to a query, if there was one */
+void w8001_uinput_setup(struct w8001_uinput *w8001, unsigned char query);
+
+/* Creates the devices that answered and starts the digitizer */
+int w8001_uinput_start(struct w8001_uinput *w8001);
+
+/* Decodes bytes read from the line; returns -1 if writing events failed */
+int w8001_uinput_input(struct w8001_uinput *w8001,
+		       const unsigned char *data, size_t count);
+
+void w8001_uinput_stats(const struct w8001_uinput *w8001,
+			struct w8001_uinput_stats *stats);
+
+void w8001_uinput_destroy(struct w8001_uinput *w8001);
+
+#endif